@@ -0,0 +1,211 @@
+#include "bad_pixels.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace cv;
+
+// Enough for a full 5x5 neighbourhood
+static const int MAX_NEIGHBOURS = 24;
+
+bool BadPixelMap::load(const std::string &path)
+{
+    FileStorage storage(path, FileStorage::READ);
+    if (!storage.isOpened())
+    {
+        std::cerr << "Could not open bad pixel map " << path << std::endl;
+        return false;
+    }
+
+    Size frameSize((int)storage["width"], (int)storage["height"]);
+    FileNode list = storage["pixels"];
+    if (frameSize.area() <= 0 || !list.isSeq() || list.size() % 2 != 0)
+    {
+        std::cerr << path << ": expected width, height and a list of x, y pixels" << std::endl;
+        return false;
+    }
+
+    std::vector<int> values;
+    for (FileNodeIterator it = list.begin(); it != list.end(); ++it)
+    {
+        values.push_back((int)*it);
+    }
+    std::vector<Point> badPixels;
+    for (std::size_t i = 0; i < values.size(); i += 2)
+    {
+        badPixels.push_back(Point(values[i], values[i + 1]));
+    }
+
+    set(frameSize, badPixels);
+    return true;
+}
+
+bool BadPixelMap::save(const std::string &path) const
+{
+    FileStorage storage(path, FileStorage::WRITE);
+    if (!storage.isOpened())
+    {
+        std::cerr << "Could not write bad pixel map " << path << std::endl;
+        return false;
+    }
+
+    storage << "width" << size.width;
+    storage << "height" << size.height;
+    storage << "pixels" << "[:";
+    for (const Point &pixel : pixels)
+    {
+        storage << pixel.x << pixel.y;
+    }
+    storage << "]";
+    return true;
+}
+
+void BadPixelMap::set(Size frameSize, const std::vector<Point> &badPixels)
+{
+    size = frameSize;
+    pixels.clear();
+    entries.clear();
+    neighbours.clear();
+
+    Mat bad = Mat::zeros(size, CV_8UC1);
+    for (const Point &pixel : badPixels)
+    {
+        if (pixel.x >= 0 && pixel.y >= 0 && pixel.x < size.width && pixel.y < size.height)
+        {
+            bad.at<uchar>(pixel) = 1;
+            pixels.push_back(pixel);
+        }
+    }
+
+    for (const Point &pixel : pixels)
+    {
+        Entry entry;
+        entry.pixel = pixel;
+        entry.first = (int)neighbours.size();
+        for (int radius = 1; radius <= 2 && (int)neighbours.size() == entry.first; radius++)
+        {
+            for (int y = pixel.y - radius; y <= pixel.y + radius; y++)
+            {
+                for (int x = pixel.x - radius; x <= pixel.x + radius; x++)
+                {
+                    if (x >= 0 && y >= 0 && x < size.width && y < size.height && !bad.at<uchar>(y, x))
+                    {
+                        neighbours.push_back(Point(x, y));
+                    }
+                }
+            }
+        }
+        entry.count = (int)neighbours.size() - entry.first;
+
+        // A pixel in a 5x5 block of bad ones has nothing to go by, it stays as it is
+        if (entry.count > 0)
+        {
+            entries.push_back(entry);
+        }
+    }
+}
+
+void BadPixelMap::correct(Mat &raw) const
+{
+    if (raw.size() != size)
+    {
+        return;
+    }
+
+    uint16_t values[MAX_NEIGHBOURS];
+    for (const Entry &entry : entries)
+    {
+        for (int i = 0; i < entry.count; i++)
+        {
+            const Point &neighbour = neighbours[entry.first + i];
+            values[i] = raw.ptr<uint16_t>(neighbour.y)[neighbour.x];
+        }
+        std::nth_element(values, values + entry.count / 2, values + entry.count);
+        raw.ptr<uint16_t>(entry.pixel.y)[entry.pixel.x] = values[entry.count / 2];
+    }
+}
+
+void BadPixelCalibration::add(const Mat &raw)
+{
+    if (frames == 0)
+    {
+        sum = Mat::zeros(raw.size(), CV_64FC1);
+        sumSquares = Mat::zeros(raw.size(), CV_64FC1);
+    }
+    if (raw.size() != sum.size())
+    {
+        return;
+    }
+
+    for (int y = 0; y < raw.rows; y++)
+    {
+        const uint16_t *in = raw.ptr<uint16_t>(y);
+        double *s = sum.ptr<double>(y);
+        double *s2 = sumSquares.ptr<double>(y);
+        for (int x = 0; x < raw.cols; x++)
+        {
+            s[x] += in[x];
+            s2[x] += (double)in[x] * in[x];
+        }
+    }
+    frames++;
+}
+
+// Median of a copy of the values
+static float median_of(const Mat &values)
+{
+    std::vector<float> copy;
+    copy.reserve(values.total());
+    for (int y = 0; y < values.rows; y++)
+    {
+        copy.insert(copy.end(), values.ptr<float>(y), values.ptr<float>(y) + values.cols);
+    }
+    std::nth_element(copy.begin(), copy.begin() + copy.size() / 2, copy.end());
+    return copy[copy.size() / 2];
+}
+
+bool BadPixelCalibration::finish(BadPixelMap &map) const
+{
+    if (frames == 0)
+    {
+        return false;
+    }
+
+    Mat mean(sum.size(), CV_32FC1), noise(sum.size(), CV_32FC1);
+    for (int y = 0; y < sum.rows; y++)
+    {
+        for (int x = 0; x < sum.cols; x++)
+        {
+            double m = sum.at<double>(y, x) / frames;
+            mean.at<float>(y, x) = (float)m;
+            noise.at<float>(y, x) = (float)std::sqrt(std::max(sumSquares.at<double>(y, x) / frames - m * m, 0.0));
+        }
+    }
+
+    // How far each pixel is from its neighbourhood, and how far that typically is (MAD as a sigma)
+    Mat smooth, deviation;
+    medianBlur(mean, smooth, 5);
+    absdiff(mean, smooth, deviation);
+    float sigma = std::max(1.4826f * median_of(deviation), 1.0f);
+    float typicalNoise = median_of(noise);
+
+    std::vector<Point> badPixels;
+    for (int y = 0; y < sum.rows; y++)
+    {
+        for (int x = 0; x < sum.cols; x++)
+        {
+            float n = noise.at<float>(y, x);
+            bool outlier = deviation.at<float>(y, x) > deviationSigmas * sigma;
+            bool stuck = frames > 1 && n < stuckRatio * typicalNoise;
+            bool flickering = frames > 1 && n > flickerRatio * typicalNoise;
+            if (outlier || stuck || flickering)
+            {
+                badPixels.push_back(Point(x, y));
+            }
+        }
+    }
+
+    map.set(sum.size(), badPixels);
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef BAD_PIXELS_H
+#define BAD_PIXELS_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+// The dead, stuck and flickering pixels of one sensor, and their correction.
+//
+// The list is found once by BadPixelCalibration and kept in a FileStorage file:
+//
+//   width: 206
+//   height: 156
+//   pixels: [ x, y, x, y, ... ]
+//
+// Loading it works out, for every listed pixel, which of its neighbours are good: the 3x3 around it, or
+//  the 5x5 when the whole 3x3 is bad. Correcting a frame then only touches the listed pixels, each one
+//  replaced with the median of its good neighbours, so it costs next to nothing per frame.
+class BadPixelMap
+{
+public:
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    // Takes a new list and indexes it
+    void set(cv::Size frameSize, const std::vector<cv::Point> &badPixels);
+
+    // Frames of another size than the map's are left alone
+    void correct(cv::Mat &raw) const;
+
+    cv::Size size;
+    std::vector<cv::Point> pixels;
+
+private:
+    struct Entry
+    {
+        cv::Point pixel;
+        int first, count; // into neighbours
+    };
+
+    std::vector<Entry> entries;
+    std::vector<cv::Point> neighbours;
+};
+
+// Finds bad pixels in frames of an evenly warm scene, a lens cap or a wall. A pixel is bad when its
+//  average stands out from the 5x5 median around it by more than deviationSigmas times the frame's
+//  typical deviation, when it hardly changes from frame to frame while the others do (stuck), or when
+//  it changes far more than they do (flickering).
+class BadPixelCalibration
+{
+public:
+    double deviationSigmas = 8;
+    double stuckRatio = 0.1;       // of the median temporal noise
+    double flickerRatio = 10;
+
+    // Frames of another size than the first one are skipped
+    void add(const cv::Mat &raw);
+    // False when no frames were added
+    bool finish(BadPixelMap &map) const;
+
+    int frames = 0;
+
+private:
+    cv::Mat sum, sumSquares; // CV_64FC1
+};
+
+#endif
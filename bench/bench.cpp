@@ -0,0 +1,150 @@
+#include "bench.h"
+#include "../args.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <thread>
+#include <unistd.h>
+
+namespace bench
+{
+
+void Runner::add(const std::string &name, std::function<void()> body)
+{
+    cases.push_back({name, std::move(body)});
+}
+
+bool Runner::parse(int argc, char const *argv[])
+{
+    args::ArgumentParser parser("Seek Thermal pipeline benchmarks");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> arg_filter(parser, "regex", "Only run benchmarks whose name matches", {"benchmark_filter"});
+    args::ValueFlag<std::string> arg_min_time(parser, "seconds", "Minimum run time per benchmark", {"benchmark_min_time"});
+    args::ValueFlag<std::string> arg_out(parser, "file", "Write results as JSON to this file", {"benchmark_out"});
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help)
+    {
+        std::cout << parser;
+        return false;
+    }
+    catch (args::ParseError e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return false;
+    }
+
+    if (arg_filter)
+    {
+        filter = args::get(arg_filter);
+    }
+    if (arg_min_time)
+    {
+        minTime = std::stod(args::get(arg_min_time));
+    }
+    if (arg_out)
+    {
+        outFileName = args::get(arg_out);
+    }
+
+    return true;
+}
+
+void Runner::run()
+{
+    std::regex pattern(filter.empty() ? ".*" : filter);
+
+    printf("%-48s %14s %14s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+    printf("%s\n", std::string(91, '-').c_str());
+
+    for (auto &c : cases)
+    {
+        if (!std::regex_search(c.name, pattern))
+        {
+            continue;
+        }
+
+        // Warm up caches and lazily allocated buffers, then grow the batch until it is long enough to trust
+        c.body();
+
+        uint64_t iterations = 1;
+        double realNs = 0, cpuNs = 0;
+        while (true)
+        {
+            auto start = std::chrono::steady_clock::now();
+            double cpuStart = thread_cpu_ns();
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                c.body();
+            }
+            cpuNs = thread_cpu_ns() - cpuStart;
+            realNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+            if (realNs >= minTime * 1e9 || iterations >= 1000000000ull)
+            {
+                break;
+            }
+
+            // Aim a bit past the target so we usually need only one more round
+            double factor = realNs > 0 ? (minTime * 1e9 * 1.4) / realNs : 10;
+            iterations = (uint64_t)(iterations * std::min(std::max(factor, 2.0), 10.0));
+        }
+
+        Result result{c.name, iterations, realNs / iterations, cpuNs / iterations};
+        resultList.push_back(result);
+        printf("%-48s %11.0f ns %11.0f ns %12llu\n", result.name.c_str(), result.realNs, result.cpuNs, (unsigned long long)result.iterations);
+    }
+}
+
+bool Runner::writeJson(const std::string &fileName) const
+{
+    std::ofstream out(fileName);
+    if (!out)
+    {
+        return false;
+    }
+
+    char hostName[256] = "";
+    gethostname(hostName, sizeof(hostName) - 1);
+
+    auto now = std::time(nullptr);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"host_name\": \"" << hostName << "\",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < resultList.size(); i++)
+    {
+        const auto &r = resultList[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << r.name << "\",\n";
+        out << "      \"run_name\": \"" << r.name << "\",\n";
+        out << "      \"run_type\": \"iteration\",\n";
+        out << "      \"iterations\": " << r.iterations << ",\n";
+        out << "      \"real_time\": " << r.realNs << ",\n";
+        out << "      \"cpu_time\": " << r.cpuNs << ",\n";
+        out << "      \"time_unit\": \"ns\"\n";
+        out << "    }" << (i + 1 < resultList.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+
+    return (bool)out;
+}
+
+} // namespace bench
@@ -0,0 +1,72 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Minimal stand-in for Google Benchmark: registers named cases, grows the iteration count until a case
+//  runs for --benchmark_min_time seconds and reports real/cpu time per iteration. The JSON written by
+//  --benchmark_out uses Google Benchmark's layout so existing comparison tooling can read it.
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    double realNs; // per iteration
+    double cpuNs;  // per iteration, this thread only
+};
+
+class Runner
+{
+public:
+    void add(const std::string &name, std::function<void()> body);
+
+    // Parses --benchmark_filter, --benchmark_min_time, --benchmark_out and --help. Returns false on --help or a bad flag.
+    bool parse(int argc, char const *argv[]);
+
+    // Runs every registered case matching the filter, printing a table as it goes
+    void run();
+
+    bool writeJson(const std::string &fileName) const;
+
+    const std::vector<Result> &results() const { return resultList; }
+    const std::string &outFile() const { return outFileName; }
+
+private:
+    struct Case
+    {
+        std::string name;
+        std::function<void()> body;
+    };
+
+    std::vector<Case> cases;
+    std::vector<Result> resultList;
+    std::string filter;
+    std::string outFileName;
+    double minTime = 0.5;
+};
+
+inline double thread_cpu_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Keeps the optimizer from discarding a computed value
+template <typename T>
+inline void do_not_optimize(T const &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+#endif
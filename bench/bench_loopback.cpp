@@ -0,0 +1,324 @@
+// End to end throughput of the streamer protocol over loopback.
+//
+// Plays the part of the server streamer.cpp connects to: starts the real streamer binary on a synthetic
+//  frame source, requests frames as fast as they come back and reports frames per second, request to
+//  response latency percentiles and CPU time per frame on both sides. No camera or network needed.
+//
+// --mode=stream subscribes once instead of requesting every frame; latency is then the time between
+//  consecutive frames. --header=binary negotiates the binary FrameHeader and checks every payload CRC.
+
+#include <SFML/Network.hpp>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../args.h"
+#include "../protocol.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static bool receiveAll(sf::TcpSocket &socket, void *data, std::size_t size)
+{
+    std::size_t done = 0;
+    while (done < size)
+    {
+        std::size_t received;
+        if (socket.receive((char *)data + done, size - done, received) != sf::Socket::Done)
+        {
+            return false;
+        }
+        done += received;
+    }
+    return true;
+}
+
+// Reads one ":::%010lu" or FrameHeader framed image, returns its size or -1
+static long receiveImage(sf::TcpSocket &socket, std::vector<char> &buffer, bool binary, FrameHeader &frameHeader)
+{
+    long size;
+    if (binary)
+    {
+        uint8_t header[FRAME_HEADER_SIZE];
+        if (!receiveAll(socket, header, FRAME_HEADER_SIZE) || !read_frame_header(header, frameHeader))
+        {
+            return -1;
+        }
+        size = frameHeader.payloadSize;
+    }
+    else
+    {
+        char header[14] = {0};
+        if (!receiveAll(socket, header, 13) || strncmp(header, ":::", 3) != 0)
+        {
+            return -1;
+        }
+        size = strtol(header + 3, nullptr, 10);
+    }
+
+    buffer.resize(size);
+    if (!receiveAll(socket, buffer.data(), size))
+    {
+        return -1;
+    }
+    if (binary && crc32(buffer.data(), size) != frameHeader.payloadCrc)
+    {
+        return -1;
+    }
+    return size;
+}
+
+// utime + stime of a child process, in seconds
+static double processCpuSeconds(pid_t pid)
+{
+    char path[64];
+    sprintf(path, "/proc/%d/stat", (int)pid);
+    std::ifstream stat(path);
+    std::string content((std::istreambuf_iterator<char>(stat)), std::istreambuf_iterator<char>());
+
+    // Skip past "pid (comm)", comm may contain spaces
+    auto pos = content.rfind(')');
+    if (pos == std::string::npos)
+    {
+        return 0;
+    }
+
+    unsigned long utime = 0, stime = 0;
+    sscanf(content.c_str() + pos + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+    return (utime + stime) / (double)sysconf(_SC_CLK_TCK);
+}
+
+static double selfCpuSeconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static std::string defaultStreamerPath()
+{
+    char self[4096];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length <= 0)
+    {
+        return "./streamer";
+    }
+    self[length] = '\0';
+    std::string path(self);
+    return path.substr(0, path.rfind('/') + 1) + "streamer";
+}
+
+static double percentile(std::vector<double> sorted, double p)
+{
+    size_t index = std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()));
+    return sorted[index];
+}
+
+// A whole non-negative number of frames, -1 for anything else
+static int parseCount(const std::string &text)
+{
+    char *end;
+    long value = strtol(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && value >= 0 && value <= 1000000000 ? (int)value : -1;
+}
+
+int main(int argc, char const *argv[])
+{
+    args::ArgumentParser parser("Seek Thermal streamer loopback benchmark");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> arg_streamer(parser, "path", "streamer binary to drive", {"streamer"});
+    args::ValueFlag<std::string> arg_source(parser, "source", "Frame source passed to the streamer", {"source"});
+    args::ValueFlag<std::string> arg_mode(parser, "mode", "request (one command per frame) or stream", {"mode"});
+    args::ValueFlag<std::string> arg_header(parser, "header", "ascii (:::length) or binary", {"header"});
+    args::ValueFlag<std::string> arg_frames(parser, "count", "Frames to measure", {"frames"});
+    args::ValueFlag<std::string> arg_warmup(parser, "count", "Frames to discard first", {"warmup"});
+    args::ValueFlag<std::string> arg_out(parser, "file", "Write results as JSON to this file", {"out"});
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help)
+    {
+        std::cout << parser;
+        return 0;
+    }
+    catch (args::ParseError e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::string streamerPath = arg_streamer ? args::get(arg_streamer) : defaultStreamerPath();
+    std::string source = arg_source ? args::get(arg_source) : "synthetic";
+    std::string mode = arg_mode ? args::get(arg_mode) : "request";
+    bool stream = mode == "stream";
+    bool binary = arg_header && args::get(arg_header) == "binary";
+    int frames = arg_frames ? parseCount(args::get(arg_frames)) : 500;
+    int warmup = arg_warmup ? parseCount(args::get(arg_warmup)) : 20;
+    // Every result is per measured frame
+    if (frames < 1 || warmup < 0)
+    {
+        std::cerr << "--frames needs at least 1 frame and --warmup 0 or more" << std::endl;
+        return 1;
+    }
+
+    sf::TcpListener listener;
+    if (listener.listen(sf::Socket::AnyPort, sf::IpAddress::LocalHost) != sf::Socket::Done)
+    {
+        std::cerr << "Could not listen on loopback" << std::endl;
+        return 1;
+    }
+    std::string port = std::to_string(listener.getLocalPort());
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        std::string sourceFlag = "--source=" + source;
+        execl(streamerPath.c_str(), streamerPath.c_str(), "--host", "127.0.0.1", "--port", port.c_str(),
+              sourceFlag.c_str(), "--source-fps=0", (char *)nullptr);
+        perror("exec streamer");
+        _exit(127);
+    }
+
+    sf::TcpSocket socket;
+    if (listener.accept(socket) != sf::Socket::Done)
+    {
+        std::cerr << "Streamer did not connect" << std::endl;
+        kill(child, SIGTERM);
+        return 1;
+    }
+
+    // Both the binary header and streaming are commands, which the streamer only takes after the hello
+    char ack = 0;
+    if ((binary || stream) && (socket.send(&COMMAND_HELLO, 1) != sf::Socket::Done || !receiveAll(socket, &ack, 1) ||
+                               ack != COMMAND_HELLO_ACK))
+    {
+        std::cerr << "The streamer does not take commands" << std::endl;
+        kill(child, SIGTERM);
+        return 1;
+    }
+
+    const char headerVersion[] = {COMMAND_HEADER_VERSION, '1'};
+    if (binary && socket.send(headerVersion, sizeof(headerVersion)) != sf::Socket::Done)
+    {
+        std::cerr << "Could not negotiate the binary header" << std::endl;
+        kill(child, SIGTERM);
+        return 1;
+    }
+
+    std::vector<char> image;
+    FrameHeader frameHeader;
+    uint32_t firstSequence = 0;
+    uint64_t transitUs = 0;
+    std::vector<double> latencies;
+    latencies.reserve(frames);
+    size_t bytes = 0;
+    const char command = COMMAND_SINGLE_FRAME;
+    const char subscribe[] = {COMMAND_SUBSCRIBE, '0', '0', '0'};
+
+    double streamerCpuStart = 0, selfCpuStart = 0;
+    Clock::time_point start, previous = Clock::now();
+
+    for (int i = 0; i < warmup + frames; i++)
+    {
+        if (i == warmup)
+        {
+            streamerCpuStart = processCpuSeconds(child);
+            selfCpuStart = selfCpuSeconds();
+            start = Clock::now();
+        }
+
+        auto requested = Clock::now();
+        sf::Socket::Status sent = sf::Socket::Done;
+        if (!stream)
+        {
+            sent = socket.send(&command, 1);
+        }
+        else if (i == 0)
+        {
+            sent = socket.send(subscribe, sizeof(subscribe));
+        }
+
+        long size;
+        if (sent != sf::Socket::Done || (size = receiveImage(socket, image, binary, frameHeader)) < 0)
+        {
+            std::cerr << "Streamer dropped the connection after " << i << " frames" << std::endl;
+            kill(child, SIGTERM);
+            return 1;
+        }
+
+        if (stream)
+        {
+            requested = previous;
+            previous = Clock::now();
+        }
+
+        if (i == warmup)
+        {
+            firstSequence = frameHeader.sequence;
+        }
+
+        if (i >= warmup)
+        {
+            transitUs += timestamp_us() - frameHeader.captureTimeUs;
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - requested).count());
+            bytes += size;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    double streamerCpu = processCpuSeconds(child) - streamerCpuStart;
+    double selfCpu = selfCpuSeconds() - selfCpuStart;
+
+    // Signal first so the streamer exits instead of reconnecting when the socket closes
+    kill(child, SIGTERM);
+    socket.disconnect();
+    waitpid(child, nullptr, 0);
+
+    std::sort(latencies.begin(), latencies.end());
+    double fps = frames / elapsed;
+    double p50 = percentile(latencies, 50), p90 = percentile(latencies, 90), p99 = percentile(latencies, 99);
+    double maxLatency = latencies.back();
+    double streamerCpuMs = streamerCpu * 1000.0 / frames, selfCpuMs = selfCpu * 1000.0 / frames;
+
+    printf("mode              %s\n", mode.c_str());
+    printf("frames            %d\n", frames);
+    printf("frames/s          %.1f\n", fps);
+    printf("bytes/frame       %zu\n", bytes / frames);
+    printf("latency p50/p90/p99/max  %.2f / %.2f / %.2f / %.2f ms\n", p50, p90, p99, maxLatency);
+    if (binary)
+    {
+        // Frames the streamer captured but this client never saw, and capture to receive time
+        printf("skipped frames    %u\n", frameHeader.sequence - firstSequence + 1 - frames);
+        printf("capture to receive %.2f ms\n", transitUs / 1000.0 / frames);
+    }
+    printf("streamer cpu/frame %.2f ms\n", streamerCpuMs);
+    printf("server cpu/frame   %.2f ms\n", selfCpuMs);
+
+    if (arg_out)
+    {
+        std::ofstream out(args::get(arg_out));
+        out << "{\n";
+        out << "  \"source\": \"" << source << "\",\n";
+        out << "  \"mode\": \"" << mode << "\",\n";
+        out << "  \"frames\": " << frames << ",\n";
+        out << "  \"fps\": " << fps << ",\n";
+        out << "  \"bytes_per_frame\": " << bytes / frames << ",\n";
+        out << "  \"latency_ms\": {\"p50\": " << p50 << ", \"p90\": " << p90 << ", \"p99\": " << p99 << ", \"max\": " << maxLatency << "},\n";
+        out << "  \"streamer_cpu_ms_per_frame\": " << streamerCpuMs << ",\n";
+        out << "  \"server_cpu_ms_per_frame\": " << selfCpuMs << "\n";
+        out << "}\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+// Microbenchmarks for process_frame and each of its steps, on synthetic frames of both camera models
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+#include <memory>
+#include "bench.h"
+#include "../bad_pixels.h"
+#include "../frame_source.h"
+#include "../grey_frame.h"
+#include "../hotspot_tracker.h"
+#include "../nuc.h"
+#include "../parallel_jpeg.h"
+#include "../process_frame.h"
+#include "../raw_codec.h"
+#include "../roi_index.h"
+#include "../zone_alarm.h"
+#include "../rotate_scale.h"
+
+using namespace cv;
+
+static const int COLORMAP = 11;
+static const int SCALES[] = {1, 3, 4};
+
+// Every step gets the output of the previous one as its input, prepared once up front
+struct Fixture
+{
+    Mat raw, g16, g8, rotated, scratch, out;
+    Mat scaled[5], gradient[5], colored[5];
+    std::vector<uchar> buffer;
+    ParallelJpegEncoder jpeg;
+    ColormapCache palette, fixedPalette;
+    RoiIndex roi;
+    ZoneAlarms zones;
+    HotspotDetector hotspots;
+    Hotspot found[MAX_HOTSPOTS];
+    HotspotTracker tracker;
+    BadPixelMap badPixels;
+    NonUniformityCorrection nuc;
+    Mat nucFrame;
+    TrackAlarm alarms[MAX_TRACKS];
+    std::vector<ZoneEvent> events;
+    int sensor;
+
+    Mat frames[2]; // consecutive frames for the temporal codec modes
+    RawEncoder encoder;
+    RawDecoder decoder;
+    std::vector<uint8_t> encoded, intra;
+    size_t frame = 0;
+};
+
+static void add_model(bench::Runner &runner, const std::string &model, const std::string &sourceKind, WorkerPool &pool)
+{
+    FrameSourceOptions options;
+    options.kind = sourceKind;
+    auto source = create_frame_source(options);
+    auto f = std::make_shared<Fixture>();
+    if (!source->open() || !source->read(f->raw))
+    {
+        std::cerr << "Could not generate a " << model << " frame" << std::endl;
+        return;
+    }
+    f->sensor = source->device_temp_sensor();
+    f->fixedPalette.fixed = true;
+    f->frames[0] = f->raw.clone();
+    source->read(f->frames[1]);
+
+    normalize(f->raw, f->g16, 0, 65535, NORM_MINMAX);
+    f->g16.convertTo(f->g8, CV_8UC1, 1.0 / 256.0);
+    transpose(f->g8, f->rotated);
+    flip(f->rotated, f->rotated, 1);
+    for (int scale : SCALES)
+    {
+        resize(f->g8, f->scaled[scale], Size(), scale, scale, INTER_LINEAR);
+        add_gradient(f->scaled[scale], f->gradient[scale]);
+        applyColorMap(f->gradient[scale], f->colored[scale], COLORMAP);
+    }
+
+    std::string suffix = "/" + model + "_" + std::to_string(f->raw.cols) + "x" + std::to_string(f->raw.rows);
+
+    // The two configurations the binaries actually run: main.cpp and streamer.cpp
+    runner.add("process_frame" + suffix + "/scale:3/rotate:0", [f]() {
+        process_frame(f->raw, f->out, 3.0f, COLORMAP, 0, f->sensor);
+    });
+    runner.add("process_frame" + suffix + "/scale:4/rotate:90", [f]() {
+        process_frame(f->raw, f->out, 4.0f, COLORMAP, 90, f->sensor);
+    });
+    // streamer.cpp's configuration with the stages split into row bands over a worker per core
+    runner.add("process_frame" + suffix + "/scale:4/rotate:90/workers:" + std::to_string(pool.size()), [f, &pool]() {
+        process_frame(f->raw, f->out, 4.0f, COLORMAP, 90, f->sensor, nullptr, &pool);
+    });
+    // ... and colorized through cached tables, the way streamer.cpp runs it
+    runner.add("process_frame" + suffix + "/scale:4/rotate:90/workers:" + std::to_string(pool.size()) + "/palette", [f, &pool]() {
+        process_frame(f->raw, f->out, 4.0f, COLORMAP, 90, f->sensor, nullptr, &pool, &f->palette);
+    });
+    runner.add("process_frame" + suffix + "/scale:4/rotate:90/workers:" + std::to_string(pool.size()) + "/fixed_range", [f, &pool]() {
+        process_frame(f->raw, f->out, 4.0f, COLORMAP, 90, f->sensor, nullptr, &pool, &f->fixedPalette);
+    });
+
+    runner.add("minMaxIdx" + suffix, [f]() {
+        double min, max;
+        minMaxIdx(f->raw, &min, &max);
+        bench::do_not_optimize(min);
+        bench::do_not_optimize(max);
+    });
+    runner.add("normalize" + suffix, [f]() {
+        normalize(f->raw, f->scratch, 0, 65535, NORM_MINMAX);
+    });
+    runner.add("convertTo" + suffix, [f]() {
+        f->g16.convertTo(f->scratch, CV_8UC1, 1.0 / 256.0);
+    });
+    runner.add("rotate90" + suffix, [f]() {
+        transpose(f->g8, f->scratch);
+        flip(f->scratch, f->scratch, 1);
+    });
+
+    // --roi-queries: the tables every frame, then a query that costs the same for any rectangle
+    f->roi.build(f->raw, f->sensor, 0);
+    runner.add("roi_index/build" + suffix, [f]() {
+        f->roi.build(f->raw, f->sensor, 0);
+    });
+    runner.add("roi_index/build" + suffix + "/workers:" + std::to_string(pool.size()), [f, &pool]() {
+        f->roi.build(f->raw, f->sensor, 0, &pool);
+    });
+    runner.add("roi_index/query" + suffix, [f]() {
+        RoiStats stats;
+        f->roi.query(Rect(10, 10, f->raw.cols - 20, f->raw.rows - 20), stats);
+        bench::do_not_optimize(stats.max);
+    });
+
+    // --bad-pixels: 0.2% of the sensor, about what an older unit has
+    std::vector<Point> bad;
+    RNG rng(1);
+    for (int i = 0; i < (int)f->raw.total() / 500; i++)
+    {
+        bad.push_back(Point(rng.uniform(0, f->raw.cols), rng.uniform(0, f->raw.rows)));
+    }
+    f->badPixels.set(f->raw.size(), bad);
+    runner.add("bad_pixels" + suffix, [f]() {
+        f->badPixels.correct(f->frames[0]);
+    });
+
+    // --nuc: tables from flat fields with the corners 30% less sensitive than the centre. Corrected in
+    //  place over and over, the pass costs the same whatever the values.
+    Mat cool, warm;
+    f->raw.convertTo(cool, CV_32FC1);
+    warm = cool.clone();
+    for (int y = 0; y < warm.rows; y++)
+    {
+        for (int x = 0; x < warm.cols; x++)
+        {
+            double dx = (x - warm.cols / 2.0) / (warm.cols / 2.0), dy = (y - warm.rows / 2.0) / (warm.rows / 2.0);
+            warm.at<float>(y, x) += (float)(500 * (1 - 0.15 * (dx * dx + dy * dy)));
+        }
+    }
+    f->nuc.calibrate(cool, warm);
+    f->nucFrame = f->raw.clone();
+    runner.add("nuc" + suffix, [f]() {
+        f->nuc.apply(f->nucFrame);
+    });
+
+    // --zones: a rectangle over the middle quarter and a triangle
+    Zone rect, triangle;
+    int w = f->raw.cols, h = f->raw.rows;
+    rect.polygon = {Point(w / 4, h / 4), Point(w * 3 / 4, h / 4), Point(w * 3 / 4, h * 3 / 4), Point(w / 4, h * 3 / 4)};
+    triangle.polygon = {Point(0, 0), Point(w / 2, 0), Point(0, h / 2)};
+    rect.watchMax = triangle.watchMean = true;
+    f->zones.setup({rect, triangle}, f->raw.size());
+    runner.add("zone_alarms" + suffix, [f]() {
+        f->events.clear();
+        bench::do_not_optimize(f->zones.evaluate(f->raw, f->sensor, 0, 0, f->events));
+    });
+
+    // --hotspots, with the threshold a quarter of the way down from the frame's max
+    FrameStats stats;
+    process_frame_grey(f->raw, f->scratch, 1.0f, 0, f->sensor, stats);
+    f->hotspots.thresholdCelcius = stats.maxtemp - (stats.maxtemp - stats.mintemp) / 4;
+    runner.add("hotspots" + suffix, [f]() {
+        bench::do_not_optimize(f->hotspots.detect(f->raw, f->sensor, f->found, MAX_HOTSPOTS));
+    });
+    int found = f->hotspots.detect(f->raw, f->sensor, f->found, MAX_HOTSPOTS);
+    runner.add("hotspot_tracker" + suffix, [f, found]() {
+        bench::do_not_optimize(f->tracker.update(f->found, found, f->alarms));
+    });
+
+    // Lossless raw payload; the ratio depends on the sensor noise, so print what this scene gets
+    f->encoder.encode(f->frames[0], f->intra);
+    f->encoder.encode(f->frames[1], f->encoded);
+    printf("raw_codec%s: intra %.2fx, next frame %.2fx\n", suffix.c_str(), f->raw.total() * 2.0 / f->intra.size(),
+           f->raw.total() * 2.0 / f->encoded.size());
+
+    runner.add("raw_codec/encode" + suffix, [f]() {
+        f->encoder.encode(f->frames[f->frame++ & 1], f->encoded);
+    });
+    runner.add("raw_codec/decode_intra" + suffix, [f]() {
+        f->decoder.decode(f->intra.data(), f->intra.size(), f->scratch);
+    });
+
+    for (int scale : SCALES)
+    {
+        std::string x = "/x" + std::to_string(scale);
+        runner.add("resize" + suffix + x, [f, scale]() {
+            resize(f->g8, f->scratch, Size(), scale, scale, INTER_LINEAR);
+        });
+        // The fused kernels against the two passes they replace
+        runner.add("rotate90+resize" + suffix + x, [f, scale]() {
+            transpose(f->g8, f->scratch);
+            flip(f->scratch, f->scratch, 1);
+            resize(f->scratch, f->scratch, Size(), scale, scale, INTER_LINEAR);
+        });
+        for (int interpolation : {INTER_LINEAR, INTER_NEAREST})
+        {
+            std::string name = interpolation == INTER_LINEAR ? "bilinear" : "nearest";
+            RotateScaleKernel kernel = rotate_scale_kernel(90, interpolation);
+            runner.add("rotate_scale/" + name + suffix + x + "/rotate:90", [f, scale, kernel]() {
+                Size size = rotate_scale_size(f->g8.size(), 90, scale);
+                f->scratch.create(size, CV_8UC1);
+                kernel(f->g8, f->scratch, scale, 0, size.height);
+            });
+        }
+        runner.add("gradient" + suffix + x, [f, scale]() {
+            add_gradient(f->scaled[scale], f->scratch);
+        });
+        runner.add("applyColorMap" + suffix + x, [f, scale]() {
+            applyColorMap(f->gradient[scale], f->scratch, COLORMAP);
+        });
+        runner.add("colormap_table" + suffix + x, [f, scale]() {
+            const Mat &colors = f->palette.colors(COLORMAP);
+            const Vec3b *bgr = colors.ptr<Vec3b>();
+            f->scratch.create(f->gradient[scale].size(), CV_8UC3);
+            for (int y = 0; y < f->scratch.rows; y++)
+            {
+                const uchar *in = f->gradient[scale].ptr<uchar>(y);
+                Vec3b *out = f->scratch.ptr<Vec3b>(y);
+                for (int x = 0; x < f->scratch.cols; x++)
+                {
+                    out[x] = bgr[in[x]];
+                }
+            }
+        });
+        runner.add("overlays" + suffix + x, [f, scale]() {
+            Point centre(f->colored[scale].cols / 2, f->colored[scale].rows / 2);
+            draw_overlays(f->colored[scale], 21.5, 38.2, 30.1, Point(10, 10), centre + Point(20, 20), centre);
+        });
+        runner.add("imencode" + suffix + x, [f, scale]() {
+            imencode(".jpeg", f->colored[scale], f->buffer);
+        });
+        runner.add("parallel_jpeg" + suffix + x + "/workers:" + std::to_string(pool.size()), [f, scale, &pool]() {
+            f->jpeg.encode(f->colored[scale], f->buffer, &pool);
+        });
+        // Grey frames for receivers that colorize, against the colorized JPEG above
+        runner.add("imencode_grey" + suffix + x, [f, scale]() {
+            imencode(".jpeg", f->gradient[scale], f->buffer);
+        });
+        runner.add("grey_frame" + suffix + x + "/workers:" + std::to_string(pool.size()), [f, scale, &pool]() {
+            FrameStats stats;
+            encode_grey_frame(f->gradient[scale], COLORMAP, stats, f->jpeg, &pool, f->buffer);
+        });
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    bench::Runner runner;
+    if (!runner.parse(argc, argv))
+    {
+        return 0;
+    }
+
+    WorkerPool pool;
+    pool.start(0, false);
+
+    add_model(runner, "thermal", "synthetic", pool);
+    add_model(runner, "pro", "synthetic-pro", pool);
+
+    runner.run();
+    pool.stop();
+
+    if (!runner.outFile().empty() && !runner.writeJson(runner.outFile()))
+    {
+        std::cerr << "Failed to write " << runner.outFile() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "camera_rig.h"
+#include "protocol.h"
+#include <iostream>
+
+CameraRig::~CameraRig()
+{
+    stop();
+}
+
+void CameraRig::add(std::unique_ptr<FrameSource> source)
+{
+    std::unique_ptr<Camera> camera(new Camera());
+    camera->source = std::move(source);
+    cameras.push_back(std::move(camera));
+}
+
+void CameraRig::start(WorkerPool &pool, FrameHandler handler)
+{
+    this->pool = &pool;
+    this->handler = handler;
+    stopping = false;
+    capturing = (int)cameras.size();
+
+    for (std::size_t i = 0; i < cameras.size(); i++)
+    {
+        cameras[i]->capture = std::thread(&CameraRig::run, this, (int)i);
+    }
+}
+
+void CameraRig::stop()
+{
+    stopping = true;
+    for (auto &camera : cameras)
+    {
+        if (camera->capture.joinable())
+        {
+            camera->capture.join();
+        }
+    }
+
+    if (pool)
+    {
+        pool->wait();
+    }
+}
+
+void CameraRig::run(int index)
+{
+    Camera &camera = *cameras[index];
+    uint32_t sequence = 0;
+
+    while (!stopping)
+    {
+        // Sources may hand out their internal buffer, the worker gets a copy
+        if (!camera.source->read(camera.read))
+        {
+            std::cerr << "Camera " << index << " stopped delivering frames" << std::endl;
+            break;
+        }
+        uint64_t captureTimeUs = timestamp_us();
+        int sensor = camera.source->device_temp_sensor();
+        camera.stats.captured++;
+
+        if (camera.busy)
+        {
+            camera.stats.dropped++;
+            sequence++;
+            continue;
+        }
+
+        camera.read.copyTo(camera.pending);
+        camera.busy = true;
+
+        uint32_t frameSequence = sequence++;
+        pool->submit([this, index, frameSequence, captureTimeUs, sensor]() {
+            Camera &camera = *cameras[index];
+            handler(index, camera.pending, frameSequence, captureTimeUs, sensor);
+            camera.stats.processed++;
+            camera.busy = false;
+        });
+    }
+
+    capturing--;
+}
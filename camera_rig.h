@@ -0,0 +1,71 @@
+#ifndef CAMERA_RIG_H
+#define CAMERA_RIG_H
+
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "frame_source.h"
+#include "worker_pool.h"
+
+// Several cameras in one process. Every camera gets a capture thread of its own, so a slow USB transfer
+//  on one never delays the others, and hands its frames to a shared WorkerPool for processing and
+//  encoding.
+//
+// A camera has at most one frame with the workers at a time: the capture thread reads the next frame
+//  while the previous one is processed, and drops it (counted in dropped) if that is still going when
+//  the read finishes. Frames of one camera are therefore handled one after another, in order, which is
+//  what stateful outputs (raw codec, recorders, video files) need, while frames of different cameras
+//  run on different workers at the same time.
+class CameraRig
+{
+public:
+    // Runs on a worker. raw is only valid for the duration of the call.
+    typedef std::function<void(int camera, cv::Mat &raw, uint32_t sequence, uint64_t captureTimeUs, int deviceTempSensor)> FrameHandler;
+
+    struct CameraStats
+    {
+        std::atomic<uint64_t> captured{0};
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    ~CameraRig();
+
+    // source must already be open, it becomes camera size() - 1
+    void add(std::unique_ptr<FrameSource> source);
+    int size() const { return (int)cameras.size(); }
+
+    void start(WorkerPool &pool, FrameHandler handler);
+    // Joins the capture threads and waits for the frames still being processed
+    void stop();
+
+    // False once every camera has stopped delivering frames
+    bool active() const { return capturing > 0; }
+
+    const CameraStats &stats(int camera) const { return cameras[camera]->stats; }
+
+private:
+    struct Camera
+    {
+        std::unique_ptr<FrameSource> source;
+        std::thread capture;
+        cv::Mat read;    // captured into
+        cv::Mat pending; // with the workers while busy
+        std::atomic<bool> busy{false};
+        CameraStats stats;
+    };
+
+    void run(int index);
+
+    std::vector<std::unique_ptr<Camera>> cameras;
+    WorkerPool *pool = nullptr;
+    FrameHandler handler;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> capturing{0};
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "colormap_cache.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include "thermal.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace cv;
+
+// Raw counts per Celcius; temp_from_raw is linear, so it doesn't depend on the device temperature
+static double raw_per_celcius()
+{
+    return std::abs(raw_from_temp(1, 0) - raw_from_temp(0, 0));
+}
+
+const ColormapCache::Table &ColormapCache::range(double min, double max, double device_k)
+{
+    if (fixed)
+    {
+        int fixedLow = (int)std::lround(std::min(std::max(raw_from_temp(fixedLowCelcius, device_k), 0.0), 65535.0));
+        int fixedHigh = (int)std::lround(std::min(std::max(raw_from_temp(fixedHighCelcius, device_k), 0.0), 65535.0));
+        double drift = driftCelcius * raw_per_celcius();
+        if (!haveRange || std::abs(fixedLow - low) > drift || std::abs(fixedHigh - high) > drift)
+        {
+            low = fixedLow;
+            high = std::max(fixedHigh, fixedLow);
+        }
+        haveRange = true;
+        return lookup(low, high);
+    }
+
+    double hysteresis = hysteresisCelcius * raw_per_celcius();
+    if (!haveRange || min < low || min > low + hysteresis)
+    {
+        low = (int)min;
+    }
+    if (!haveRange || max > high || max < high - hysteresis)
+    {
+        high = (int)max;
+    }
+    haveRange = true;
+    return lookup(low, high);
+}
+
+const ColormapCache::Table &ColormapCache::lookup(int rangeLow, int rangeHigh)
+{
+    for (auto it = tables.begin(); it != tables.end(); ++it)
+    {
+        if (it->low == rangeLow && it->high == rangeHigh)
+        {
+            tables.splice(tables.begin(), tables, it);
+            return tables.front();
+        }
+    }
+
+    if ((int)tables.size() >= std::max(capacity, 1))
+    {
+        tables.pop_back();
+    }
+    tables.emplace_front();
+    Table &table = tables.front();
+    table.low = rangeLow;
+    table.high = rangeHigh;
+
+    // Every raw value of the range through the same two conversions process_frame makes
+    Mat ramp(1, rangeHigh - rangeLow + 1, CV_16UC1), g16;
+    for (int i = 0; i < ramp.cols; i++)
+    {
+        ramp.at<uint16_t>(i) = (uint16_t)(rangeLow + i);
+    }
+    double scale = 65535.0 * (rangeHigh - rangeLow > DBL_EPSILON ? 1.0 / (rangeHigh - rangeLow) : 0);
+    ramp.convertTo(g16, CV_16U, scale, -rangeLow * scale);
+    g16.convertTo(table.grey, CV_8UC1, 1.0 / 256.0);
+    return table;
+}
+
+const Mat &ColormapCache::colors(int colormap)
+{
+    Mat &bgr = colorTables[colormap];
+    if (bgr.empty())
+    {
+        Mat ramp(1, 256, CV_8UC1);
+        for (int i = 0; i < 256; i++)
+        {
+            ramp.at<uchar>(i) = (uchar)i;
+        }
+        if (colormap != -1)
+        {
+            applyColorMap(ramp, bgr, colormap);
+        }
+        else
+        {
+            cvtColor(ramp, bgr, COLOR_GRAY2BGR);
+        }
+    }
+    return bgr;
+}
+
+bool parse_fixed_range(const std::string &text, double &lowCelcius, double &highCelcius)
+{
+    auto colon = text.find(':');
+    return colon != std::string::npos && parse_celcius(text.substr(0, colon), lowCelcius) &&
+           parse_celcius(text.substr(colon + 1), highCelcius) && lowCelcius < highCelcius;
+}
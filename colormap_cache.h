@@ -0,0 +1,64 @@
+#ifndef COLORMAP_CACHE_H
+#define COLORMAP_CACHE_H
+
+#include <opencv2/core/core.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+// Lookup tables for colorizing one camera's frames, so process_frame does a gather per pixel instead of
+//  normalizing and colormapping from scratch.
+//
+// The raw range frames are stretched over is smoothed: it widens as soon as a frame's min or max falls
+//  outside it, and only narrows once a frame's min or max has moved more than the hysteresis inside it.
+//  That stops the palette from flickering with sensor noise and keeps the range, the key of the raw ->
+//  grey tables, the same from frame to frame. The frame is upscaled between the two stages, so the raw ->
+//  BGR mapping is kept as raw -> grey for the range and grey -> BGR for the colormap.
+//
+// With a fixed scale the range is a configured temperature range instead, see fixed.
+//
+// Used by one thread at a time; the tables it hands out stay valid until the next call.
+class ColormapCache
+{
+public:
+    // Raw values low..high to grey levels, with the same arithmetic as process_frame's convertTo stages
+    struct Table
+    {
+        int low = 0;
+        int high = -1;
+        cv::Mat grey; // 1 x (high - low + 1) CV_8UC1
+    };
+
+    // Celcius a frame's min or max has to move inside the range before it narrows, 0 follows every frame
+    double hysteresisCelcius = 0.5;
+    // Ranges kept, a scene switching between a few (a hand moving in and out of view) keeps hitting them
+    int capacity = 8;
+
+    // Fixed scale: the colors span fixedLowCelcius..fixedHighCelcius whatever is in view, so a color
+    //  means the same temperature in every frame. The range's raw counts depend on the device temperature;
+    //  its table is only rebuilt once they have drifted by more than driftCelcius.
+    bool fixed = false;
+    double fixedLowCelcius = 20;
+    double fixedHighCelcius = 45;
+    double driftCelcius = 0.1;
+
+    // Moves the range along with this frame's raw min/max, or the device temperature for a fixed scale,
+    //  and returns its table
+    const Table &range(double min, double max, double device_k);
+    // 1 x 256 CV_8UC3 grey level -> BGR of a cv::applyColorMap colormap, or grey for -1
+    const cv::Mat &colors(int colormap);
+
+private:
+    const Table &lookup(int rangeLow, int rangeHigh);
+
+    bool haveRange = false;
+    int low = 0, high = 0;
+    std::list<Table> tables; // most recently used first
+
+    std::map<int, cv::Mat> colorTables; // by colormap, clients may each want another
+};
+
+// Reads a fixed scale as "low:high" Celcius, false unless both are numbers and low < high
+bool parse_fixed_range(const std::string &text, double &lowCelcius, double &highCelcius);
+
+#endif
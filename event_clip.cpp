@@ -0,0 +1,216 @@
+#include "event_clip.h"
+#include "thermal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// Room in the ring beyond the pre-event window, so the writer can work through a clip's first frames
+//  while new ones keep arriving
+static const double WRITER_SLACK_SECONDS = 2.0;
+
+EventClipRecorder::~EventClipRecorder()
+{
+    stop();
+}
+
+bool EventClipRecorder::start(const std::string &prefix, double preSeconds, double postSeconds, double maxFps, cv::Size frameSize)
+{
+    this->prefix = prefix;
+    preUs = (uint64_t)(preSeconds * 1e6);
+    postUs = (uint64_t)(postSeconds * 1e6);
+    clipCapacity = (uint64_t)std::ceil((preSeconds + postSeconds) * maxFps) + 1;
+
+    // All the memory the ring will ever need, up front
+    std::size_t ringSize = (std::size_t)std::ceil((preSeconds + WRITER_SLACK_SECONDS) * maxFps) + 1;
+    ring.resize(ringSize);
+    ringInfo.resize(ringSize);
+    for (auto &frame : ring)
+    {
+        frame.create(frameSize, CV_16UC1);
+    }
+
+    stopping = false;
+    writer = std::thread(&EventClipRecorder::run, this);
+    return true;
+}
+
+void EventClipRecorder::stop()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        if (!clips.empty() && clips.back().end == OPEN)
+        {
+            clips.back().end = pushed;
+        }
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+void EventClipRecorder::push(const cv::Mat &raw, uint64_t sequence, uint64_t captureTimeUs, int deviceTempSensor, bool alarm)
+{
+    bool keep;
+    std::size_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Frames a clip still needs must stay put until the writer has them
+        keep = clips.empty() || pushed - std::max(flushed, clips.front().first) < ring.size();
+        slot = pushed % ring.size();
+    }
+
+    if (keep && raw.size() == ring[slot].size())
+    {
+        // The writer never reads this slot while it's outside the clip window, so no lock for the copy
+        raw.copyTo(ring[slot]);
+        RecordedFrameInfo &info = ringInfo[slot];
+        info.sequence = sequence;
+        info.captureTimeUs = captureTimeUs;
+        info.deviceTempSensor = deviceTempSensor;
+        info.preAdd = preAdd;
+        info.multiplier = multiplier;
+        info.postAdd = postAdd;
+    }
+    else
+    {
+        keep = false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (keep)
+        {
+            pushed++;
+        }
+        else if (!clips.empty())
+        {
+            framesDropped++;
+        }
+
+        Clip *open = !clips.empty() && clips.back().end == OPEN ? &clips.back() : nullptr;
+        if (open && !alarm && captureTimeUs > open->deadlineUs)
+        {
+            // This frame is past the window and not part of the clip
+            open->end = keep ? pushed - 1 : pushed;
+            open = nullptr;
+        }
+
+        if (alarm && open)
+        {
+            open->deadlineUs = captureTimeUs + postUs;
+        }
+        else if (alarm)
+        {
+            // Look back preUs, but not into frames an earlier clip already has or the ring has given up
+            uint64_t lower = pushed >= ring.size() ? pushed - ring.size() + 1 : 0;
+            if (!clips.empty())
+            {
+                lower = std::max(lower, clips.back().end);
+            }
+
+            uint64_t first = pushed;
+            while (first > lower && ringInfo[(first - 1) % ring.size()].captureTimeUs + preUs >= captureTimeUs)
+            {
+                first--;
+            }
+
+            char name[32];
+            sprintf(name, "_%010lu", (unsigned long)sequence);
+            clips.push_back({first, OPEN, captureTimeUs + postUs, prefix + name});
+            std::cout << "Alarm, saving clip " << prefix + name << std::endl;
+        }
+
+        if (clips.empty())
+        {
+            return;
+        }
+    }
+    wake.notify_one();
+}
+
+bool EventClipRecorder::writeFrame(RecordingWriter &file, const Clip &clip, int &part, uint64_t frame)
+{
+    // A clip kept open by a long alarm continues in _1, _2, ... once its file is full
+    if (file.isOpen() && file.isFull())
+    {
+        file.close();
+        part++;
+    }
+
+    if (!file.isOpen())
+    {
+        std::string fileName = clip.fileName + (part ? "_" + std::to_string(part) : "") + ".tsrec";
+        if (!file.create(fileName, ring[0].size(), clipCapacity))
+        {
+            return false;
+        }
+    }
+
+    std::size_t slot = frame % ring.size();
+    return file.append(ring[slot], ringInfo[slot]);
+}
+
+void EventClipRecorder::run()
+{
+    RecordingWriter file;
+    int part = 0;
+
+    while (true)
+    {
+        Clip clip;
+        uint64_t frame;
+        bool finished = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] {
+                if (clips.empty())
+                {
+                    return stopping;
+                }
+                uint64_t next = std::max(flushed, clips.front().first);
+                return next < std::min(clips.front().end, pushed) || next >= clips.front().end;
+            });
+
+            if (clips.empty())
+            {
+                return;
+            }
+
+            flushed = std::max(flushed, clips.front().first);
+            if (flushed >= clips.front().end)
+            {
+                clips.pop_front();
+                finished = true;
+            }
+            else
+            {
+                clip = clips.front();
+                frame = flushed;
+            }
+        }
+
+        if (finished)
+        {
+            file.close();
+            part = 0;
+            clipsWritten++;
+            continue;
+        }
+
+        if (!writeFrame(file, clip, part, frame))
+        {
+            framesDropped++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            flushed = frame + 1;
+        }
+    }
+}
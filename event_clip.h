@@ -0,0 +1,70 @@
+#ifndef EVENT_CLIP_H
+#define EVENT_CLIP_H
+
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "recorder.h"
+
+// Saves what led up to an alarm and what followed it.
+//
+// Every raw frame is copied into a preallocated ring holding the last preSeconds or so. When a frame
+//  raises the alarm, the frames from the last preSeconds plus everything up to postSeconds after the
+//  last alarming frame are written to <prefix>_<sequence>.tsrec (the Recorder format) by a writer thread
+//  reading straight out of the ring. An alarm while a clip is still open pushes its end out instead of
+//  starting another one, so a flickering reading gives one clip.
+//
+// If the writer falls a whole ring behind during a clip, new frames are dropped from the clip (counted in
+//  framesDropped) rather than overwriting ones not yet on disk. Meant to be fed from a single thread.
+class EventClipRecorder
+{
+public:
+    ~EventClipRecorder();
+
+    // maxFps sizes the ring, frames are picked by capture time so a slower source just looks further back
+    bool start(const std::string &prefix, double preSeconds, double postSeconds, double maxFps, cv::Size frameSize);
+    // Finishes the clip in progress, if any
+    void stop();
+
+    void push(const cv::Mat &raw, uint64_t sequence, uint64_t captureTimeUs, int deviceTempSensor, bool alarm);
+
+    std::atomic<uint64_t> clipsWritten{0};
+    std::atomic<uint64_t> framesDropped{0};
+
+private:
+    struct Clip
+    {
+        uint64_t first;        // absolute frame numbers, slot = number % ring size
+        uint64_t end;          // one past the last frame, OPEN while the post-event window runs
+        uint64_t deadlineUs;   // frames captured after this close the clip
+        std::string fileName;
+    };
+
+    static const uint64_t OPEN = UINT64_MAX;
+
+    void run();
+    bool writeFrame(RecordingWriter &writer, const Clip &clip, int &part, uint64_t frame);
+
+    std::string prefix;
+    uint64_t preUs = 0, postUs = 0;
+    uint64_t clipCapacity = 0;
+
+    std::vector<cv::Mat> ring;
+    std::vector<RecordedFrameInfo> ringInfo;
+    uint64_t pushed = 0;  // frames in the ring so far
+    uint64_t flushed = 0; // next frame the writer saves
+
+    std::deque<Clip> clips;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+};
+
+#endif
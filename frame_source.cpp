@@ -0,0 +1,379 @@
+#include "frame_source.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include "seek.h"
+#include "thermal.h"
+#include <libusb.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// Frame sizes as delivered by libseek after cropping
+static const int SEEK_THERMAL_WIDTH = 206;
+static const int SEEK_THERMAL_HEIGHT = 156;
+static const int SEEK_THERMAL_PRO_WIDTH = 320;
+static const int SEEK_THERMAL_PRO_HEIGHT = 240;
+
+// USB ids, the same ones libseek looks for
+static const uint16_t SEEK_VENDOR_ID = 0x289d;
+static const uint16_t SEEK_THERMAL_PRODUCT_ID = 0x0010;
+static const uint16_t SEEK_THERMAL_PRO_PRODUCT_ID = 0x0011;
+
+static std::unique_ptr<FrameSource> create_source(const FrameSourceOptions &options)
+{
+    if (options.kind == "seek")
+    {
+        return std::unique_ptr<FrameSource>(new SeekFrameSource(false, options.path, options.device));
+    }
+    if (options.kind == "seekpro")
+    {
+        return std::unique_ptr<FrameSource>(new SeekFrameSource(true, options.path, options.device));
+    }
+    if (options.kind == "synthetic")
+    {
+        return std::unique_ptr<FrameSource>(new SyntheticFrameSource(
+            SEEK_THERMAL_WIDTH, SEEK_THERMAL_HEIGHT, options.sensorCelcius, options.fps, options.seed));
+    }
+    if (options.kind == "synthetic-pro")
+    {
+        return std::unique_ptr<FrameSource>(new SyntheticFrameSource(
+            SEEK_THERMAL_PRO_WIDTH, SEEK_THERMAL_PRO_HEIGHT, options.sensorCelcius, options.fps, options.seed));
+    }
+    if (options.kind == "replay")
+    {
+        return std::unique_ptr<FrameSource>(new ReplayFrameSource(options.path, options.sensorCelcius, options.fps));
+    }
+    if (options.kind == "recording")
+    {
+        return std::unique_ptr<FrameSource>(new RecordingFrameSource(options.path, options.fps));
+    }
+
+    return nullptr;
+}
+
+std::unique_ptr<FrameSource> create_frame_source(const FrameSourceOptions &options)
+{
+    std::unique_ptr<FrameSource> source = create_source(options);
+    if (source && !options.badPixels.empty())
+    {
+        return std::unique_ptr<FrameSource>(new BadPixelFrameSource(std::move(source), options.badPixels));
+    }
+    return source;
+}
+
+static int sensor_from_celcius(double celcius)
+{
+    return (int)lround(device_k_to_sensor(celcius + 273.0));
+}
+
+std::vector<SeekDeviceInfo> list_seek_devices()
+{
+    std::vector<SeekDeviceInfo> devices;
+
+    libusb_context *context;
+    if (libusb_init(&context) != 0)
+    {
+        std::cerr << "Could not initialize libusb" << std::endl;
+        return devices;
+    }
+
+    libusb_device **list;
+    ssize_t count = libusb_get_device_list(context, &list);
+    int thermalCount = 0, proCount = 0;
+    for (ssize_t i = 0; i < count; i++)
+    {
+        libusb_device_descriptor descriptor;
+        if (libusb_get_device_descriptor(list[i], &descriptor) != 0 || descriptor.idVendor != SEEK_VENDOR_ID)
+        {
+            continue;
+        }
+
+        SeekDeviceInfo device;
+        if (descriptor.idProduct == SEEK_THERMAL_PRODUCT_ID)
+        {
+            device.pro = false;
+            device.index = thermalCount++;
+        }
+        else if (descriptor.idProduct == SEEK_THERMAL_PRO_PRODUCT_ID)
+        {
+            device.pro = true;
+            device.index = proCount++;
+        }
+        else
+        {
+            continue;
+        }
+        device.bus = libusb_get_bus_number(list[i]);
+        device.address = libusb_get_device_address(list[i]);
+        devices.push_back(device);
+    }
+
+    if (count >= 0)
+    {
+        libusb_free_device_list(list, 1);
+    }
+    libusb_exit(context);
+    return devices;
+}
+
+SeekFrameSource::SeekFrameSource(bool pro, const std::string &ffcFilename, int device)
+    : device(device)
+{
+    if (pro)
+    {
+        seek.reset(new LibSeek::SeekThermalPro(ffcFilename));
+    }
+    else
+    {
+        seek.reset(new LibSeek::SeekThermal(ffcFilename));
+    }
+}
+
+bool SeekFrameSource::open()
+{
+    if (device != 0)
+    {
+        std::cerr << "libseek only opens the first camera of each model, not camera " << device << std::endl;
+        return false;
+    }
+    return seek->open();
+}
+
+bool SeekFrameSource::read(cv::Mat &frame)
+{
+    return seek->read(frame);
+}
+
+int SeekFrameSource::device_temp_sensor()
+{
+    return seek->device_temp_sensor();
+}
+
+FramePacer::FramePacer(double fps)
+    : interval(std::chrono::steady_clock::duration::zero()),
+      next(std::chrono::steady_clock::now())
+{
+    if (fps > 0)
+    {
+        interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    }
+}
+
+void FramePacer::wait()
+{
+    if (interval == std::chrono::steady_clock::duration::zero())
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (next > now)
+    {
+        std::this_thread::sleep_until(next);
+        next += interval;
+    }
+    else
+    {
+        // We fell behind, don't try to catch up with a burst of frames
+        next = now + interval;
+    }
+}
+
+SyntheticFrameSource::SyntheticFrameSource(int width, int height, double sensorCelcius, double fps, unsigned int seed)
+    : width(width), height(height), sensor(sensor_from_celcius(sensorCelcius)), pacer(fps), rng(seed)
+{
+}
+
+bool SyntheticFrameSource::open()
+{
+    double device_k = device_sensor_to_k(sensor);
+
+    background.create(height, width, CV_32FC1);
+    for (int r = 0; r < height; r++)
+    {
+        float *row = background.ptr<float>(r);
+        for (int c = 0; c < width; c++)
+        {
+            double dx = (c - width / 2.0) / (width / 2.0);
+            double dy = (r - height / 2.0) / (height / 2.0);
+            double celcius = backgroundCelcius - vignettingCelcius * (dx * dx + dy * dy) / 2.0;
+            row[c] = (float)raw_from_temp(celcius, device_k);
+        }
+    }
+
+    if (blobs.empty())
+    {
+        // Two people walking past, one of them feverish, and something lukewarm
+        blobs.push_back({width * 0.25, height * 0.5, 1.3, 0.4, height / 6.0, 36.6});
+        blobs.push_back({width * 0.70, height * 0.4, -0.9, 0.7, height / 7.0, 38.4});
+        blobs.push_back({width * 0.50, height * 0.8, 0.5, -0.3, height / 10.0, 29.0});
+    }
+
+    return true;
+}
+
+bool SyntheticFrameSource::read(cv::Mat &frame)
+{
+    pacer.wait();
+
+    double device_k = device_sensor_to_k(sensor);
+    background.copyTo(scene);
+
+    for (auto &blob : blobs)
+    {
+        blob.x += blob.vx;
+        blob.y += blob.vy;
+        if (blob.x < 0 || blob.x >= width)
+        {
+            blob.vx = -blob.vx;
+        }
+        if (blob.y < 0 || blob.y >= height)
+        {
+            blob.vy = -blob.vy;
+        }
+
+        // Flat-topped falloff, only evaluated inside the blob's bounding box
+        float peak = (float)raw_from_temp(blob.celcius, device_k);
+        int reach = (int)(blob.radius * 2);
+        int r0 = std::max(0, (int)blob.y - reach), r1 = std::min(height, (int)blob.y + reach + 1);
+        int c0 = std::max(0, (int)blob.x - reach), c1 = std::min(width, (int)blob.x + reach + 1);
+        for (int r = r0; r < r1; r++)
+        {
+            float *row = scene.ptr<float>(r);
+            for (int c = c0; c < c1; c++)
+            {
+                double d = ((c - blob.x) * (c - blob.x) + (r - blob.y) * (r - blob.y)) / (blob.radius * blob.radius);
+                float weight = (float)exp(-d * d);
+                row[c] = std::max(row[c], row[c] + (peak - row[c]) * weight);
+            }
+        }
+    }
+
+    noise.create(height, width, CV_32FC1);
+    rng.fill(noise, cv::RNG::NORMAL, cv::Scalar(0), cv::Scalar(noiseCounts));
+    cv::add(scene, noise, scene);
+    scene.convertTo(frame, CV_16UC1);
+
+    return true;
+}
+
+int SyntheticFrameSource::device_temp_sensor()
+{
+    return sensor;
+}
+
+ReplayFrameSource::ReplayFrameSource(const std::string &pattern, double sensorCelcius, double fps)
+    : pattern(pattern), sensor(sensor_from_celcius(sensorCelcius)), pacer(fps)
+{
+}
+
+bool ReplayFrameSource::open()
+{
+    std::vector<cv::String> files;
+    cv::glob(pattern, files);
+
+    for (const auto &file : files)
+    {
+        cv::Mat frame = cv::imread(file, cv::IMREAD_ANYDEPTH);
+        if (frame.empty() || frame.type() != CV_16UC1)
+        {
+            std::cout << "Skipping " << file << ", not a 16-bit single channel image" << std::endl;
+            continue;
+        }
+        frames.push_back(frame);
+    }
+
+    return !frames.empty();
+}
+
+bool ReplayFrameSource::read(cv::Mat &frame)
+{
+    pacer.wait();
+
+    frames[position].copyTo(frame);
+    position = (position + 1) % frames.size();
+
+    return true;
+}
+
+int ReplayFrameSource::device_temp_sensor()
+{
+    return sensor;
+}
+
+RecordingFrameSource::RecordingFrameSource(const std::string &pattern, double fps)
+    : pattern(pattern), pacer(fps)
+{
+}
+
+bool RecordingFrameSource::open()
+{
+    std::vector<cv::String> files;
+    cv::glob(pattern, files);
+
+    for (const auto &file : files)
+    {
+        std::unique_ptr<RecordingReader> reader(new RecordingReader());
+        if (!reader->open(file) || reader->frameCount() == 0)
+        {
+            std::cout << "Skipping " << file << ", no recorded frames" << std::endl;
+            continue;
+        }
+        segments.push_back(std::move(reader));
+    }
+
+    return !segments.empty();
+}
+
+bool RecordingFrameSource::read(cv::Mat &frame)
+{
+    pacer.wait();
+
+    cv::Mat recorded;
+    RecordedFrameInfo info;
+    if (!segments[segment]->read(position, recorded, info))
+    {
+        std::cerr << "Could not read frame " << position << " of recording segment " << segment << std::endl;
+        return false;
+    }
+    recorded.copyTo(frame);
+    sensor = info.deviceTempSensor;
+
+    if (++position == segments[segment]->frameCount())
+    {
+        position = 0;
+        segment = (segment + 1) % segments.size();
+    }
+
+    return true;
+}
+
+int RecordingFrameSource::device_temp_sensor()
+{
+    return sensor;
+}
+
+BadPixelFrameSource::BadPixelFrameSource(std::unique_ptr<FrameSource> source, const std::string &mapPath)
+    : source(std::move(source)), mapPath(mapPath)
+{
+}
+
+bool BadPixelFrameSource::open()
+{
+    return map.load(mapPath) && source->open();
+}
+
+bool BadPixelFrameSource::read(cv::Mat &frame)
+{
+    if (!source->read(frame))
+    {
+        return false;
+    }
+    map.correct(frame);
+    return true;
+}
+
+int BadPixelFrameSource::device_temp_sensor()
+{
+    return source->device_temp_sensor();
+}
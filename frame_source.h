@@ -0,0 +1,164 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <opencv2/core/core.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SeekCam.h"
+#include "bad_pixels.h"
+#include "recorder.h"
+
+// Where the raw CV_16UC1 frames come from. Mirrors the part of LibSeek::SeekCam the binaries use,
+//  so the rest of the pipeline does not care whether a camera is attached.
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool open() = 0;
+    virtual bool read(cv::Mat &frame) = 0;
+    virtual int device_temp_sensor() = 0;
+};
+
+struct FrameSourceOptions
+{
+    std::string kind = "seek"; // seek, seekpro, synthetic, synthetic-pro, replay, recording
+    std::string path;          // ffc file for seek, image glob/directory for replay, segment glob for recording
+    double sensorCelcius = 23.0;
+    double fps = 0;            // 0 = as fast as possible (synthetic/replay/recording only)
+    unsigned int seed = 1;
+    int device = 0;            // which camera of the model to open when several are attached (seek/seekpro)
+    std::string badPixels;     // bad pixel map the frames are corrected with, empty for none
+};
+
+// Returns nullptr for an unknown kind. With a bad pixel map the source comes wrapped in a BadPixelFrameSource.
+std::unique_ptr<FrameSource> create_frame_source(const FrameSourceOptions &options);
+
+// Seek Thermal cameras attached over USB, in the order libusb lists them
+struct SeekDeviceInfo
+{
+    bool pro;
+    int index;   // among the attached cameras of the same model, what FrameSourceOptions::device takes
+    int bus;
+    int address;
+};
+
+std::vector<SeekDeviceInfo> list_seek_devices();
+
+// Physical Seek Thermal (Compact) or Seek Thermal Compact Pro. libseek opens the first camera of the
+//  model it finds and has no way to pick another, so open() fails for any device but 0.
+class SeekFrameSource : public FrameSource
+{
+public:
+    SeekFrameSource(bool pro, const std::string &ffcFilename, int device = 0);
+
+    bool open() override;
+    bool read(cv::Mat &frame) override;
+    int device_temp_sensor() override;
+
+private:
+    int device;
+    std::unique_ptr<LibSeek::SeekCam> seek;
+};
+
+// Throttles read() to a target rate. fps <= 0 disables pacing.
+class FramePacer
+{
+public:
+    explicit FramePacer(double fps);
+    void wait();
+
+private:
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point next;
+};
+
+// Generated scene: warm background with vignetting, sensor noise and hot blobs bouncing around.
+class SyntheticFrameSource : public FrameSource
+{
+public:
+    struct Blob
+    {
+        double x, y, vx, vy, radius, celcius;
+    };
+
+    SyntheticFrameSource(int width, int height, double sensorCelcius, double fps, unsigned int seed);
+
+    bool open() override;
+    bool read(cv::Mat &frame) override;
+    int device_temp_sensor() override;
+
+    double backgroundCelcius = 24.0;
+    double vignettingCelcius = 2.0; // how much colder the corners are
+    double noiseCounts = 6.0;       // stddev of per-pixel noise, in raw counts
+    std::vector<Blob> blobs;
+
+private:
+    int width, height;
+    int sensor;
+    FramePacer pacer;
+    cv::RNG rng;
+    cv::Mat background; // CV_32FC1, raw counts without noise or blobs
+    cv::Mat scene;      // CV_32FC1 scratch
+    cv::Mat noise;      // CV_32FC1 scratch
+};
+
+// Plays back 16-bit single channel images (PNG/TIFF) in name order, looping forever.
+//  All images are loaded on open() so disk I/O never shows up in a profile.
+class ReplayFrameSource : public FrameSource
+{
+public:
+    ReplayFrameSource(const std::string &pattern, double sensorCelcius, double fps);
+
+    bool open() override;
+    bool read(cv::Mat &frame) override;
+    int device_temp_sensor() override;
+
+private:
+    std::string pattern;
+    int sensor;
+    FramePacer pacer;
+    std::vector<cv::Mat> frames;
+    size_t position = 0;
+};
+
+// Plays back Recorder segments in name order, looping forever, with the device sensor value each frame
+//  was recorded with. Segments are mapped rather than loaded, so long recordings cost no memory up front.
+class RecordingFrameSource : public FrameSource
+{
+public:
+    RecordingFrameSource(const std::string &pattern, double fps);
+
+    bool open() override;
+    bool read(cv::Mat &frame) override;
+    int device_temp_sensor() override;
+
+private:
+    std::string pattern;
+    FramePacer pacer;
+    std::vector<std::unique_ptr<RecordingReader>> segments;
+    size_t segment = 0;
+    uint64_t position = 0;
+    int sensor = 0;
+};
+
+// Corrects the bad pixels of another source's frames as they are read, see bad_pixels.h. The map is
+//  loaded by open(), which fails when it can't be.
+class BadPixelFrameSource : public FrameSource
+{
+public:
+    BadPixelFrameSource(std::unique_ptr<FrameSource> source, const std::string &mapPath);
+
+    bool open() override;
+    bool read(cv::Mat &frame) override;
+    int device_temp_sensor() override;
+
+private:
+    std::unique_ptr<FrameSource> source;
+    std::string mapPath;
+    BadPixelMap map;
+};
+
+#endif
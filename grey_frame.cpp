@@ -0,0 +1,116 @@
+#include "grey_frame.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <algorithm>
+#include <cmath>
+#include "protocol.h"
+
+static const uint16_t GREY_FLAG_ALARM = 1;
+static const uint16_t GREY_FLAG_NO_OVERLAYS = 2;
+
+static void put_celcius(uint8_t *out, double celcius)
+{
+    put_le(out, (uint32_t)(int32_t)std::lround(celcius * 1000), 4);
+}
+
+static double get_celcius(const uint8_t *in)
+{
+    return (int32_t)(uint32_t)get_le(in, 4) / 1000.0;
+}
+
+static void put_point(uint8_t *out, const cv::Point &point)
+{
+    put_le(out, (uint16_t)point.x, 2);
+    put_le(out + 2, (uint16_t)point.y, 2);
+}
+
+static cv::Point get_point(const uint8_t *in)
+{
+    return cv::Point((int)get_le(in, 2), (int)get_le(in + 2, 2));
+}
+
+bool encode_grey_frame(const cv::Mat &frame_g8, int colormap, const FrameStats &stats, ParallelJpegEncoder &jpeg,
+                       WorkerPool *pool, std::vector<uchar> &out, bool overlays)
+{
+    if (!jpeg.encode(frame_g8, out, pool))
+    {
+        return false;
+    }
+
+    uint8_t info[GREY_INFO_SIZE + MAX_HOTSPOTS * GREY_HOTSPOT_SIZE];
+    put_le(info, (uint16_t)(int16_t)colormap, 2);
+    put_le(info + 2, (stats.alarm ? GREY_FLAG_ALARM : 0) | (overlays ? 0 : GREY_FLAG_NO_OVERLAYS), 2);
+    put_celcius(info + 4, stats.rangeLow);
+    put_celcius(info + 8, stats.rangeHigh);
+    put_celcius(info + 12, stats.mintemp);
+    put_celcius(info + 16, stats.maxtemp);
+    put_celcius(info + 20, stats.centraltemp);
+    put_point(info + 24, stats.minp);
+    put_point(info + 28, stats.maxp);
+    put_point(info + 32, stats.centralp);
+    put_le(info + 36, (uint16_t)stats.hotspotCount, 2);
+    put_le(info + 38, 0, 2);
+    for (int i = 0; i < stats.hotspotCount; i++)
+    {
+        uint8_t *entry = info + GREY_INFO_SIZE + i * GREY_HOTSPOT_SIZE;
+        put_celcius(entry, stats.hotspots[i].peakCelcius);
+        put_point(entry + 4, stats.hotspots[i].marker);
+        put_le(entry + 8, (uint16_t)stats.hotspots[i].radius, 2);
+        put_le(entry + 10, (uint16_t)std::min(stats.hotspots[i].area, 65535), 2);
+    }
+    out.insert(out.begin(), info, info + GREY_INFO_SIZE + stats.hotspotCount * GREY_HOTSPOT_SIZE);
+    return true;
+}
+
+bool decode_grey_frame(const uint8_t *payload, std::size_t size, cv::Mat &outframe, FrameStats *stats)
+{
+    if (size <= GREY_INFO_SIZE)
+    {
+        return false;
+    }
+
+    int colormap = (int16_t)(uint16_t)get_le(payload, 2);
+    if (!colormap_supported(colormap))
+    {
+        colormap = RenderParams().colormap;
+    }
+    FrameStats info;
+    uint16_t flags = (uint16_t)get_le(payload + 2, 2);
+    info.alarm = (flags & GREY_FLAG_ALARM) != 0;
+    info.rangeLow = get_celcius(payload + 4);
+    info.rangeHigh = get_celcius(payload + 8);
+    info.mintemp = get_celcius(payload + 12);
+    info.maxtemp = get_celcius(payload + 16);
+    info.centraltemp = get_celcius(payload + 20);
+    info.minp = get_point(payload + 24);
+    info.maxp = get_point(payload + 28);
+    info.centralp = get_point(payload + 32);
+
+    info.hotspotCount = std::min((int)get_le(payload + 36, 2), MAX_HOTSPOTS);
+    std::size_t infoSize = GREY_INFO_SIZE + info.hotspotCount * GREY_HOTSPOT_SIZE;
+    if (size <= infoSize)
+    {
+        return false;
+    }
+    for (int i = 0; i < info.hotspotCount; i++)
+    {
+        const uint8_t *entry = payload + GREY_INFO_SIZE + i * GREY_HOTSPOT_SIZE;
+        info.hotspots[i].peakCelcius = get_celcius(entry);
+        info.hotspots[i].marker = get_point(entry + 4);
+        info.hotspots[i].radius = (int)get_le(entry + 8, 2);
+        info.hotspots[i].area = (int)get_le(entry + 10, 2);
+    }
+
+    cv::Mat jpeg(1, (int)(size - infoSize), CV_8UC1, (void *)(payload + infoSize));
+    cv::Mat frame_g8 = cv::imdecode(jpeg, cv::IMREAD_GRAYSCALE);
+    if (frame_g8.empty())
+    {
+        return false;
+    }
+
+    colorize_frame(frame_g8, outframe, colormap, info, nullptr, nullptr, (flags & GREY_FLAG_NO_OVERLAYS) == 0);
+    if (stats)
+    {
+        *stats = info;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef GREY_FRAME_H
+#define GREY_FRAME_H
+
+#include <opencv2/core/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "parallel_jpeg.h"
+#include "process_frame.h"
+#include "worker_pool.h"
+
+// PAYLOAD_GREY_JPEG: the processed frame before the colormap, for receivers that colorize on display.
+//  One channel instead of three makes the JPEG a third to a half the size and quicker to encode.
+//
+// The payload is a GREY_INFO_SIZE byte block, little endian, then GREY_HOTSPOT_SIZE bytes for each
+//  hotspot and a JPEG of the CV_8UC1 frame with its gradient bar (process_frame_grey's frame_g8):
+//
+//    0  i16  colormap, a cv::ColormapTypes value, -1 = shown grey
+//    2  u16  flags, 1 = alarm, 2 = no overlays
+//    4  i32  Celcius of grey level 0, in thousandths
+//    8  i32  Celcius of grey level 255
+//   12  i32  min temperature
+//   16  i32  max temperature
+//   20  i32  central temperature
+//   24  u16  min x, y
+//   28  u16  max x, y
+//   32  u16  central x, y
+//   36  u16  hotspot count, at most MAX_HOTSPOTS
+//   38  u16  reserved, 0
+//
+// and for every hotspot, hottest first:
+//
+//    0  i32  peak temperature
+//    4  u16  marker x, y (processed frame pixels)
+//    8  u16  marker radius
+//   10  u16  area (raw sensor pixels)
+
+const std::size_t GREY_INFO_SIZE = 40;
+const std::size_t GREY_HOTSPOT_SIZE = 12;
+
+bool encode_grey_frame(const cv::Mat &frame_g8, int colormap, const FrameStats &stats, ParallelJpegEncoder &jpeg,
+                       WorkerPool *pool, std::vector<uchar> &out, bool overlays = true);
+
+// Reference decoder: the colorized frame with its overlays, as process_frame would have made it but for
+//  the JPEG's loss in the grey levels. Returns false on a short payload or a JPEG that doesn't decode.
+bool decode_grey_frame(const uint8_t *payload, std::size_t size, cv::Mat &outframe, FrameStats *stats = nullptr);
+
+#endif
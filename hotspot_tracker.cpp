@@ -0,0 +1,168 @@
+#include "hotspot_tracker.h"
+#include <cfloat>
+#include <cstdio>
+
+using namespace cv;
+
+// Cost of a hotspot and a track too far apart to be matched, finite so the potentials stay finite
+static const double OUT_OF_GATE = 1e9;
+
+std::string track_alarm_json(const TrackAlarm &alarm, int cameraId, uint32_t sequence, uint64_t captureTimeUs)
+{
+    char json[256];
+    snprintf(json, sizeof(json), "{\"camera\":%d,\"track\":%d,\"state\":\"alarm\",\"sequence\":%u,\"time\":%llu,\"peak\":%.2f,\"x\":%.1f,\"y\":%.1f}",
+             cameraId, alarm.id, sequence, (unsigned long long)captureTimeUs, alarm.peakCelcius, alarm.position.x, alarm.position.y);
+    return json;
+}
+
+// Minimum cost assignment of rows hotspots to distinct slots (rows <= MAX_TRACKS), the O(n^2 m) Hungarian
+//  algorithm with row and column potentials, 1 based as it is usually written
+void HotspotTracker::assign(int rows)
+{
+    const int columns = MAX_TRACKS;
+    double u[MAX_HOTSPOTS + 1] = {0}, v[MAX_TRACKS + 1] = {0}, minv[MAX_TRACKS + 1];
+    int p[MAX_TRACKS + 1] = {0}, way[MAX_TRACKS + 1] = {0};
+    bool used[MAX_TRACKS + 1];
+
+    for (int i = 1; i <= rows; i++)
+    {
+        p[0] = i;
+        int j0 = 0;
+        for (int j = 0; j <= columns; j++)
+        {
+            minv[j] = DBL_MAX;
+            used[j] = false;
+        }
+
+        do
+        {
+            used[j0] = true;
+            int i0 = p[j0], j1 = 0;
+            double delta = DBL_MAX;
+            for (int j = 1; j <= columns; j++)
+            {
+                if (used[j])
+                {
+                    continue;
+                }
+                double reduced = cost[i0 - 1][j - 1] - u[i0] - v[j];
+                if (reduced < minv[j])
+                {
+                    minv[j] = reduced;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta)
+                {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= columns; j++)
+            {
+                if (used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        do
+        {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    for (int j = 1; j <= columns; j++)
+    {
+        if (p[j] != 0)
+        {
+            assignment[p[j] - 1] = j - 1;
+        }
+    }
+}
+
+int HotspotTracker::update(Hotspot *hotspots, int count, TrackAlarm *alarms)
+{
+    double gate = (double)gatePixels * gatePixels;
+    for (int i = 0; i < count; i++)
+    {
+        for (int slot = 0; slot < MAX_TRACKS; slot++)
+        {
+            const Track &track = pool[slot];
+            if (track.id == 0)
+            {
+                cost[i][slot] = gate;
+                continue;
+            }
+            Point2f offset = hotspots[i].centroid - (track.position + track.velocity);
+            double distance = (double)offset.x * offset.x + (double)offset.y * offset.y;
+            cost[i][slot] = distance <= gate ? distance : OUT_OF_GATE;
+        }
+    }
+    assign(count);
+
+    bool matched[MAX_TRACKS] = {false};
+    int alarmCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Hotspot &hotspot = hotspots[i];
+        int slot = assignment[i];
+        Track &track = pool[slot];
+        if (cost[i][slot] >= OUT_OF_GATE)
+        {
+            // Every slot is taken by a track further away
+            hotspot.trackId = 0;
+            continue;
+        }
+
+        if (track.id == 0)
+        {
+            track = Track();
+            track.id = nextId++;
+            track.position = hotspot.centroid;
+        }
+        else
+        {
+            track.velocity = (hotspot.centroid - track.position) * 0.5f + track.velocity * 0.5f;
+            track.position = hotspot.centroid;
+        }
+        track.peakCelcius = hotspot.peakCelcius;
+        track.hits++;
+        track.missed = 0;
+        matched[slot] = true;
+        hotspot.trackId = track.id;
+
+        if (!track.alarmed && track.hits >= hitsToAlarm && track.peakCelcius > alarmCelcius)
+        {
+            track.alarmed = true;
+            TrackAlarm &alarm = alarms[alarmCount++];
+            alarm.id = track.id;
+            alarm.peakCelcius = track.peakCelcius;
+            alarm.position = track.position;
+        }
+    }
+
+    for (int slot = 0; slot < MAX_TRACKS; slot++)
+    {
+        Track &track = pool[slot];
+        if (track.id == 0 || matched[slot])
+        {
+            continue;
+        }
+        track.position += track.velocity;
+        if (++track.missed > maxMissed)
+        {
+            track.id = 0;
+        }
+    }
+
+    return alarmCount;
+}
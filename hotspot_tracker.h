@@ -0,0 +1,67 @@
+#ifndef HOTSPOT_TRACKER_H
+#define HOTSPOT_TRACKER_H
+
+#include <opencv2/core/core.hpp>
+#include <cstdint>
+#include <string>
+#include "hotspots.h"
+
+// Tracks alive at once, every hotspot of a frame can always be offered a slot
+const int MAX_TRACKS = 16;
+static_assert(MAX_HOTSPOTS <= MAX_TRACKS, "every hotspot needs a track slot to go to");
+
+struct Track
+{
+    int id = 0;            // 0 = free slot
+    cv::Point2f position;  // raw sensor pixels
+    cv::Point2f velocity;  // raw sensor pixels per frame
+    double peakCelcius = 0;
+    int hits = 0;          // frames it was matched in
+    int missed = 0;        // frames since it was last matched
+    bool alarmed = false;
+};
+
+// A track going over the alarm threshold, once per track
+struct TrackAlarm
+{
+    int id = 0;
+    double peakCelcius = 0;
+    cv::Point2f position;
+};
+
+// {"camera":..,"track":..,"state":"alarm",...}, one line of the alarm channel
+std::string track_alarm_json(const TrackAlarm &alarm, int cameraId, uint32_t sequence, uint64_t captureTimeUs);
+
+// Gives hotspots ids that last from frame to frame, so that a person alarms once rather than on every
+//  frame they are in.
+//
+// Every track predicts where its hotspot will be with constant velocity. The hotspots of a frame are
+//  assigned to tracks with the Hungarian algorithm on squared distances to those predictions; a free
+//  slot costs as much as a match right at the gate, so a hotspot only starts a new track when no track
+//  is predicted close enough. A track nothing matched coasts on its velocity until maxMissed frames have
+//  gone by. All state is a fixed pool of MAX_TRACKS, nothing is allocated per frame.
+class HotspotTracker
+{
+public:
+    float gatePixels = 12;     // furthest a hotspot may be from its track's prediction, raw pixels
+    int maxMissed = 9;         // a second at the Seek's 9 fps
+    int hitsToAlarm = 2;       // frames a track has to be seen before it may alarm
+    double alarmCelcius = 45;  // the peak a track alarms over
+
+    // Sets the trackId of every hotspot, 0 when the pool had no room for it. Writes the tracks that started
+    //  alarming to alarms, which must hold MAX_TRACKS, and returns how many.
+    int update(Hotspot *hotspots, int count, TrackAlarm *alarms);
+
+    const Track &track(int slot) const { return pool[slot]; }
+
+private:
+    void assign(int rows);
+
+    Track pool[MAX_TRACKS];
+    int nextId = 1;
+
+    double cost[MAX_HOTSPOTS][MAX_TRACKS];
+    int assignment[MAX_HOTSPOTS]; // slot of every hotspot
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "hotspots.h"
+#include "thermal.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace cv;
+
+void HotspotDetector::reserve(Size size)
+{
+    if (size == reserved)
+    {
+        return;
+    }
+
+    // At most every other pixel starts a run
+    std::size_t maxRuns = (std::size_t)size.height * ((size.width + 1) / 2);
+    runs.reserve(maxRuns);
+    parent.reserve(maxRuns);
+    blobOf.reserve(maxRuns);
+    blobList.reserve(maxRuns);
+    order.reserve(maxRuns);
+    reserved = size;
+}
+
+// Root of a run, halving the path on the way
+int HotspotDetector::find(int run)
+{
+    while (parent[run] != run)
+    {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+// The lower index becomes the root, so a blob's root is its first run in row order
+void HotspotDetector::join(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a < b)
+    {
+        parent[b] = a;
+    }
+    else if (b < a)
+    {
+        parent[a] = b;
+    }
+}
+
+int HotspotDetector::detect(const Mat &raw, int deviceTempSensor, Hotspot *hotspots, int capacity)
+{
+    reserve(raw.size());
+    runs.clear();
+    parent.clear();
+    blobList.clear();
+    order.clear();
+
+    // Temperatures rise with the raw value, so the threshold is one raw level
+    double device_k = device_sensor_to_k(deviceTempSensor);
+    double limit = std::floor(raw_from_temp(thresholdCelcius, device_k));
+    if (limit >= 65535)
+    {
+        blobs = 0;
+        return 0;
+    }
+    uint16_t hot = (uint16_t)(std::max(limit, -1.0) + 1);
+
+    int previousBegin = 0, previousEnd = 0; // runs of the row above
+    for (int y = 0; y < raw.rows; y++)
+    {
+        const uint16_t *in = raw.ptr<uint16_t>(y);
+        int rowBegin = (int)runs.size();
+        int touching = previousBegin;
+        int x = 0;
+        while (x < raw.cols)
+        {
+            if (in[x] < hot)
+            {
+                x++;
+                continue;
+            }
+
+            Run run;
+            run.row = y;
+            run.begin = x;
+            run.peak = in[x];
+            run.peakX = x;
+            for (; x < raw.cols && in[x] >= hot; x++)
+            {
+                if (in[x] > run.peak)
+                {
+                    run.peak = in[x];
+                    run.peakX = x;
+                }
+            }
+            run.end = x;
+
+            int index = (int)runs.size();
+            runs.push_back(run);
+            parent.push_back(index);
+
+            // Runs above that end left of this one can't touch the next one either
+            while (touching < previousEnd && runs[touching].end < run.begin)
+            {
+                touching++;
+            }
+            for (int up = touching; up < previousEnd && runs[up].begin <= run.end; up++)
+            {
+                join(up, index);
+            }
+        }
+        previousBegin = rowBegin;
+        previousEnd = (int)runs.size();
+    }
+
+    // Roots come before the rest of their blob, so one pass in order folds every run into its blob
+    blobOf.resize(runs.size());
+    for (int i = 0; i < (int)runs.size(); i++)
+    {
+        const Run &run = runs[i];
+        int root = find(i);
+        if (root == i)
+        {
+            blobOf[i] = (int)blobList.size();
+            blobList.push_back(Blob{0, 0, 0, run.peak, Point(run.peakX, run.row)});
+        }
+        Blob &blob = blobList[blobOf[root]];
+
+        int64_t length = run.end - run.begin;
+        blob.area += length;
+        blob.sumX += (int64_t)(run.begin + run.end - 1) * length / 2;
+        blob.sumY += (int64_t)run.row * length;
+        if (run.peak > blob.peak)
+        {
+            blob.peak = run.peak;
+            blob.peakAt = Point(run.peakX, run.row);
+        }
+    }
+
+    for (int i = 0; i < (int)blobList.size(); i++)
+    {
+        if (blobList[i].area >= minArea)
+        {
+            order.push_back(i);
+        }
+    }
+    blobs = (int)order.size();
+
+    int count = std::min(capacity, blobs);
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), [this](int a, int b) {
+        return blobList[a].peak > blobList[b].peak;
+    });
+
+    for (int i = 0; i < count; i++)
+    {
+        const Blob &blob = blobList[order[i]];
+        Hotspot &hotspot = hotspots[i];
+        hotspot.centroid = Point2f((float)blob.sumX / blob.area, (float)blob.sumY / blob.area);
+        hotspot.peak = blob.peakAt;
+        hotspot.peakCelcius = temp_from_raw(blob.peak, device_k);
+        hotspot.area = (int)blob.area;
+    }
+    return count;
+}
@@ -0,0 +1,70 @@
+#ifndef HOTSPOTS_H
+#define HOTSPOTS_H
+
+#include <opencv2/core/core.hpp>
+#include <cstdint>
+#include <vector>
+
+// Most hotspots a frame reports, the hottest ones when there are more
+const int MAX_HOTSPOTS = 8;
+
+// A connected blob of pixels over the hotspot threshold
+struct Hotspot
+{
+    cv::Point2f centroid; // raw sensor pixels
+    cv::Point peak;       // the hottest pixel, raw sensor pixels
+    double peakCelcius = 0;
+    int area = 0;         // pixels
+
+    // Where the overlay goes, in processed frame pixels, filled in by process_frame_grey
+    cv::Point marker;
+    int radius = 0;
+
+    int trackId = 0; // set by HotspotTracker, 0 while untracked
+};
+
+// Finds every blob of pixels hotter than thresholdCelcius in a raw frame, 8-connected.
+//
+// A single pass labels runs of hot pixels on a row rather than pixels: each run is joined to the runs of
+//  the row above that touch it with union-find, and its area, coordinate sums and hottest pixel are
+//  folded into its blob afterwards. All buffers are sized for the worst case of the frame size on first
+//  use, so frames after that allocate nothing.
+class HotspotDetector
+{
+public:
+    double thresholdCelcius = 35;
+    int minArea = 4; // smaller blobs are noise
+
+    // Writes up to capacity hotspots to hotspots, hottest first, and returns how many
+    int detect(const cv::Mat &raw, int deviceTempSensor, Hotspot *hotspots, int capacity);
+
+    int blobs = 0;   // blobs of at least minArea pixels in the last frame, reported or not
+
+private:
+    struct Run
+    {
+        int row, begin, end; // columns [begin, end)
+        uint16_t peak;
+        int peakX;
+    };
+
+    struct Blob
+    {
+        int64_t area, sumX, sumY;
+        uint16_t peak;
+        cv::Point peakAt;
+    };
+
+    void reserve(cv::Size size);
+    int find(int run);
+    void join(int a, int b);
+
+    cv::Size reserved;
+    std::vector<Run> runs;
+    std::vector<int> parent;  // per run, union-find
+    std::vector<int> blobOf;  // per root run, index into blobList
+    std::vector<Blob> blobList;
+    std::vector<int> order;   // blobs worth reporting, sorted by peak
+};
+
+#endif
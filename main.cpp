@@ -14,21 +14,31 @@
 #include <utility>
 #include <chrono>
 #include "args.h"
+#include "event_clip.h"
+#include "frame_source.h"
+#include "hotspot_tracker.h"
+#include "nuc.h"
+#include "process_frame.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "thermal.h"
+#include "video_sink.h"
 
 using namespace cv;
 using namespace LibSeek;
 
+// Frames kept around an alarm, the ring is sized for the Compact Pro's frame rate
+const double DEFAULT_CLIP_SECONDS = 5.0;
+const double CLIP_MAX_FPS = 15.0;
+
+// Frame rate written into video files when the source doesn't set one, the Seek's own
+const double DEFAULT_VIDEO_FPS = 9.0;
+
 // Setup sig handling
 static volatile sig_atomic_t sigflag = 0;
 
-enum CustomLineTypes {
-    LINE_AA = 16
-};
-
 auto isConnectedToServer = false;
 auto isWindowMode = true;
-auto fireWarningText = "WARNING";
-auto fireThresholdCelcius = 45;
 void connectToServer(sf::TcpSocket &socket, const char *remoteAddress, const int remotePort);
 
 std::stringstream getTime();
@@ -39,157 +49,6 @@ void handle_sig(int sig)
     sigflag = 1;
 }
 
-double device_sensor_to_k(double sensor)
-{
-    // formula from http://aterlux.ru/article/ntcresistor-en
-    double ref_temp = 297.0;    // 23C from table
-    double ref_sensor = 6616.0; // ref value from table
-    double beta = 200;          // best beta coef we've found
-    double part3 = log(sensor) - log(ref_sensor);
-    double parte = part3 / beta + 1.0 / ref_temp;
-    return 1.0 / parte;
-}
-
-double temp_from_raw(int x, double device_k)
-{
-    // Constants below are taken from linear trend line in Excel.
-    // -273 is translation of Kelvin to Celsius
-    // 330 is max temperature supported by Seek device
-    // 16384 is full 14 bits value, max possible ()
-    double base = x * 330 / 16384.0;
-    double lin_k = -1.5276;        // derived from Excel linear model
-    double lin_offset = -470.8979; // same Excel model
-
-    auto fahrenheit = base - device_k * lin_k + lin_offset - 273.0;
-    return (fahrenheit - 32.0) * 5.0 / 9.0;
-}
-
-void overlay_values(Mat &outframe, Point coord, const Scalar &color)
-{
-    int gap = 2;
-    int arrLen = 7;
-    int weight = 1;
-    line(outframe, coord - Point(-arrLen, -arrLen), coord - Point(-gap, -gap), color, weight);
-    line(outframe, coord - Point(arrLen, arrLen), coord - Point(gap, gap), color, weight);
-    line(outframe, coord - Point(-arrLen, arrLen), coord - Point(-gap, gap), color, weight);
-    line(outframe, coord - Point(arrLen, -arrLen), coord - Point(gap, -gap), color, weight);
-}
-
-void draw_temp(Mat &outframe, double temp, const Point &coord, Scalar color)
-{
-    char txt[64];
-    sprintf(txt, "%5.1f", temp);
-    putText(outframe, txt, coord - Point(40, -20), FONT_HERSHEY_COMPLEX, 1, std::move(color), 2, CustomLineTypes::LINE_AA);
-}
-
-void draw_text(Mat &outframe, const char* text, const Point &coord, Scalar color)
-{
-    putText(outframe, text, coord - Point(40, -20), FONT_HERSHEY_COMPLEX, 1, std::move(color), 2, CustomLineTypes::LINE_AA);
-}
-
-// Function to process a raw (corrected) seek frame
-void process_frame(Mat &inframe, Mat &outframe, float scale, int colormap, int rotate, int device_temp_sensor)
-{
-    Mat frame_g8_nograd, frame_g16; // Transient Mat containers for processing
-
-    // get raw max/min/central values
-    double min, max, central;
-    minMaxIdx(inframe, &min, &max);
-    Scalar valat = inframe.at<uint16_t>(Point(inframe.cols / 2.0, inframe.rows / 2.0));
-    central = valat[0];
-
-    double device_k = device_sensor_to_k(device_temp_sensor);
-
-    double mintemp = temp_from_raw(min, device_k);
-    double maxtemp = temp_from_raw(max, device_k);
-    double centraltemp = temp_from_raw(central, device_k);
-
-    // printf("rmin,rmax,central,devtempsns: %d %d %d %d\t", (int)min, (int)max, (int)central, (int)device_temp_sensor);
-    // printf("min-max-center-device: %.1f %.1f %.1f %.1f\n", mintemp, maxtemp, centraltemp, device_k - 273.0);
-
-    normalize(inframe, frame_g16, 0, 65535, NORM_MINMAX);
-
-    // Convert seek CV_16UC1 to CV_8UC1
-    frame_g16.convertTo(frame_g8_nograd, CV_8UC1, 1.0 / 256.0);
-
-    // Rotate image
-    if (rotate == 90)
-    {
-        transpose(frame_g8_nograd, frame_g8_nograd);
-        flip(frame_g8_nograd, frame_g8_nograd, 1);
-    }
-    else if (rotate == 180)
-    {
-        flip(frame_g8_nograd, frame_g8_nograd, -1);
-    }
-    else if (rotate == 270)
-    {
-        transpose(frame_g8_nograd, frame_g8_nograd);
-        flip(frame_g8_nograd, frame_g8_nograd, 0);
-    }
-
-    Point minp, maxp, centralp;
-    minMaxLoc(frame_g8_nograd, NULL, NULL, &minp, &maxp); // doing it here, so we take rotation into account
-    centralp = Point(frame_g8_nograd.cols / 2.0, frame_g8_nograd.rows / 2.0);
-    minp *= scale;
-    maxp *= scale;
-    centralp *= scale;
-
-    // Resize image: http://docs.opencv.org/3.2.0/da/d54/group__imgproc__transform.html#ga5bb5a1fea74ea38e1a5445ca803ff121
-    // Note this is expensive computationally, only do if option set != 1
-    if (scale != 1.0)
-        resize(frame_g8_nograd, frame_g8_nograd, Size(), scale, scale, INTER_LINEAR);
-
-    // add gradient
-    Mat frame_g8(Size(frame_g8_nograd.cols + 20, frame_g8_nograd.rows), CV_8U, Scalar(128));
-    for (int r = 0; r < frame_g8.rows - 1; r++)
-    {
-        frame_g8.row(r).setTo(255.0 * (frame_g8.rows - r) / ((float)frame_g8.rows));
-    }
-    frame_g8_nograd.copyTo(frame_g8(Rect(0, 0, frame_g8_nograd.cols, frame_g8_nograd.rows)));
-
-    // Apply colormap: http://docs.opencv.org/3.2.0/d3/d50/group__imgproc__colormap.html#ga9a805d8262bcbe273f16be9ea2055a65
-    if (colormap != -1)
-    {
-        applyColorMap(frame_g8, outframe, colormap);
-    }
-    else
-    {
-        cv::cvtColor(frame_g8, outframe, cv::COLOR_GRAY2BGR);
-    }
-
-    // overlay marks
-    draw_temp(outframe, mintemp, Point(outframe.cols - 49, outframe.rows - 29), Scalar(255, 255, 255));
-    draw_temp(outframe, mintemp, Point(outframe.cols - 51, outframe.rows - 31), Scalar(0, 0, 0));
-    draw_temp(outframe, mintemp, Point(outframe.cols - 50, outframe.rows - 30), Scalar(255, 0, 0));
-
-    draw_temp(outframe, maxtemp, Point(outframe.cols - 49, 0), Scalar(255, 255, 255));
-    draw_temp(outframe, maxtemp, Point(outframe.cols - 51, 2), Scalar(0, 0, 0));
-    draw_temp(outframe, maxtemp, Point(outframe.cols - 50, 1), Scalar(0, 0, 255));
-
-    draw_temp(outframe, centraltemp, centralp + Point(-1, -1), Scalar(255, 255, 255));
-    draw_temp(outframe, centraltemp, centralp + Point(1, 1), Scalar(0, 0, 0));
-    draw_temp(outframe, centraltemp, centralp + Point(0, 0), Scalar(128, 128, 128));
-
-    overlay_values(outframe, centralp + Point(-1, -1), Scalar(0, 0, 0));
-    overlay_values(outframe, centralp + Point(1, 1), Scalar(255, 255, 255));
-    overlay_values(outframe, centralp, Scalar(128, 128, 128));
-
-    overlay_values(outframe, minp + Point(-1, -1), Scalar(0, 0, 0));
-    overlay_values(outframe, minp + Point(1, 1), Scalar(255, 255, 255));
-    overlay_values(outframe, minp, Scalar(255, 0, 0));
-
-    overlay_values(outframe, maxp + Point(-1, -1), Scalar(0, 0, 0));
-    overlay_values(outframe, maxp + Point(1, 1), Scalar(255, 255, 255));
-    overlay_values(outframe, maxp, Scalar(0, 0, 255));
-
-    if (maxtemp > fireThresholdCelcius) {
-        draw_text(outframe, fireWarningText, maxp + Point(-1, -1), Scalar(255, 255, 255));
-        draw_text(outframe, fireWarningText, maxp + Point(1, 1), Scalar(0, 0, 0));
-        draw_text(outframe, fireWarningText, maxp + Point(0, 0), Scalar(0, 0, 255));
-    }
-}
-
 std::stringstream getTime()
 {
     auto time = std::time(nullptr);
@@ -231,6 +90,29 @@ int main(int argc, char **argv)
     args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
     args::ValueFlag<std::string> arg_target_host(parser, "arg_target_host", "Target host", {"host"});
     args::ValueFlag<std::string> arg_target_port(parser, "arg_target_port", "Target port", {"port"});
+    args::Flag arg_binary_header(parser, "arg_binary_header", "Send frames with the binary FrameHeader instead of :::length", {"binary-header"});
+    args::ValueFlag<std::string> arg_source(parser, "arg_source", "Frame source: seek, seekpro, synthetic, synthetic-pro, replay or recording", {"source"});
+    args::ValueFlag<std::string> arg_source_path(parser, "arg_source_path", "FFC file for seek, image glob for replay, segment glob for recording", {"source-path"});
+    args::ValueFlag<std::string> arg_source_fps(parser, "arg_source_fps", "Frame rate of synthetic/replay/recording sources, 0 = unthrottled", {"source-fps"});
+    args::ValueFlag<std::string> arg_sensor_temp(parser, "arg_sensor_temp", "Device sensor temperature of synthetic/replay sources (Celcius)", {"sensor-temp"});
+    args::ValueFlag<std::string> arg_record(parser, "arg_record", "Record raw frames to <prefix>_NNNN.tsrec segments", {"record"});
+    args::ValueFlag<std::string> arg_record_segment(parser, "arg_record_segment", "Frames per recording segment", {"record-segment-frames"});
+    args::ValueFlag<std::string> arg_record_codec(parser, "arg_record_codec", "Recording payload: raw or delta (lossless compression)", {"record-codec"});
+    args::ValueFlag<std::string> arg_clip(parser, "arg_clip", "Save raw clips around fever alarms to <prefix>_<sequence>.tsrec", {"clip"});
+    args::ValueFlag<std::string> arg_clip_pre(parser, "arg_clip_pre", "Seconds kept before an alarm", {"clip-pre"});
+    args::ValueFlag<std::string> arg_clip_post(parser, "arg_clip_post", "Seconds kept after the last alarming frame", {"clip-post"});
+    args::ValueFlag<std::string> arg_video(parser, "arg_video", "Write the processed frames to video files, e.g. out/cam.mp4 for out/cam_0000.mp4, ...", {"video"});
+    args::ValueFlag<std::string> arg_video_encoder(parser, "arg_video_encoder", "Video encoder: opencv (VideoWriter) or ffmpeg (pipe)", {"video-encoder"});
+    args::ValueFlag<std::string> arg_video_codec(parser, "arg_video_codec", "Fourcc for opencv (default MJPG), encoder for ffmpeg (default libx264)", {"video-codec"});
+    args::ValueFlag<std::string> arg_video_segment_seconds(parser, "arg_video_segment_seconds", "Start a new video file after this many seconds", {"video-segment-seconds"});
+    args::ValueFlag<std::string> arg_fixed_range(parser, "arg_fixed_range", "Colors span this fixed low:high Celcius range, e.g. 20:45, instead of the frame's", {"fixed-range"});
+    args::ValueFlag<std::string> arg_range_hysteresis(parser, "arg_range_hysteresis", "Celcius the min/max have to move inside the color range before it narrows", {"range-hysteresis"});
+    args::ValueFlag<std::string> arg_upscale(parser, "arg_upscale", "Upscaling: bilinear (default) or nearest", {"upscale"});
+    args::ValueFlag<std::string> arg_hotspots(parser, "arg_hotspots", "Mark every hotspot over this many Celcius, not just the hottest pixel", {"hotspots"});
+    args::ValueFlag<std::string> arg_bad_pixels(parser, "arg_bad_pixels", "Correct the pixels listed in this bad pixel map (see --calibrate-bad-pixels)", {"bad-pixels"});
+    args::ValueFlag<std::string> arg_nuc(parser, "arg_nuc", "Correct every pixel's gain and offset from these NUC tables (see streamer --calibrate-nuc)", {"nuc"});
+    args::ValueFlag<std::string> arg_fire_threshold(parser, "arg_fire_threshold", "Alarm when the frame's max goes over this many Celcius (default 45)", {"fire-threshold"});
+    args::ValueFlag<std::string> arg_video_segment_mb(parser, "arg_video_segment_mb", "Start a new video file once it reaches this many megabytes", {"video-segment-mb"});
 
     // Parse command line arguments
     try
@@ -255,15 +137,66 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (arg_upscale)
+    {
+        std::string upscale = args::get(arg_upscale);
+        if (upscale == "nearest")
+        {
+            upscaleInterpolation = cv::INTER_NEAREST;
+        }
+        else if (upscale != "bilinear")
+        {
+            std::cerr << "Unknown upscaling " << upscale << std::endl;
+            std::cerr << parser;
+            return 1;
+        }
+    }
+
+    if (arg_fire_threshold)
+    {
+        if (!parse_celcius(args::get(arg_fire_threshold), fireThresholdCelcius))
+        {
+            std::cerr << "Fire threshold needs a temperature in Celcius, got " << args::get(arg_fire_threshold) << std::endl;
+            return 1;
+        }
+    }
+
     // Register signals
     signal(SIGINT, handle_sig);
     signal(SIGTERM, handle_sig);
+    // A video encoder or client that went away shows up as a failed write instead of killing the process
+    signal(SIGPIPE, SIG_IGN);
 
-    // Setup seek camera
-    LibSeek::SeekCam *seek;
-    LibSeek::SeekThermal seekClassic("");
+    // Setup frame source, a seek camera unless told otherwise
+    FrameSourceOptions sourceOptions;
+    if (arg_source)
+    {
+        sourceOptions.kind = args::get(arg_source);
+    }
+    if (arg_source_path)
+    {
+        sourceOptions.path = args::get(arg_source_path);
+    }
+    if (arg_source_fps)
+    {
+        sourceOptions.fps = std::stod(args::get(arg_source_fps));
+    }
+    if (arg_sensor_temp)
+    {
+        sourceOptions.sensorCelcius = std::stod(args::get(arg_sensor_temp));
+    }
+    if (arg_bad_pixels)
+    {
+        sourceOptions.badPixels = args::get(arg_bad_pixels);
+    }
 
-    seek = &seekClassic;
+    auto seek = create_frame_source(sourceOptions);
+    if (!seek)
+    {
+        std::cerr << "Unknown frame source " << sourceOptions.kind << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
 
     if (!seek->open())
     {
@@ -274,6 +207,40 @@ int main(int argc, char **argv)
     // Mat containers for seek frames
     Mat seekFrame, outFrame;
 
+    // Lookup tables colorizing the frames, over a range that doesn't flicker with the noise
+    ColormapCache palette;
+    if (arg_range_hysteresis)
+    {
+        palette.hysteresisCelcius = std::stod(args::get(arg_range_hysteresis));
+    }
+    if (arg_fixed_range)
+    {
+        std::string range = args::get(arg_fixed_range);
+        if (!parse_fixed_range(range, palette.fixedLowCelcius, palette.fixedHighCelcius))
+        {
+            std::cerr << "Fixed range needs low:high Celcius with low below high, got " << range << std::endl;
+            return 1;
+        }
+        palette.fixed = true;
+    }
+
+    NonUniformityCorrection nuc;
+    if (arg_nuc && !nuc.load(args::get(arg_nuc)))
+    {
+        return 1;
+    }
+
+    HotspotDetector hotspotDetector;
+    HotspotDetector *hotspots = nullptr;
+    HotspotTracker tracker;
+    TrackAlarm trackAlarms[MAX_TRACKS];
+    if (arg_hotspots)
+    {
+        hotspotDetector.thresholdCelcius = std::stod(args::get(arg_hotspots));
+        hotspots = &hotspotDetector;
+        tracker.alarmCelcius = fireThresholdCelcius;
+    }
+
     // Retrieve a single frame, resize to requested scaling value and then determine size of matrix
     //  so we can size the VideoWriter stream correctly
     if (!seek->read(seekFrame))
@@ -282,8 +249,56 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    // Raw frames go to disk from a writer thread, a slow disk drops frames rather than stalling capture
+    Recorder recorder;
+    if (arg_record)
+    {
+        uint64_t segmentFrames = arg_record_segment ? std::stoull(args::get(arg_record_segment)) : RECORDING_DEFAULT_SEGMENT_FRAMES;
+        bool compress = arg_record_codec && args::get(arg_record_codec) == "delta";
+        recorder.start(args::get(arg_record), segmentFrames, RECORDER_QUEUE_DEPTH, compress);
+    }
+
+    EventClipRecorder clipRecorder;
+    if (arg_clip)
+    {
+        double pre = arg_clip_pre ? std::stod(args::get(arg_clip_pre)) : DEFAULT_CLIP_SECONDS;
+        double post = arg_clip_post ? std::stod(args::get(arg_clip_post)) : DEFAULT_CLIP_SECONDS;
+        clipRecorder.start(args::get(arg_clip), pre, post, CLIP_MAX_FPS, seekFrame.size());
+    }
+
+    // Video files are encoded on their own thread and drop frames rather than hold up the live output
+    VideoSink videoSink;
+    if (arg_video)
+    {
+        VideoSinkOptions videoOptions;
+        videoOptions.path = args::get(arg_video);
+        videoOptions.fps = sourceOptions.fps > 0 ? sourceOptions.fps : DEFAULT_VIDEO_FPS;
+        if (arg_video_encoder)
+        {
+            videoOptions.encoder = args::get(arg_video_encoder);
+        }
+        if (arg_video_codec)
+        {
+            videoOptions.codec = args::get(arg_video_codec);
+        }
+        if (arg_video_segment_seconds)
+        {
+            videoOptions.segmentSeconds = std::stod(args::get(arg_video_segment_seconds));
+        }
+        if (arg_video_segment_mb)
+        {
+            videoOptions.segmentBytes = (uint64_t)(std::stod(args::get(arg_video_segment_mb)) * 1024 * 1024);
+        }
+        if (!videoSink.start(videoOptions))
+        {
+            return 1;
+        }
+    }
+
     // Variables for socket mode
     sf::TcpSocket socket;
+    FrameHeader frameHeader;
+    uint32_t frameSequence = 0;
     const char *remoteAddress = nullptr;
     int remotePort = -1;
 
@@ -319,8 +334,33 @@ int main(int argc, char **argv)
             return -1;
         }
 
+        frameHeader.sequence = frameSequence++;
+        frameHeader.captureTimeUs = timestamp_us();
+        nuc.apply(seekFrame);
+
+        if (arg_record)
+        {
+            recorder.record(seekFrame, frameHeader.sequence, frameHeader.captureTimeUs, seek->device_temp_sensor());
+        }
+
         // Retrieve frame from seek and process
-        process_frame(seekFrame, outFrame, 3.0f, 11, 0, seek->device_temp_sensor());
+        FrameStats stats;
+        process_frame(seekFrame, outFrame, 3.0f, 11, 0, seek->device_temp_sensor(), &stats, nullptr, &palette, hotspots);
+
+        // Once per person rather than once per frame
+        if (hotspots)
+        {
+            int alarms = tracker.update(stats.hotspots, stats.hotspotCount, trackAlarms);
+            for (int i = 0; i < alarms; i++)
+            {
+                std::cout << getTime().str() << " hotspot " << trackAlarms[i].id << " alarm, peak " << trackAlarms[i].peakCelcius << std::endl;
+            }
+        }
+
+        if (arg_clip)
+        {
+            clipRecorder.push(seekFrame, frameHeader.sequence, frameHeader.captureTimeUs, seek->device_temp_sensor(), stats.alarm);
+        }
 
         cv::putText(
             outFrame,
@@ -332,6 +372,11 @@ int main(int argc, char **argv)
             1.5, /* Thickness */
             CustomLineTypes::LINE_AA);
 
+        if (arg_video)
+        {
+            videoSink.push(outFrame);
+        }
+
         if (!isWindowMode)
         {
             std::vector<uchar> imageBuffer;
@@ -339,9 +384,25 @@ int main(int argc, char **argv)
 
             unsigned long imageSize = imageBuffer.size() * sizeof(uchar);
             char imageSizeText[100];
-            sprintf(imageSizeText, ":::%0.10lu", imageSize);
+            std::size_t headerSize;
+            if (arg_binary_header)
+            {
+                frameHeader.payloadType = PAYLOAD_JPEG;
+                frameHeader.width = outFrame.cols;
+                frameHeader.height = outFrame.rows;
+                frameHeader.payloadSize = imageSize;
+                frameHeader.payloadCrc = crc32(imageBuffer.data(), imageSize);
+                frameHeader.sendTimeUs = timestamp_us();
+                write_frame_header(frameHeader, (uint8_t *)imageSizeText);
+                headerSize = FRAME_HEADER_SIZE;
+            }
+            else
+            {
+                sprintf(imageSizeText, ":::%0.10lu", imageSize);
+                headerSize = strlen(imageSizeText);
+            }
 
-            if (isConnectedToServer && socket.send(imageSizeText, strlen(imageSizeText)) != sf::Socket::Done)
+            if (isConnectedToServer && socket.send(imageSizeText, headerSize) != sf::Socket::Done)
             {
                 isConnectedToServer = false;
             }
@@ -369,5 +430,15 @@ int main(int argc, char **argv)
     }
 
     std::cout << "Break signal detected, exiting" << std::endl;
+    if (arg_record)
+    {
+        recorder.stop();
+        std::cout << recorder.framesWritten << " frames recorded, " << recorder.framesDropped << " dropped" << std::endl;
+    }
+    if (arg_video)
+    {
+        videoSink.stop();
+        std::cout << videoSink.framesWritten << " video frames in " << videoSink.segmentsWritten << " files, " << videoSink.framesDropped << " dropped" << std::endl;
+    }
     return 0;
 }
@@ -0,0 +1,327 @@
+#include "multicast.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+static const int SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;
+
+// IPv4 + UDP headers, and the most a UDP datagram can carry over IPv4
+static const int IP_UDP_OVERHEAD = 28;
+static const int MAX_UDP_PAYLOAD = 65507;
+
+// Frame ids this far behind the newest one are treated as a restarted sender rather than stragglers
+static const int32_t STALE_FRAME_WINDOW = 64;
+
+static bool parse_address(const std::string &address, in_addr &out)
+{
+    return inet_pton(AF_INET, address.c_str(), &out) == 1;
+}
+
+MulticastSender::~MulticastSender()
+{
+    close();
+}
+
+bool MulticastSender::open(const std::string &group, int port, int ttl, int mtu, const std::string &interfaceAddress)
+{
+    int payload = std::min(mtu - IP_UDP_OVERHEAD, MAX_UDP_PAYLOAD) - (int)MULTICAST_HEADER_SIZE;
+    if (payload <= 0)
+    {
+        std::cerr << "An mtu of " << mtu << " leaves no room for frame data, it needs to be over "
+                  << IP_UDP_OVERHEAD + MULTICAST_HEADER_SIZE << std::endl;
+        return false;
+    }
+
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    if (!parse_address(group, destination.sin_addr))
+    {
+        std::cerr << "Invalid multicast group " << group << std::endl;
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Could not create multicast socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    unsigned char ttlValue = (unsigned char)ttl;
+    unsigned char loop = 1; // local viewers on the same box
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttlValue, sizeof(ttlValue));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+
+    if (!interfaceAddress.empty())
+    {
+        in_addr interface;
+        if (!parse_address(interfaceAddress, interface) ||
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) != 0)
+        {
+            std::cerr << "Could not send multicast on interface " << interfaceAddress << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    fragmentPayload = payload;
+    return true;
+}
+
+void MulticastSender::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool MulticastSender::send(uint32_t frameId, uint8_t payloadType, const uint8_t *data, std::size_t size)
+{
+    std::size_t count = size == 0 ? 1 : (size + fragmentPayload - 1) / fragmentPayload;
+    if (count > 0xFFFF || size > MULTICAST_MAX_FRAME_SIZE)
+    {
+        return false;
+    }
+
+    headers.resize(count * MULTICAST_HEADER_SIZE);
+    vectors.resize(count * 2);
+    messages.resize(count);
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        std::size_t offset = i * fragmentPayload;
+        std::size_t length = std::min(fragmentPayload, size - offset);
+
+        uint8_t *header = &headers[i * MULTICAST_HEADER_SIZE];
+        put_le(header + 0, MULTICAST_MAGIC, 4);
+        put_le(header + 4, frameId, 4);
+        put_le(header + 8, i, 2);
+        put_le(header + 10, count, 2);
+        put_le(header + 12, size, 4);
+        put_le(header + 16, offset, 4);
+        header[20] = payloadType;
+        header[21] = cameraId;
+        memset(header + 22, 0, 2);
+
+        vectors[i * 2].iov_base = header;
+        vectors[i * 2].iov_len = MULTICAST_HEADER_SIZE;
+        vectors[i * 2 + 1].iov_base = (void *)(data + offset);
+        vectors[i * 2 + 1].iov_len = length;
+
+        memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_name = &destination;
+        messages[i].msg_hdr.msg_namelen = sizeof(destination);
+        messages[i].msg_hdr.msg_iov = &vectors[i * 2];
+        messages[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    std::size_t sent = 0;
+    while (sent < count)
+    {
+        int result = sendmmsg(fd, &messages[sent], count - sent, 0);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        sent += result;
+    }
+
+    return true;
+}
+
+MulticastReceiver::~MulticastReceiver()
+{
+    close();
+}
+
+bool MulticastReceiver::open(const std::string &group, int port, const std::string &interfaceAddress)
+{
+    ip_mreq membership;
+    if (!parse_address(group, membership.imr_multiaddr))
+    {
+        std::cerr << "Invalid multicast group " << group << std::endl;
+        return false;
+    }
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (!interfaceAddress.empty() && !parse_address(interfaceAddress, membership.imr_interface))
+    {
+        std::cerr << "Invalid interface address " << interfaceAddress << std::endl;
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Could not create multicast socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Several viewers may run on one box
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(fd, (sockaddr *)&local, sizeof(local)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)
+    {
+        std::cerr << "Could not join " << group << ":" << port << ": " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    datagram.resize(65536);
+    return true;
+}
+
+void MulticastReceiver::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool MulticastReceiver::receive(std::vector<uint8_t> &frame, uint32_t &frameId, uint8_t &payloadType)
+{
+    while (true)
+    {
+        ssize_t received = recv(fd, datagram.data(), datagram.size(), 0);
+        if (received < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if ((std::size_t)received < MULTICAST_HEADER_SIZE || get_le(datagram.data(), 4) != MULTICAST_MAGIC)
+        {
+            continue;
+        }
+
+        if (simulatedLoss > 0)
+        {
+            // xorshift32 is plenty for deciding which datagram to throw away
+            lossState ^= lossState << 13;
+            lossState ^= lossState >> 17;
+            lossState ^= lossState << 5;
+            if (lossState < simulatedLoss * 4294967296.0)
+            {
+                fragmentsLost++;
+                continue;
+            }
+        }
+        fragmentsReceived++;
+
+        const uint8_t *header = datagram.data();
+        uint32_t id = (uint32_t)get_le(header + 4, 4);
+        uint16_t index = (uint16_t)get_le(header + 8, 2);
+        uint16_t count = (uint16_t)get_le(header + 10, 2);
+        uint32_t size = (uint32_t)get_le(header + 12, 4);
+        uint32_t offset = (uint32_t)get_le(header + 16, 4);
+        std::size_t length = received - MULTICAST_HEADER_SIZE;
+        // The first fragment of a frame sizes the buffer, so its size has to be one the fragments could fill
+        if (index >= count || (uint64_t)offset + length > size || size > MULTICAST_MAX_FRAME_SIZE ||
+            size > (uint64_t)count * (MAX_UDP_PAYLOAD - MULTICAST_HEADER_SIZE))
+        {
+            continue;
+        }
+
+        // Late fragments of frames already finished or given up on. Ids far in the past mean the
+        //  sender restarted, start over from there.
+        int32_t age = haveCompleted ? (int32_t)(lastCompleted - id) : -1;
+        if (age >= 0 && age < STALE_FRAME_WINDOW)
+        {
+            continue;
+        }
+        if (age >= STALE_FRAME_WINDOW)
+        {
+            haveCompleted = false;
+            assembling = false;
+        }
+        if (assembling && (int32_t)(id - currentFrame) < 0 && (int32_t)(currentFrame - id) < STALE_FRAME_WINDOW)
+        {
+            continue;
+        }
+
+        if (!assembling || id != currentFrame)
+        {
+            if (assembling)
+            {
+                framesDropped++;
+            }
+            assembling = true;
+            currentFrame = id;
+            fragmentCount = count;
+            fragmentsSeen = 0;
+            bytesSeen = 0;
+            seen.assign(count, false);
+            fragmentStarts.assign(count, 0);
+            fragmentEnds.assign(count, 0);
+            assembly.resize(size);
+            assemblingPayload = header[20];
+            assemblingCamera = header[21];
+        }
+
+        // Fragments have to agree with the first one of their frame, or they could write past the buffer
+        if (count != fragmentCount || size != assembly.size() || header[20] != assemblingPayload || header[21] != assemblingCamera ||
+            (uint64_t)offset + length > assembly.size() || seen[index])
+        {
+            continue;
+        }
+        seen[index] = true;
+        fragmentStarts[index] = offset;
+        fragmentEnds[index] = offset + (uint32_t)length;
+        fragmentsSeen++;
+        bytesSeen += length;
+        memcpy(assembly.data() + offset, header + MULTICAST_HEADER_SIZE, length);
+
+        if (fragmentsSeen < fragmentCount)
+        {
+            continue;
+        }
+
+        // Every fragment there, but unless they add up to the size and follow on from each other the gaps
+        //  still hold the previous frame's bytes
+        bool whole = bytesSeen == assembly.size();
+        for (uint16_t i = 0; whole && i < fragmentCount; i++)
+        {
+            whole = fragmentStarts[i] == (i == 0 ? 0 : fragmentEnds[i - 1]);
+        }
+        if (!whole)
+        {
+            framesDropped++;
+            assembling = false;
+            continue;
+        }
+
+        frame.swap(assembly);
+        frameId = currentFrame;
+        payloadType = assemblingPayload;
+        cameraId = assemblingCamera;
+        assembling = false;
+        haveCompleted = true;
+        lastCompleted = currentFrame;
+        framesCompleted++;
+        return true;
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// UDP multicast output. Each encoded frame is split into datagrams that fit the MTU, each one carrying
+//  this little endian header in front of its slice of the payload:
+//
+//    0  u32  magic "TSMC"
+//    4  u32  frame id (capture sequence number)
+//    8  u16  fragment index
+//   10  u16  fragment count
+//   12  u32  frame size
+//   16  u32  offset of this fragment in the frame
+//   20  u8   payload type (PayloadType from protocol.h)
+//   21  u8   camera id, 0 unless the streamer drives several cameras
+//   22  u16  reserved, 0
+//
+// Nothing is retransmitted. Receivers drop a frame as soon as they see a fragment of a newer one, so a
+//  lost datagram costs one frame and latency stays flat no matter how many viewers join.
+
+const uint32_t MULTICAST_MAGIC = 0x434D5354; // "TSMC" on the wire
+const std::size_t MULTICAST_HEADER_SIZE = 24;
+const int MULTICAST_DEFAULT_MTU = 1500;
+// Largest frame sent or reassembled, far above a 4x colored JPEG or a raw frame
+const std::size_t MULTICAST_MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+class MulticastSender
+{
+public:
+    ~MulticastSender();
+
+    // interfaceAddress may be empty to let the routing table pick
+    bool open(const std::string &group, int port, int ttl, int mtu, const std::string &interfaceAddress);
+    void close();
+
+    // All fragments of a frame go out with a single sendmmsg call
+    bool send(uint32_t frameId, uint8_t payloadType, const uint8_t *data, std::size_t size);
+
+    // Written into every fragment. Cameras sharing a group still need a port each, frame ids of
+    //  different cameras would otherwise cut into each other's reassembly.
+    uint8_t cameraId = 0;
+
+private:
+    int fd = -1;
+    sockaddr_in destination;
+    std::size_t fragmentPayload = 0;
+    std::vector<uint8_t> headers;
+    std::vector<iovec> vectors;
+    std::vector<mmsghdr> messages;
+};
+
+class MulticastReceiver
+{
+public:
+    ~MulticastReceiver();
+
+    bool open(const std::string &group, int port, const std::string &interfaceAddress);
+    void close();
+
+    // Blocks until a complete frame has been reassembled, every byte of it. Returns false on socket errors.
+    bool receive(std::vector<uint8_t> &frame, uint32_t &frameId, uint8_t &payloadType);
+
+    // Of the last frame receive() returned
+    uint8_t cameraId = 0;
+
+    // Fraction of datagrams to throw away on arrival, to see how viewers cope with a lossy network
+    double simulatedLoss = 0;
+
+    uint64_t framesCompleted = 0;
+    uint64_t framesDropped = 0;
+    uint64_t fragmentsReceived = 0;
+    uint64_t fragmentsLost = 0; // simulated
+
+private:
+    int fd = -1;
+    uint32_t lossState = 0x9E3779B9;
+    bool assembling = false;
+    bool haveCompleted = false;
+    uint32_t lastCompleted = 0;
+    uint32_t currentFrame = 0;
+    uint16_t fragmentCount = 0;
+    uint16_t fragmentsSeen = 0;
+    std::size_t bytesSeen = 0;
+    uint8_t assemblingPayload = 0;
+    uint8_t assemblingCamera = 0;
+    std::vector<bool> seen;
+    std::vector<uint32_t> fragmentStarts, fragmentEnds; // byte ranges of the fragments seen, by index
+    std::vector<uint8_t> assembly;
+    std::vector<uint8_t> datagram;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "nuc.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace cv;
+
+// Counts the mean of a warm flat field has to be above the cool one's for gains, about 1 Celcius
+static const double MIN_FLAT_SPAN = 100;
+
+// Gains have to fit Q15 in 16 bits
+static const float MIN_GAIN = 0.5f;
+static const float MAX_GAIN = 1.99f;
+
+void FlatField::add(const Mat &raw)
+{
+    if (frames == 0)
+    {
+        sum = Mat::zeros(raw.size(), CV_64FC1);
+    }
+    if (raw.size() != sum.size())
+    {
+        return;
+    }
+
+    for (int y = 0; y < raw.rows; y++)
+    {
+        const uint16_t *in = raw.ptr<uint16_t>(y);
+        double *s = sum.ptr<double>(y);
+        for (int x = 0; x < raw.cols; x++)
+        {
+            s[x] += in[x];
+        }
+    }
+    frames++;
+}
+
+void FlatField::reset()
+{
+    frames = 0;
+}
+
+Mat FlatField::mean() const
+{
+    Mat out;
+    if (frames > 0)
+    {
+        sum.convertTo(out, CV_32FC1, 1.0 / frames);
+    }
+    return out;
+}
+
+bool NonUniformityCorrection::load(const std::string &path)
+{
+    FileStorage storage(path, FileStorage::READ);
+    if (!storage.isOpened())
+    {
+        std::cerr << "Could not open NUC tables " << path << std::endl;
+        return false;
+    }
+
+    Mat loadedGain, loadedOffset;
+    storage["gain"] >> loadedGain;
+    storage["offset"] >> loadedOffset;
+    if (loadedGain.empty() || loadedGain.size() != loadedOffset.size() || loadedGain.channels() != 1 || loadedOffset.channels() != 1)
+    {
+        std::cerr << path << ": expected gain and offset matrices of the same size" << std::endl;
+        return false;
+    }
+
+    loadedGain.convertTo(gain, CV_32FC1);
+    loadedOffset.convertTo(offset, CV_32FC1);
+    tabulate();
+    return true;
+}
+
+bool NonUniformityCorrection::save(const std::string &path) const
+{
+    FileStorage storage(path, FileStorage::WRITE);
+    if (!storage.isOpened())
+    {
+        std::cerr << "Could not write NUC tables " << path << std::endl;
+        return false;
+    }
+
+    storage << "gain" << gain;
+    storage << "offset" << offset;
+    return true;
+}
+
+bool NonUniformityCorrection::calibrate(const Mat &coolMean, const Mat &warmMean)
+{
+    double span = mean(warmMean)[0] - mean(coolMean)[0];
+    gain = Mat(coolMean.size(), CV_32FC1);
+    for (int y = 0; y < gain.rows; y++)
+    {
+        const float *cool = coolMean.ptr<float>(y);
+        const float *warm = warmMean.ptr<float>(y);
+        float *g = gain.ptr<float>(y);
+        for (int x = 0; x < gain.cols; x++)
+        {
+            float pixelSpan = warm[x] - cool[x];
+            g[x] = span >= MIN_FLAT_SPAN && pixelSpan > 0 ? std::min(std::max((float)span / pixelSpan, MIN_GAIN), MAX_GAIN) : 1.0f;
+        }
+    }
+
+    setOffsets(coolMean);
+    return span >= MIN_FLAT_SPAN;
+}
+
+void NonUniformityCorrection::setOffsets(const Mat &flatMean)
+{
+    if (gain.size() != flatMean.size())
+    {
+        gain = Mat(flatMean.size(), CV_32FC1, Scalar(1));
+    }
+
+    // Every pixel lands on the flat field's mean after its gain
+    double level = 0;
+    for (int y = 0; y < flatMean.rows; y++)
+    {
+        const float *flat = flatMean.ptr<float>(y);
+        const float *g = gain.ptr<float>(y);
+        for (int x = 0; x < flatMean.cols; x++)
+        {
+            level += g[x] * flat[x];
+        }
+    }
+    level /= flatMean.total();
+
+    offset = Mat(flatMean.size(), CV_32FC1);
+    for (int y = 0; y < flatMean.rows; y++)
+    {
+        const float *flat = flatMean.ptr<float>(y);
+        const float *g = gain.ptr<float>(y);
+        float *o = offset.ptr<float>(y);
+        for (int x = 0; x < flatMean.cols; x++)
+        {
+            o[x] = (float)level - g[x] * flat[x];
+        }
+    }
+
+    tabulate();
+}
+
+void NonUniformityCorrection::tabulate()
+{
+    gainQ15.create(gain.size(), CV_16UC1);
+    offsetCounts.create(offset.size(), CV_16SC1);
+    for (int y = 0; y < gain.rows; y++)
+    {
+        const float *g = gain.ptr<float>(y);
+        const float *o = offset.ptr<float>(y);
+        uint16_t *gq = gainQ15.ptr<uint16_t>(y);
+        int16_t *oq = offsetCounts.ptr<int16_t>(y);
+        for (int x = 0; x < gain.cols; x++)
+        {
+            gq[x] = (uint16_t)std::lround(std::min(std::max(g[x], 0.0f), MAX_GAIN) * 32768);
+            oq[x] = (int16_t)std::min(std::max(std::lround(o[x]), -32768L), 32767L);
+        }
+    }
+}
+
+void NonUniformityCorrection::recapture(int frames)
+{
+    recaptureFrames = std::max(frames, 1);
+    recaptured.reset();
+}
+
+bool NonUniformityCorrection::apply(Mat &raw)
+{
+    bool recaptureDone = false;
+    if (recaptureFrames > 0)
+    {
+        recaptured.add(raw);
+        if (recaptured.frames >= recaptureFrames)
+        {
+            setOffsets(recaptured.mean());
+            recaptureFrames = 0;
+            recaptureDone = true;
+        }
+    }
+
+    if (gainQ15.empty() || raw.size() != gainQ15.size())
+    {
+        return recaptureDone;
+    }
+
+    // A 16 bit count times a Q15 gain under 2 fits 32 bits unsigned, rounding included. No branches, so
+    //  the loop turns into widening multiplies, adds and a saturating pack.
+    for (int y = 0; y < raw.rows; y++)
+    {
+        uint16_t *p = raw.ptr<uint16_t>(y);
+        const uint16_t *g = gainQ15.ptr<uint16_t>(y);
+        const int16_t *o = offsetCounts.ptr<int16_t>(y);
+        for (int x = 0; x < raw.cols; x++)
+        {
+            uint32_t scaled = (uint32_t)p[x] * g[x] + (1u << 14);
+            int32_t value = (int32_t)(scaled >> 15) + o[x];
+            p[x] = (uint16_t)std::min(std::max(value, 0), 65535);
+        }
+    }
+    return recaptureDone;
+}
@@ -0,0 +1,67 @@
+#ifndef NUC_H
+#define NUC_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+
+// Average of frames of a flat field, an evenly warm scene
+class FlatField
+{
+public:
+    void add(const cv::Mat &raw);
+    void reset();
+    // CV_32FC1, empty before the first frame
+    cv::Mat mean() const;
+
+    int frames = 0;
+
+private:
+    cv::Mat sum; // CV_64FC1
+};
+
+// Per pixel non-uniformity correction, corrected = gain * raw + offset. Evens out the vignetting and the
+//  pixel to pixel spread of the sensor, so the colors aren't spent on the difference between the centre
+//  and the corners of a wall. The overall level stays where it was, temperatures still read the same.
+//
+// The tables come from two flat fields, one cool and one warm: the gains make every pixel step by the
+//  same amount between them, the offsets then make the cool one flat. Offsets drift with the sensor's
+//  temperature while gains hardly do, so the offsets can be recaptured from a single flat field later on.
+//  They are kept in a FileStorage file as two CV_32FC1 matrices, "gain" and "offset".
+//
+// Frames are corrected with fixed point tables, gains in Q15 (0 to 2) and offsets in whole counts, in one
+//  multiply-add pass over the frame that the compiler vectorizes.
+class NonUniformityCorrection
+{
+public:
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    // Gains and offsets from the means of a cool and a warm flat field. When they are too close together
+    //  for gains, false with the gains left at 1 and only the offsets from the cool one.
+    bool calibrate(const cv::Mat &coolMean, const cv::Mat &warmMean);
+    // New offsets for the current gains from the mean of a flat field, gains of 1 without any yet
+    void setOffsets(const cv::Mat &flatMean);
+
+    // Averages the next frames apply() gets into new offsets, the lens cap has to be on meanwhile.
+    //  Frames are still corrected with the old tables until then.
+    void recapture(int frames);
+    bool recapturing() const { return recaptureFrames > 0; }
+
+    // Corrects raw in place, feeding a running recapture first. Frames of another size than the tables'
+    //  are left alone. True when a recapture finished with this frame.
+    bool apply(cv::Mat &raw);
+
+    bool empty() const { return gain.empty(); }
+
+    cv::Mat gain, offset; // CV_32FC1
+
+private:
+    void tabulate();
+
+    cv::Mat gainQ15;      // CV_16UC1
+    cv::Mat offsetCounts; // CV_16SC1
+    int recaptureFrames = 0;
+    FlatField recaptured;
+};
+
+#endif
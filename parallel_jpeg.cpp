@@ -0,0 +1,146 @@
+#include "parallel_jpeg.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Bands are whole MCU rows for 4:2:0, and for 4:4:4 and grey too since 16 rows are two of their MCU rows
+static const int MCU_SIZE = 16;
+// Below this many MCU rows per band the extra headers cost more than the parallelism saves
+static const int MIN_BAND_MCU_ROWS = 4;
+
+static const uint8_t MARKER_SOF0 = 0xC0;
+static const uint8_t MARKER_SOS = 0xDA;
+static const uint8_t MARKER_RST0 = 0xD0;
+
+// Where one band's JPEG is split up
+struct JpegLayout
+{
+    std::size_t sofOffset = 0; // of the SOF0 marker
+    std::size_t dataOffset = 0; // entropy coded data, right after the SOS segment
+    std::size_t dataEnd = 0;    // the EOI marker
+    int maxH = 0, maxV = 0;     // largest sampling factors, an MCU is 8 * maxH by 8 * maxV pixels
+};
+
+// Walks the marker segments up to the start of the scan. Only single scan baseline files, which is
+//  what imencode writes unless told otherwise.
+static bool parse_jpeg(const std::vector<uchar> &jpeg, JpegLayout &layout)
+{
+    std::size_t size = jpeg.size();
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 || jpeg[size - 2] != 0xFF || jpeg[size - 1] != 0xD9)
+    {
+        return false;
+    }
+
+    std::size_t p = 2;
+    while (p + 4 <= size && jpeg[p] == 0xFF)
+    {
+        uint8_t marker = jpeg[p + 1];
+        std::size_t length = (jpeg[p + 2] << 8) | jpeg[p + 3];
+        if (p + 2 + length > size)
+        {
+            return false;
+        }
+
+        if (marker == MARKER_SOF0)
+        {
+            layout.sofOffset = p;
+            int components = jpeg[p + 9];
+            for (int c = 0; c < components; c++)
+            {
+                uint8_t sampling = jpeg[p + 11 + c * 3];
+                layout.maxH = std::max(layout.maxH, sampling >> 4);
+                layout.maxV = std::max(layout.maxV, sampling & 15);
+            }
+        }
+        else if (marker == MARKER_SOS)
+        {
+            layout.dataOffset = p + 2 + length;
+            layout.dataEnd = size - 2;
+            return layout.sofOffset != 0 && layout.maxH > 0;
+        }
+        p += 2 + length;
+    }
+
+    return false;
+}
+
+// Appends entropy coded data, renumbering its restart markers from rst on. Inside the data 0xFF is only
+//  ever followed by a stuffed 0x00 or a marker.
+static void append_renumbered(std::vector<uchar> &out, const uchar *data, std::size_t size, int &rst)
+{
+    std::size_t start = out.size();
+    out.insert(out.end(), data, data + size);
+
+    uchar *p = out.data() + start;
+    uchar *end = p + size;
+    while ((p = (uchar *)memchr(p, 0xFF, end - p)) != nullptr && p + 1 < end)
+    {
+        if ((p[1] & 0xF8) == MARKER_RST0)
+        {
+            p[1] = MARKER_RST0 + rst;
+            rst = (rst + 1) & 7;
+        }
+        p += 2;
+    }
+}
+
+bool ParallelJpegEncoder::encode(const cv::Mat &image, std::vector<uchar> &out, WorkerPool *pool)
+{
+    int mcuRows = (image.rows + MCU_SIZE - 1) / MCU_SIZE;
+    int bandCount = pool ? std::min(pool->size() + 1, mcuRows / MIN_BAND_MCU_ROWS) : 1;
+    if (bandCount <= 1)
+    {
+        return cv::imencode(".jpeg", image, out, {cv::IMWRITE_JPEG_QUALITY, quality});
+    }
+
+    // A restart interval of one MCU row, so every band boundary falls on a restart. Grey frames aren't
+    //  subsampled, their MCUs are 8 by 8.
+    int mcuWidth = image.channels() == 1 ? 8 : MCU_SIZE;
+    int mcusPerRow = (image.cols + mcuWidth - 1) / mcuWidth;
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality, cv::IMWRITE_JPEG_RST_INTERVAL, mcusPerRow};
+
+    bands.resize(bandCount);
+    std::vector<char> encoded(bandCount, 0);
+    pool->parallel_for(bandCount, 1, [&](int begin, int end) {
+        for (int band = begin; band < end; band++)
+        {
+            int top = mcuRows * band / bandCount * MCU_SIZE;
+            int bottom = band == bandCount - 1 ? image.rows : mcuRows * (band + 1) / bandCount * MCU_SIZE;
+            encoded[band] = cv::imencode(".jpeg", image.rowRange(top, bottom), bands[band], params);
+        }
+    });
+
+    std::vector<JpegLayout> layouts(bandCount);
+    for (int band = 0; band < bandCount; band++)
+    {
+        if (!encoded[band] || !parse_jpeg(bands[band], layouts[band]) ||
+            (image.cols + 8 * layouts[band].maxH - 1) / (8 * layouts[band].maxH) != mcusPerRow ||
+            MCU_SIZE % (8 * layouts[band].maxV) != 0)
+        {
+            return cv::imencode(".jpeg", image, out, {cv::IMWRITE_JPEG_QUALITY, quality});
+        }
+    }
+
+    // Headers of the first band, with the height of the whole frame
+    const std::vector<uchar> &first = bands[0];
+    out.assign(first.begin(), first.begin() + layouts[0].dataOffset);
+    out[layouts[0].sofOffset + 5] = image.rows >> 8;
+    out[layouts[0].sofOffset + 6] = image.rows & 0xFF;
+
+    int rst = 0;
+    for (int band = 0; band < bandCount; band++)
+    {
+        if (band > 0)
+        {
+            out.push_back(0xFF);
+            out.push_back(MARKER_RST0 + rst);
+            rst = (rst + 1) & 7;
+        }
+        const JpegLayout &layout = layouts[band];
+        append_renumbered(out, bands[band].data() + layout.dataOffset, layout.dataEnd - layout.dataOffset, rst);
+    }
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+    return true;
+}
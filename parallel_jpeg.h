@@ -0,0 +1,31 @@
+#ifndef PARALLEL_JPEG_H
+#define PARALLEL_JPEG_H
+
+#include <opencv2/core/core.hpp>
+#include <cstddef>
+#include <vector>
+#include "worker_pool.h"
+
+// Baseline JPEG encoding of a frame split over a WorkerPool.
+//
+// The frame is cut into horizontal bands of whole MCU rows (16 pixel rows with OpenCV's default 4:2:0
+//  subsampling, 8 for grey frames) and each band goes through cv::imencode on a worker, with a restart marker after every
+//  MCU row. The bands are stitched into one JPEG: the first band's headers with the full height patched
+//  into SOF0, then every band's entropy coded data, a restart marker between bands and all restart
+//  markers renumbered to carry on from the band before. Restarts reset the DC prediction and every band
+//  is coded with the same standard tables, so the result is byte for byte what a single imencode of the
+//  whole frame with the same restart interval gives; one restart marker per MCU row adds well under 1%.
+class ParallelJpegEncoder
+{
+public:
+    int quality = 95; // cv::imencode's default
+
+    // Without a pool, for frames too small to split, or when a band doesn't come out laid out as
+    //  expected, the frame is encoded in one go
+    bool encode(const cv::Mat &image, std::vector<uchar> &out, WorkerPool *pool);
+
+private:
+    std::vector<std::vector<uchar>> bands;
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "process_frame.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include "rotate_scale.h"
+#include "thermal.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+using namespace cv;
+
+const char *fireWarningText = "WARNING";
+double fireThresholdCelcius = 45;
+int upscaleInterpolation = INTER_LINEAR;
+
+// Rows per band below which splitting a stage costs more than it saves
+static const int ROW_GRAIN = 16;
+
+// Runs body over bands of [0, rows) on the pool, or over all rows at once without one
+static void for_rows(WorkerPool *pool, int rows, const std::function<void(int, int)> &body)
+{
+    if (pool)
+    {
+        pool->parallel_for(rows, ROW_GRAIN, body);
+    }
+    else
+    {
+        body(0, rows);
+    }
+}
+
+void overlay_values(Mat &outframe, Point coord, const Scalar &color)
+{
+    int gap = 2;
+    int arrLen = 7;
+    int weight = 1;
+    line(outframe, coord - Point(-arrLen, -arrLen), coord - Point(-gap, -gap), color, weight);
+    line(outframe, coord - Point(arrLen, arrLen), coord - Point(gap, gap), color, weight);
+    line(outframe, coord - Point(-arrLen, arrLen), coord - Point(-gap, gap), color, weight);
+    line(outframe, coord - Point(arrLen, -arrLen), coord - Point(gap, -gap), color, weight);
+}
+
+void draw_temp(Mat &outframe, double temp, const Point &coord, Scalar color)
+{
+    char txt[64];
+    sprintf(txt, "%5.1f", temp);
+    putText(outframe, txt, coord - Point(40, -20), FONT_HERSHEY_COMPLEX, 1, std::move(color), 2, CustomLineTypes::LINE_AA);
+}
+
+void draw_text(Mat &outframe, const char *text, const Point &coord, Scalar color)
+{
+    putText(outframe, text, coord - Point(40, -20), FONT_HERSHEY_COMPLEX, 1, std::move(color), 2, CustomLineTypes::LINE_AA);
+}
+
+// Copy the grey frame next to a 20px wide vertical gradient bar, which becomes the color scale
+void add_gradient(const Mat &frame_g8_nograd, Mat &frame_g8)
+{
+    frame_g8.create(Size(frame_g8_nograd.cols + 20, frame_g8_nograd.rows), CV_8U);
+    add_gradient_rows(frame_g8_nograd, frame_g8, 0, frame_g8.rows);
+}
+
+// Fills the gradient bar right of the first imageCols columns in rows [begin, end). The bottom row has no
+//  gradient, it stays mid grey.
+static void fill_gradient_rows(Mat &frame_g8, int imageCols, int begin, int end)
+{
+    Mat bar = frame_g8.colRange(imageCols, frame_g8.cols);
+    for (int r = begin; r < end; r++)
+    {
+        bar.row(r).setTo(r < frame_g8.rows - 1 ? 255.0 * (frame_g8.rows - r) / ((float)frame_g8.rows) : 128.0);
+    }
+}
+
+void add_gradient_rows(const Mat &frame_g8_nograd, Mat &frame_g8, int begin, int end)
+{
+    fill_gradient_rows(frame_g8, frame_g8_nograd.cols, begin, end);
+    frame_g8_nograd.rowRange(begin, end).copyTo(frame_g8(Rect(0, begin, frame_g8_nograd.cols, end - begin)));
+}
+
+// Temperature readouts and min/max/center markers on top of the colorized frame
+void draw_overlays(Mat &outframe, double mintemp, double maxtemp, double centraltemp, const Point &minp, const Point &maxp, const Point &centralp)
+{
+    draw_temp(outframe, mintemp, Point(outframe.cols - 49, outframe.rows - 29), Scalar(255, 255, 255));
+    draw_temp(outframe, mintemp, Point(outframe.cols - 51, outframe.rows - 31), Scalar(0, 0, 0));
+    draw_temp(outframe, mintemp, Point(outframe.cols - 50, outframe.rows - 30), Scalar(255, 0, 0));
+
+    draw_temp(outframe, maxtemp, Point(outframe.cols - 49, 0), Scalar(255, 255, 255));
+    draw_temp(outframe, maxtemp, Point(outframe.cols - 51, 2), Scalar(0, 0, 0));
+    draw_temp(outframe, maxtemp, Point(outframe.cols - 50, 1), Scalar(0, 0, 255));
+
+    draw_temp(outframe, centraltemp, centralp + Point(-1, -1), Scalar(255, 255, 255));
+    draw_temp(outframe, centraltemp, centralp + Point(1, 1), Scalar(0, 0, 0));
+    draw_temp(outframe, centraltemp, centralp + Point(0, 0), Scalar(128, 128, 128));
+
+    overlay_values(outframe, centralp + Point(-1, -1), Scalar(0, 0, 0));
+    overlay_values(outframe, centralp + Point(1, 1), Scalar(255, 255, 255));
+    overlay_values(outframe, centralp, Scalar(128, 128, 128));
+
+    overlay_values(outframe, minp + Point(-1, -1), Scalar(0, 0, 0));
+    overlay_values(outframe, minp + Point(1, 1), Scalar(255, 255, 255));
+    overlay_values(outframe, minp, Scalar(255, 0, 0));
+
+    overlay_values(outframe, maxp + Point(-1, -1), Scalar(0, 0, 0));
+    overlay_values(outframe, maxp + Point(1, 1), Scalar(255, 255, 255));
+    overlay_values(outframe, maxp, Scalar(0, 0, 255));
+
+    if (maxtemp > fireThresholdCelcius)
+    {
+        draw_text(outframe, fireWarningText, maxp + Point(-1, -1), Scalar(255, 255, 255));
+        draw_text(outframe, fireWarningText, maxp + Point(1, 1), Scalar(0, 0, 0));
+        draw_text(outframe, fireWarningText, maxp + Point(0, 0), Scalar(0, 0, 255));
+    }
+}
+
+void draw_hotspots(Mat &outframe, const FrameStats &stats)
+{
+    for (int i = 0; i < stats.hotspotCount; i++)
+    {
+        const Hotspot &hotspot = stats.hotspots[i];
+        circle(outframe, hotspot.marker, hotspot.radius + 1, Scalar(0, 0, 0), 3);
+        circle(outframe, hotspot.marker, hotspot.radius, Scalar(0, 0, 255), 1);
+
+        Point label = hotspot.marker + Point(0, hotspot.radius);
+        draw_temp(outframe, hotspot.peakCelcius, label + Point(1, 1), Scalar(0, 0, 0));
+        draw_temp(outframe, hotspot.peakCelcius, label, Scalar(0, 0, 255));
+    }
+}
+
+// Raw rows [begin, end) to grey through a range's table, values outside the range clamped to its ends
+static void grey_rows(const Mat &inframe, Mat &frame_g8, const ColormapCache::Table &table, int begin, int end)
+{
+    const uchar *grey = table.grey.ptr<uchar>();
+    for (int y = begin; y < end; y++)
+    {
+        const uint16_t *in = inframe.ptr<uint16_t>(y);
+        uchar *out = frame_g8.ptr<uchar>(y);
+        for (int x = 0; x < inframe.cols; x++)
+        {
+            out[x] = grey[std::min(std::max((int)in[x], table.low), table.high) - table.low];
+        }
+    }
+}
+
+// Grey rows [begin, end) to BGR through a colormap's table
+static void color_rows(const Mat &frame_g8, Mat &outframe, const Mat &colors, int begin, int end)
+{
+    const Vec3b *bgr = colors.ptr<Vec3b>();
+    for (int y = begin; y < end; y++)
+    {
+        const uchar *in = frame_g8.ptr<uchar>(y);
+        Vec3b *out = outframe.ptr<Vec3b>(y);
+        for (int x = 0; x < frame_g8.cols; x++)
+        {
+            out[x] = bgr[in[x]];
+        }
+    }
+}
+
+// Everything up to the colormap: the normalized, rotated and scaled frame next to its gradient bar
+void analyze_frame(const Mat &inframe, int device_temp_sensor, FrameAnalysis &analysis, WorkerPool *pool, ColormapCache *palette,
+                   HotspotDetector *hotspots)
+{
+    FrameStats &stats = analysis.stats;
+    Mat &frame_g8_nograd = analysis.grey;
+    Mat frame_g16; // Transient Mat container for processing
+
+    // get raw max/min/central values
+    double min = DBL_MAX, max = -DBL_MAX, central;
+    std::mutex minMaxMutex;
+    for_rows(pool, inframe.rows, [&](int begin, int end) {
+        double bandMin, bandMax;
+        minMaxIdx(inframe.rowRange(begin, end), &bandMin, &bandMax);
+        std::lock_guard<std::mutex> lock(minMaxMutex);
+        min = std::min(min, bandMin);
+        max = std::max(max, bandMax);
+    });
+    Scalar valat = inframe.at<uint16_t>(Point(inframe.cols / 2.0, inframe.rows / 2.0));
+    central = valat[0];
+
+    double device_k = device_sensor_to_k(device_temp_sensor);
+
+    double mintemp = temp_from_raw(min, device_k);
+    double maxtemp = temp_from_raw(max, device_k);
+    double centraltemp = temp_from_raw(central, device_k);
+
+    stats.mintemp = mintemp;
+    stats.maxtemp = maxtemp;
+    stats.centraltemp = centraltemp;
+    stats.alarm = maxtemp > fireThresholdCelcius;
+    stats.rangeLow = mintemp;
+    stats.rangeHigh = maxtemp;
+
+    // printf("rmin,rmax,central,devtempsns: %d %d %d %d\t", (int)min, (int)max, (int)central, (int)device_temp_sensor);
+    // printf("min-max-center-device: %.1f %.1f %.1f %.1f\n", mintemp, maxtemp, centraltemp, device_k - 273.0);
+
+    // Stretch to 0..65535 with the scale and shift normalize(NORM_MINMAX) uses, then convert seek CV_16UC1
+    //  to CV_8UC1, band by band. A palette has both steps in one table for its range.
+    frame_g8_nograd.create(inframe.size(), CV_8UC1);
+    if (palette)
+    {
+        const ColormapCache::Table &table = palette->range(min, max, device_k);
+        stats.rangeLow = temp_from_raw(table.low, device_k);
+        stats.rangeHigh = temp_from_raw(table.high, device_k);
+        for_rows(pool, inframe.rows, [&](int begin, int end) {
+            grey_rows(inframe, frame_g8_nograd, table, begin, end);
+        });
+    }
+    else
+    {
+        double normScale = 65535.0 * (max - min > DBL_EPSILON ? 1.0 / (max - min) : 0);
+        double normShift = -min * normScale;
+        frame_g16.create(inframe.size(), CV_16UC1);
+        for_rows(pool, inframe.rows, [&](int begin, int end) {
+            Mat g16 = frame_g16.rowRange(begin, end);
+            Mat g8 = frame_g8_nograd.rowRange(begin, end);
+            inframe.rowRange(begin, end).convertTo(g16, CV_16U, normScale, normShift);
+            g16.convertTo(g8, CV_8UC1, 1.0 / 256.0);
+        });
+    }
+
+    stats.hotspotCount = hotspots ? hotspots->detect(inframe, device_temp_sensor, stats.hotspots, MAX_HOTSPOTS) : 0;
+}
+
+void render_frame_grey(const FrameAnalysis &analysis, Mat &frame_g8, float scale, int rotate, FrameStats &stats, WorkerPool *pool)
+{
+    const Mat &frame_g8_nograd = analysis.grey;
+    stats = analysis.stats;
+
+    Point minp, maxp, centralp;
+    RotateScaleKernel kernel = scale == (int)scale && scale >= 1 ? rotate_scale_kernel(rotate, upscaleInterpolation) : nullptr;
+    if (kernel)
+    {
+        // Rotate and resize in one pass straight into the gradient's frame. Min and max are looked up where
+        //  minMaxLoc would find them on the rotated frame, so ties land on the same pixel.
+        double gmin, gmax;
+        minMaxIdx(frame_g8_nograd, &gmin, &gmax);
+        minp = find_rotated(frame_g8_nograd, rotate, (uchar)gmin);
+        maxp = find_rotated(frame_g8_nograd, rotate, (uchar)gmax);
+        Size rotated = rotate_scale_size(frame_g8_nograd.size(), rotate, 1);
+        centralp = Point(rotated.width / 2.0, rotated.height / 2.0);
+        minp *= scale;
+        maxp *= scale;
+        centralp *= scale;
+
+        Size scaled = rotate_scale_size(frame_g8_nograd.size(), rotate, (int)scale);
+        frame_g8.create(scaled.height, scaled.width + 20, CV_8U);
+        Mat image = frame_g8.colRange(0, scaled.width);
+        for_rows(pool, frame_g8.rows, [&](int begin, int end) {
+            kernel(frame_g8_nograd, image, (int)scale, begin, end);
+            fill_gradient_rows(frame_g8, scaled.width, begin, end);
+        });
+    }
+    else
+    {
+        // Rotate image, into a copy so the analysis can be rendered again
+        Mat rotated;
+        if (rotate == 90)
+        {
+            transpose(frame_g8_nograd, rotated);
+            flip(rotated, rotated, 1);
+        }
+        else if (rotate == 180)
+        {
+            flip(frame_g8_nograd, rotated, -1);
+        }
+        else if (rotate == 270)
+        {
+            transpose(frame_g8_nograd, rotated);
+            flip(rotated, rotated, 0);
+        }
+        else
+        {
+            rotated = frame_g8_nograd.clone();
+        }
+
+        minMaxLoc(rotated, NULL, NULL, &minp, &maxp); // doing it here, so we take rotation into account
+        centralp = Point(rotated.cols / 2.0, rotated.rows / 2.0);
+        minp *= scale;
+        maxp *= scale;
+        centralp *= scale;
+
+        // Resize image: http://docs.opencv.org/3.2.0/da/d54/group__imgproc__transform.html#ga5bb5a1fea74ea38e1a5445ca803ff121
+        // Note this is expensive computationally, only do if option set != 1
+        if (scale != 1.0)
+            resize(rotated, rotated, Size(), scale, scale, upscaleInterpolation);
+
+        // add gradient
+        frame_g8.create(rotated.rows, rotated.cols + 20, CV_8U);
+        for_rows(pool, frame_g8.rows, [&](int begin, int end) {
+            add_gradient_rows(rotated, frame_g8, begin, end);
+        });
+    }
+
+    stats.minp = minp;
+    stats.maxp = maxp;
+    stats.centralp = centralp;
+
+    for (int i = 0; i < stats.hotspotCount; i++)
+    {
+        Hotspot &hotspot = stats.hotspots[i];
+        Point centroid((int)std::lround(hotspot.centroid.x), (int)std::lround(hotspot.centroid.y));
+        hotspot.marker = rotate_point(centroid, frame_g8_nograd.size(), rotate) * scale;
+        hotspot.radius = std::max((int)(std::sqrt(hotspot.area / CV_PI) * scale), 4);
+    }
+}
+
+void process_frame_grey(Mat &inframe, Mat &frame_g8, float scale, int rotate, int device_temp_sensor, FrameStats &stats, WorkerPool *pool, ColormapCache *palette,
+                        HotspotDetector *hotspots)
+{
+    FrameAnalysis analysis;
+    analyze_frame(inframe, device_temp_sensor, analysis, pool, palette, hotspots);
+    render_frame_grey(analysis, frame_g8, scale, rotate, stats, pool);
+}
+
+// The colormap and the overlays
+void colorize_frame(const Mat &frame_g8, Mat &outframe, int colormap, const FrameStats &stats, WorkerPool *pool, ColormapCache *palette, bool overlays)
+{
+    // Apply colormap: http://docs.opencv.org/3.2.0/d3/d50/group__imgproc__colormap.html#ga9a805d8262bcbe273f16be9ea2055a65
+    outframe.create(frame_g8.size(), CV_8UC3);
+    const Mat *colors = palette ? &palette->colors(colormap) : nullptr;
+    for_rows(pool, frame_g8.rows, [&](int begin, int end) {
+        Mat out = outframe.rowRange(begin, end);
+        if (colors)
+        {
+            color_rows(frame_g8, outframe, *colors, begin, end);
+        }
+        else if (colormap != -1)
+        {
+            applyColorMap(frame_g8.rowRange(begin, end), out, colormap);
+        }
+        else
+        {
+            cv::cvtColor(frame_g8.rowRange(begin, end), out, cv::COLOR_GRAY2BGR);
+        }
+    });
+
+    if (overlays)
+    {
+        draw_overlays(outframe, stats.mintemp, stats.maxtemp, stats.centraltemp, stats.minp, stats.maxp, stats.centralp);
+        draw_hotspots(outframe, stats);
+    }
+}
+
+// Function to process a raw (corrected) seek frame
+void process_frame(Mat &inframe, Mat &outframe, float scale, int colormap, int rotate, int device_temp_sensor, FrameStats *stats, WorkerPool *pool, ColormapCache *palette,
+                   HotspotDetector *hotspots)
+{
+    FrameStats frameStats;
+    Mat frame_g8;
+    process_frame_grey(inframe, frame_g8, scale, rotate, device_temp_sensor, frameStats, pool, palette, hotspots);
+    colorize_frame(frame_g8, outframe, colormap, frameStats, pool, palette);
+    if (stats)
+    {
+        *stats = frameStats;
+    }
+}
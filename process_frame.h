@@ -0,0 +1,84 @@
+#ifndef PROCESS_FRAME_H
+#define PROCESS_FRAME_H
+
+#include <opencv2/core/core.hpp>
+#include "colormap_cache.h"
+#include "hotspots.h"
+#include "worker_pool.h"
+
+enum CustomLineTypes
+{
+    LINE_AA = 16
+};
+
+// Text drawn next to the hottest spot once it goes over the threshold
+extern const char *fireWarningText;
+extern double fireThresholdCelcius;
+// How frames are scaled up, cv::INTER_LINEAR (default) or cv::INTER_NEAREST
+extern int upscaleInterpolation;
+
+// Readings process_frame worked out on the way, for callers that act on them
+struct FrameStats
+{
+    double mintemp = 0;
+    double maxtemp = 0;
+    double centraltemp = 0;
+    bool alarm = false; // maxtemp over fireThresholdCelcius, the warning text is on the frame
+
+    // Celcius of grey levels 0 and 255, the range the frame is stretched over
+    double rangeLow = 0;
+    double rangeHigh = 0;
+    // Where the overlays go, in processed frame pixels
+    cv::Point minp, maxp, centralp;
+
+    // Blobs over the hotspot threshold, hottest first, when process_frame_grey was given a detector
+    Hotspot hotspots[MAX_HOTSPOTS];
+    int hotspotCount = 0;
+};
+
+void overlay_values(cv::Mat &outframe, cv::Point coord, const cv::Scalar &color);
+void draw_temp(cv::Mat &outframe, double temp, const cv::Point &coord, cv::Scalar color);
+void draw_text(cv::Mat &outframe, const char *text, const cv::Point &coord, cv::Scalar color);
+
+void add_gradient(const cv::Mat &frame_g8_nograd, cv::Mat &frame_g8);
+// Fills rows [begin, end) of frame_g8, which must already have the gradient's size
+void add_gradient_rows(const cv::Mat &frame_g8_nograd, cv::Mat &frame_g8, int begin, int end);
+void draw_overlays(cv::Mat &outframe, double mintemp, double maxtemp, double centraltemp, const cv::Point &minp, const cv::Point &maxp, const cv::Point &centralp);
+// A ring around every hotspot with its peak temperature
+void draw_hotspots(cv::Mat &outframe, const FrameStats &stats);
+
+// What process_frame_grey works out from the raw frame before rotating and scaling it: the readings, the
+//  frame stretched to grey over the palette's range, and the hotspots. It is the same for every rendering
+//  of the frame. Analysing once and rendering from it several times moves the palette's range on once
+//  and detects the hotspots once, however many ways the frame is rendered.
+struct FrameAnalysis
+{
+    cv::Mat grey;     // CV_8UC1, the raw frame's size and orientation
+    FrameStats stats; // without the overlay positions and hotspot markers, those depend on the rendering
+};
+
+void analyze_frame(const cv::Mat &inframe, int device_temp_sensor, FrameAnalysis &analysis, WorkerPool *pool = nullptr,
+                   ColormapCache *palette = nullptr, HotspotDetector *hotspots = nullptr);
+// Rotates and scales an analysed frame into frame_g8 with the gradient bar. stats gets the analysis'
+//  readings and hotspots, with the positions of this rendering.
+void render_frame_grey(const FrameAnalysis &analysis, cv::Mat &frame_g8, float scale, int rotate, FrameStats &stats,
+                       WorkerPool *pool = nullptr);
+
+// The two halves of process_frame. process_frame_grey stops before the colormap: frame_g8 is the
+//  CV_8UC1 frame with the gradient bar, and stats has everything colorize_frame needs to finish it,
+//  which lets receivers of the grey frame colorize it themselves (see grey_frame.h). With a detector the
+//  hotspots of the raw frame go into stats too.
+void process_frame_grey(cv::Mat &inframe, cv::Mat &frame_g8, float scale, int rotate, int device_temp_sensor, FrameStats &stats,
+                        WorkerPool *pool = nullptr, ColormapCache *palette = nullptr, HotspotDetector *hotspots = nullptr);
+void colorize_frame(const cv::Mat &frame_g8, cv::Mat &outframe, int colormap, const FrameStats &stats,
+                    WorkerPool *pool = nullptr, ColormapCache *palette = nullptr, bool overlays = true);
+
+// Function to process a raw (corrected) seek frame. With a pool the per-pixel stages run as row bands on
+//  its workers, the output is the same either way. Whole number scales go through a rotate_scale kernel,
+//  others through transpose/flip and cv::resize. With a palette the frame is stretched over its smoothed
+//  range and colorized through its cached tables, without one over exactly this frame's min and max.
+void process_frame(cv::Mat &inframe, cv::Mat &outframe, float scale, int colormap, int rotate, int device_temp_sensor,
+                   FrameStats *stats = nullptr, WorkerPool *pool = nullptr, ColormapCache *palette = nullptr,
+                   HotspotDetector *hotspots = nullptr);
+
+#endif
@@ -0,0 +1,233 @@
+#include "protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <opencv2/core/version.hpp>
+
+// Highest cv::ColormapTypes id, they were added over releases
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+static const int HIGHEST_COLORMAP = 21; // COLORMAP_DEEPGREEN
+#elif CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 2
+static const int HIGHEST_COLORMAP = 20; // COLORMAP_TURBO
+#elif CV_VERSION_MAJOR == 4
+static const int HIGHEST_COLORMAP = 19; // COLORMAP_TWILIGHT_SHIFTED
+#else
+static const int HIGHEST_COLORMAP = 12; // COLORMAP_PARULA
+#endif
+
+bool colormap_supported(int colormap)
+{
+    return colormap >= -1 && colormap <= HIGHEST_COLORMAP;
+}
+
+int command_argument_length(char commandByte, bool extended)
+{
+    if (!extended)
+    {
+        return 0;
+    }
+    switch (commandByte)
+    {
+    case COMMAND_FRAMES:
+        return 5;
+    case COMMAND_SUBSCRIBE:
+    case COMMAND_RECAPTURE_OFFSETS:
+        return 3;
+    case COMMAND_HEADER_VERSION:
+    case COMMAND_PAYLOAD_TYPE:
+        return 1;
+    case COMMAND_RENDER:
+        return 5;
+    case COMMAND_QUERY:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+// Value of length ASCII digits, anything else is skipped
+static int parse_digits(const char *argument, int length)
+{
+    int value = 0;
+    for (int i = 0; i < length; i++)
+    {
+        if (argument[i] >= '0' && argument[i] <= '9')
+        {
+            value = value * 10 + (argument[i] - '0');
+        }
+    }
+    return value;
+}
+
+Command parse_command(char commandByte, const char *argument, bool extended)
+{
+    Command command;
+    if (!extended)
+    {
+        return command;
+    }
+    int length = command_argument_length(commandByte, extended);
+    int value = length <= 9 ? parse_digits(argument, length) : 0;
+
+    switch (commandByte)
+    {
+    case COMMAND_FRAMES:
+        command.type = CommandType::Frames;
+        command.count = value > 0 ? value : 1;
+        break;
+    case COMMAND_SUBSCRIBE:
+        command.type = CommandType::Subscribe;
+        command.count = -1;
+        command.fps = value;
+        break;
+    case COMMAND_CANCEL:
+        command.type = CommandType::Cancel;
+        command.count = 0;
+        break;
+    case COMMAND_HEADER_VERSION:
+        command.type = CommandType::SetHeaderVersion;
+        command.count = 0;
+        command.headerVersion = value <= FRAME_HEADER_VERSION ? value : FRAME_HEADER_VERSION;
+        break;
+    case COMMAND_PAYLOAD_TYPE:
+        command.type = CommandType::SetPayloadType;
+        command.count = 0;
+        command.payloadType = value == PAYLOAD_RAW16_DELTA || value == PAYLOAD_GREY_JPEG ? value : PAYLOAD_JPEG;
+        break;
+    case COMMAND_RENDER:
+    {
+        command.type = CommandType::SetRender;
+        command.count = 0;
+        int colormap = value / 10 % 100;
+        command.render.scale = std::max(value / 10000 % 10, 1);
+        command.render.rotate = value / 1000 % 10 <= 3 ? value / 1000 % 10 * 90 : 0;
+        command.render.colormap = colormap == 99 ? -1 : colormap_supported(colormap) ? colormap : RenderParams().colormap;
+        command.render.overlays = value % 10 != 0;
+        break;
+    }
+    case COMMAND_QUERY:
+        command.type = CommandType::Query;
+        command.count = 0;
+        command.x = parse_digits(argument, 4);
+        command.y = parse_digits(argument + 4, 4);
+        command.width = parse_digits(argument + 8, 4);
+        command.height = parse_digits(argument + 12, 4);
+        break;
+    case COMMAND_RECAPTURE_OFFSETS:
+        command.type = CommandType::RecaptureOffsets;
+        command.count = 0;
+        command.offsetFrames = value;
+        break;
+    default:
+        command.type = CommandType::SingleFrame;
+        break;
+    }
+
+    return command;
+}
+
+// Table driven CRC-32 (IEEE 802.3, same as zlib)
+struct Crc32Table
+{
+    uint32_t entries[256];
+
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+uint32_t crc32(const void *data, std::size_t size, uint32_t crc)
+{
+    static const Crc32Table table;
+
+    const uint8_t *bytes = (const uint8_t *)data;
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint64_t timestamp_us()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+void put_le(uint8_t *out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint64_t get_le(const uint8_t *in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+void write_frame_header(const FrameHeader &header, uint8_t *out)
+{
+    put_le(out + 0, FRAME_HEADER_MAGIC, 4);
+    out[4] = header.version;
+    out[5] = header.payloadType;
+    put_le(out + 6, FRAME_HEADER_SIZE, 2);
+    put_le(out + 8, header.sequence, 4);
+    put_le(out + 12, header.width, 2);
+    put_le(out + 14, header.height, 2);
+    put_le(out + 16, header.captureTimeUs, 8);
+    put_le(out + 24, header.sendTimeUs, 8);
+    put_le(out + 32, header.payloadSize, 4);
+    put_le(out + 36, header.payloadCrc, 4);
+    if (header.version < 2)
+    {
+        put_le(out + 40, crc32(out, 40), 4);
+        put_le(out + 44, 0, 4);
+        return;
+    }
+    put_le(out + 40, header.cameraId, 2);
+    put_le(out + 42, 0, 2);
+    put_le(out + 44, crc32(out, 44), 4);
+}
+
+bool read_frame_header(const uint8_t *in, FrameHeader &header)
+{
+    if (get_le(in, 4) != FRAME_HEADER_MAGIC)
+    {
+        return false;
+    }
+    // The camera id is covered by the CRC from version 2 on
+    bool hasCamera = in[4] >= 2;
+    std::size_t covered = hasCamera ? 44 : 40;
+    if (get_le(in + covered, 4) != crc32(in, covered))
+    {
+        return false;
+    }
+
+    header.version = in[4];
+    header.payloadType = in[5];
+    header.sequence = (uint32_t)get_le(in + 8, 4);
+    header.width = (uint16_t)get_le(in + 12, 2);
+    header.height = (uint16_t)get_le(in + 14, 2);
+    header.captureTimeUs = get_le(in + 16, 8);
+    header.sendTimeUs = get_le(in + 24, 8);
+    header.payloadSize = (uint32_t)get_le(in + 32, 4);
+    header.payloadCrc = (uint32_t)get_le(in + 36, 4);
+    header.cameraId = hasCamera ? (uint16_t)get_le(in + 40, 2) : 0;
+    return true;
+}
@@ -0,0 +1,167 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Streamer protocol, as seen from the streamer.
+//
+// The server sends one command byte, optionally followed by a fixed number of ASCII digits. Every frame
+//  goes back as ":::" + 10 digit payload length + JPEG.
+//
+// A connection starts out in the original protocol, where every byte requests a single frame and nothing
+//  follows it. Commands are only understood after the server sent COMMAND_HELLO, which the streamer
+//  answers with COMMAND_HELLO_ACK. A streamer that predates the commands sends a frame instead, so a
+//  server can tell the two apart by the first byte of the answer. After the hello, any byte that isn't
+//  listed below still requests a single frame.
+//
+//   'F'             one frame
+//   'N' + 5 digits  that many frames, back to back
+//   'S' + 3 digits  push frames at up to that rate until cancelled, "000" = as fast as the camera
+//   'X'             stop a running 'N' or 'S' stream
+//   'V' + 1 digit   frame header version for the rest of the connection: 0 = ":::" ASCII (default),
+//                   1 or 2 = binary FrameHeader of that version
+//   'P' + 1 digit   payload for the rest of the connection, a PayloadType: 1 = JPEG (default),
+//                   5 = losslessly compressed raw frames, 6 = grey JPEG to colorize on display
+//   'R' + 5 digits  rendering for the rest of the connection, scale (1-9), quarter turns clockwise (0-3),
+//                   colormap (2 digits, cv::ColormapTypes, 99 = grey) and overlays (0/1). The streamer's
+//                   own is "41111": 4x, 90 degrees, colormap 11, overlays on. A colormap the streamer's
+//                   OpenCV doesn't have is colormap 11
+//   'Q' + 16 digits temperature statistics of a rectangle of the latest frame, x, y, width and height
+//                   (4 digits each) in raw sensor pixels, answered with a PAYLOAD_METADATA JSON object.
+//                   Needs the streamer's --roi-queries
+//   'O' + 3 digits  recapture the flat field offsets from that many frames, "000" = the streamer's default,
+//                   with the lens cap on. No answer, needs the streamer's --nuc
+//
+// Sending a new command while frames are being pushed replaces the running stream ('V', 'P', 'R', 'Q' and
+//  'O' excepted).
+
+const char COMMAND_HELLO = '\x05';     // ENQ
+const char COMMAND_HELLO_ACK = '\x06'; // ACK
+const char COMMAND_SINGLE_FRAME = 'F';
+const char COMMAND_FRAMES = 'N';
+const char COMMAND_SUBSCRIBE = 'S';
+const char COMMAND_CANCEL = 'X';
+const char COMMAND_HEADER_VERSION = 'V';
+const char COMMAND_PAYLOAD_TYPE = 'P';
+const char COMMAND_RENDER = 'R';
+const char COMMAND_QUERY = 'Q';
+const char COMMAND_RECAPTURE_OFFSETS = 'O';
+
+// Longest argument of any command
+const int COMMAND_MAX_ARGUMENT_LENGTH = 16;
+
+enum CommandType
+{
+    SingleFrame,
+    Frames,
+    Subscribe,
+    Cancel,
+    SetHeaderVersion,
+    SetPayloadType,
+    SetRender,
+    Query,
+    RecaptureOffsets,
+};
+
+// How a client wants its frames rendered
+struct RenderParams
+{
+    int scale = 4;
+    int rotate = 90;
+    int colormap = 11; // -1 = grey
+    bool overlays = true;
+
+    bool operator==(const RenderParams &other) const
+    {
+        return scale == other.scale && rotate == other.rotate && colormap == other.colormap && overlays == other.overlays;
+    }
+    bool operator!=(const RenderParams &other) const { return !(*this == other); }
+};
+
+struct Command
+{
+    CommandType type = SingleFrame;
+    int count = 1; // frames to send, -1 until cancelled
+    int fps = 0;   // 0 = unthrottled
+    int headerVersion = 0;
+    int payloadType = 0;
+    RenderParams render;
+    int x = 0, y = 0, width = 0, height = 0; // 'Q' rectangle
+    int offsetFrames = 0;                     // 'O', 0 = default
+};
+
+// Whether the linked OpenCV's cv::applyColorMap knows colormap, or it is -1 for grey. Anything else
+//  makes applyColorMap throw
+bool colormap_supported(int colormap);
+
+// Number of ASCII digits that follow the command byte, none before the hello
+int command_argument_length(char commandByte, bool extended);
+
+// argument holds command_argument_length(commandByte, extended) digits. Before the hello every byte is
+//  a single frame
+Command parse_command(char commandByte, const char *argument, bool extended);
+
+// Binary frame header, little endian, FRAME_HEADER_SIZE bytes:
+//
+//    0  u32  magic "TSFH"
+//    4  u8   version
+//    5  u8   payload type
+//    6  u16  header size
+//    8  u32  sequence number of the captured frame, gaps mean frames the client never got
+//   12  u16  width
+//   14  u16  height
+//   16  u64  capture time, microseconds since the Unix epoch
+//   24  u64  send time, microseconds since the Unix epoch
+//   32  u32  payload size
+//   36  u32  payload CRC-32
+//   40  u16  camera id, 0 unless the streamer drives several cameras
+//   42  u16  reserved, 0
+//   44  u32  header CRC-32 over bytes 0-43
+//
+// Version 1 has no camera id: its header CRC-32 over bytes 0-39 is at 40, and bytes 44-47 are 0.
+
+const uint32_t FRAME_HEADER_MAGIC = 0x48465354; // "TSFH" on the wire
+const uint8_t FRAME_HEADER_VERSION = 2;
+const std::size_t FRAME_HEADER_SIZE = 48;
+
+enum PayloadType : uint8_t
+{
+    PAYLOAD_JPEG = 1,
+    PAYLOAD_RAW16 = 2,       // raw CV_16UC1 sensor counts
+    PAYLOAD_RADIOMETRIC = 3, // per-pixel Celcius
+    PAYLOAD_METADATA = 4,    // JSON
+    PAYLOAD_RAW16_DELTA = 5, // raw CV_16UC1 frames, lossless, see raw_codec.h
+    PAYLOAD_GREY_JPEG = 6,   // the frame before the colormap, with what's needed to finish it, see grey_frame.h
+};
+
+struct FrameHeader
+{
+    uint8_t version = FRAME_HEADER_VERSION;
+    uint8_t payloadType = PAYLOAD_JPEG;
+    uint32_t sequence = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint64_t captureTimeUs = 0;
+    uint64_t sendTimeUs = 0;
+    uint32_t payloadSize = 0;
+    uint32_t payloadCrc = 0;
+    uint16_t cameraId = 0;
+};
+
+uint32_t crc32(const void *data, std::size_t size, uint32_t crc = 0);
+
+// Microseconds since the Unix epoch, for the header timestamps
+uint64_t timestamp_us();
+
+// Little endian field access for the wire formats
+void put_le(uint8_t *out, uint64_t value, int bytes);
+uint64_t get_le(const uint8_t *in, int bytes);
+
+// Lays the header out as header.version, 1 or 2
+void write_frame_header(const FrameHeader &header, uint8_t *out);
+
+// Returns false on a bad magic or header CRC. Version 1 headers read as camera 0.
+bool read_frame_header(const uint8_t *in, FrameHeader &header);
+
+#endif
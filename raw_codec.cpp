@@ -0,0 +1,380 @@
+#include "raw_codec.h"
+#include "protocol.h"
+#include <algorithm>
+
+// rANS with byte wise renormalization, see Fabian Giesen's ryg_rans
+static const int SCALE_BITS = 14;
+static const uint32_t SCALE = 1u << SCALE_BITS;
+static const uint32_t RANS_L = 1u << 23;
+
+static const int SYMBOLS = 256;
+static const uint32_t ESCAPE = SYMBOLS - 1;
+static const int ESCAPE_BYTES = 3;
+
+// Rows looked at when picking a mode
+static const int MODE_SAMPLE_STEP = 4;
+
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// LOCO-I median edge detector
+static inline int32_t med(int32_t left, int32_t up, int32_t upLeft)
+{
+    if (upLeft >= std::max(left, up))
+    {
+        return std::min(left, up);
+    }
+    if (upLeft <= std::min(left, up))
+    {
+        return std::max(left, up);
+    }
+    return left + up - upLeft;
+}
+
+// What gets predicted spatially: the pixel itself, or its change since the previous frame
+template <int Mode>
+static inline int32_t signal(const uint16_t *current, const uint16_t *previous, int x)
+{
+    return Mode == RAW_MODE_INTRA ? (int32_t)current[x] : (int32_t)current[x] - previous[x];
+}
+
+template <int Mode>
+static inline int32_t prediction(const uint16_t *current, const uint16_t *previous, const uint16_t *currentUp,
+                                 const uint16_t *previousUp, int x)
+{
+    if (Mode == RAW_MODE_TEMPORAL)
+    {
+        return 0;
+    }
+    if (!currentUp)
+    {
+        return x ? signal<Mode>(current, previous, x - 1) : 0;
+    }
+    if (x == 0)
+    {
+        return signal<Mode>(currentUp, previousUp, 0);
+    }
+    return med(signal<Mode>(current, previous, x - 1), signal<Mode>(currentUp, previousUp, x),
+               signal<Mode>(currentUp, previousUp, x - 1));
+}
+
+template <int Mode>
+static void residual_row(const cv::Mat &current, const cv::Mat &previous, int y, uint32_t *out)
+{
+    const uint16_t *c = current.ptr<uint16_t>(y);
+    const uint16_t *p = Mode == RAW_MODE_INTRA ? c : previous.ptr<uint16_t>(y);
+    const uint16_t *cu = y ? current.ptr<uint16_t>(y - 1) : nullptr;
+    const uint16_t *pu = y && Mode != RAW_MODE_INTRA ? previous.ptr<uint16_t>(y - 1) : cu;
+
+    for (int x = 0; x < current.cols; x++)
+    {
+        out[x] = zigzag(signal<Mode>(c, p, x) - prediction<Mode>(c, p, cu, pu, x));
+    }
+}
+
+// Inverse of residual_row, left to right since every pixel is predicted from decoded ones
+template <int Mode>
+static void reconstruct_row(cv::Mat &current, const cv::Mat &previous, int y, const uint32_t *in)
+{
+    uint16_t *c = current.ptr<uint16_t>(y);
+    const uint16_t *p = Mode == RAW_MODE_INTRA ? c : previous.ptr<uint16_t>(y);
+    const uint16_t *cu = y ? current.ptr<uint16_t>(y - 1) : nullptr;
+    const uint16_t *pu = y && Mode != RAW_MODE_INTRA ? previous.ptr<uint16_t>(y - 1) : cu;
+
+    for (int x = 0; x < current.cols; x++)
+    {
+        int32_t value = unzigzag(in[x]) + prediction<Mode>(c, p, cu, pu, x);
+        c[x] = (uint16_t)(Mode == RAW_MODE_INTRA ? value : value + p[x]);
+    }
+}
+
+template <int Mode>
+static uint64_t sampled_cost(const cv::Mat &current, const cv::Mat &previous, std::vector<uint32_t> &scratch)
+{
+    uint64_t cost = 0;
+    for (int y = 1; y < current.rows; y += MODE_SAMPLE_STEP)
+    {
+        residual_row<Mode>(current, previous, y, scratch.data());
+        for (int x = 0; x < current.cols; x++)
+        {
+            cost += 32 - __builtin_clz(scratch[x] | 1); // bits in the residual
+        }
+    }
+    return cost;
+}
+
+// Scales symbol counts to frequencies summing to SCALE, keeping every used symbol codable
+static void normalize_frequencies(const uint32_t *counts, int symbols, uint32_t total, uint32_t *frequencies)
+{
+    uint32_t sum = 0;
+    int largest = 0;
+    for (int s = 0; s < symbols; s++)
+    {
+        frequencies[s] = counts[s] ? std::max<uint32_t>(1, (uint32_t)((uint64_t)counts[s] * SCALE / total)) : 0;
+        sum += frequencies[s];
+        if (frequencies[s] > frequencies[largest])
+        {
+            largest = s;
+        }
+    }
+
+    if (sum <= SCALE)
+    {
+        frequencies[largest] += SCALE - sum;
+        return;
+    }
+
+    // Too many rare symbols were rounded up, take the excess from whoever can spare it
+    while (sum > SCALE)
+    {
+        int biggest = (int)(std::max_element(frequencies, frequencies + symbols) - frequencies);
+        frequencies[biggest]--;
+        sum--;
+    }
+}
+
+void RawEncoder::reset()
+{
+    previous.release();
+}
+
+void RawEncoder::encode(const cv::Mat &raw, std::vector<uint8_t> &out)
+{
+    int width = raw.cols, height = raw.rows;
+    std::size_t pixels = (std::size_t)width * height;
+    residuals.resize(pixels);
+
+    bool intra = previous.empty() || previous.size() != raw.size() || ++sinceKeyframe >= keyframeInterval;
+    RawCodecMode mode = RAW_MODE_INTRA;
+    if (!intra)
+    {
+        uint64_t intraCost = sampled_cost<RAW_MODE_INTRA>(raw, previous, residuals);
+        uint64_t temporalCost = sampled_cost<RAW_MODE_TEMPORAL>(raw, previous, residuals);
+        uint64_t bothCost = sampled_cost<RAW_MODE_BOTH>(raw, previous, residuals);
+        if (temporalCost < intraCost && temporalCost <= bothCost)
+        {
+            mode = RAW_MODE_TEMPORAL;
+        }
+        else if (bothCost < intraCost)
+        {
+            mode = RAW_MODE_BOTH;
+        }
+    }
+    if (mode == RAW_MODE_INTRA)
+    {
+        sinceKeyframe = 0;
+    }
+    lastIntra = mode == RAW_MODE_INTRA;
+
+    uint32_t counts[SYMBOLS] = {0};
+    uint32_t escapes = 0;
+    for (int y = 0; y < height; y++)
+    {
+        uint32_t *row = residuals.data() + (std::size_t)y * width;
+        switch (mode)
+        {
+        case RAW_MODE_TEMPORAL:
+            residual_row<RAW_MODE_TEMPORAL>(raw, previous, y, row);
+            break;
+        case RAW_MODE_BOTH:
+            residual_row<RAW_MODE_BOTH>(raw, previous, y, row);
+            break;
+        default:
+            residual_row<RAW_MODE_INTRA>(raw, previous, y, row);
+            break;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t symbol = std::min(row[x], ESCAPE);
+            counts[symbol]++;
+            escapes += symbol == ESCAPE;
+        }
+    }
+
+    int symbols = SYMBOLS;
+    while (symbols > 1 && counts[symbols - 1] == 0)
+    {
+        symbols--;
+    }
+
+    uint32_t frequencies[SYMBOLS] = {0}, starts[SYMBOLS] = {0};
+    normalize_frequencies(counts, symbols, (uint32_t)pixels, frequencies);
+    for (int s = 1; s < symbols; s++)
+    {
+        starts[s] = starts[s - 1] + frequencies[s - 1];
+    }
+
+    // rANS works backwards, the decoder then reads the stream front to back. A symbol never takes more
+    //  than SCALE_BITS bits, so two bytes per pixel always fit.
+    stream.resize(pixels * 2 + 8);
+    uint8_t *end = stream.data() + stream.size();
+    uint8_t *cursor = end;
+    uint32_t state = RANS_L;
+    for (std::size_t i = pixels; i-- > 0;)
+    {
+        uint32_t symbol = std::min(residuals[i], ESCAPE);
+        uint32_t frequency = frequencies[symbol];
+        uint32_t limit = ((RANS_L >> SCALE_BITS) << 8) * frequency;
+        while (state >= limit)
+        {
+            *--cursor = (uint8_t)state;
+            state >>= 8;
+        }
+        state = ((state / frequency) << SCALE_BITS) + (state % frequency) + starts[symbol];
+    }
+    cursor -= 4;
+    put_le(cursor, state, 4);
+    std::size_t streamSize = end - cursor;
+
+    out.resize(RAW_CODEC_HEADER_SIZE + symbols * 2 + streamSize + escapes * ESCAPE_BYTES);
+    uint8_t *o = out.data();
+    o[0] = RAW_CODEC_VERSION;
+    o[1] = mode;
+    put_le(o + 2, width, 2);
+    put_le(o + 4, height, 2);
+    put_le(o + 6, symbols, 2);
+    put_le(o + 8, frameNumber, 4);
+    put_le(o + 12, streamSize, 4);
+    put_le(o + 16, escapes, 4);
+    o += RAW_CODEC_HEADER_SIZE;
+    for (int s = 0; s < symbols; s++, o += 2)
+    {
+        put_le(o, frequencies[s], 2);
+    }
+    std::copy(cursor, end, o);
+    o += streamSize;
+    for (std::size_t i = 0; i < pixels; i++)
+    {
+        if (residuals[i] >= ESCAPE)
+        {
+            put_le(o, residuals[i], ESCAPE_BYTES);
+            o += ESCAPE_BYTES;
+        }
+    }
+
+    raw.copyTo(previous);
+    frameNumber++;
+}
+
+void RawDecoder::reset()
+{
+    havePrevious = false;
+}
+
+bool RawDecoder::is_intra(const uint8_t *data, std::size_t size)
+{
+    return size >= RAW_CODEC_HEADER_SIZE && data[1] == RAW_MODE_INTRA;
+}
+
+bool RawDecoder::decode(const uint8_t *data, std::size_t size, cv::Mat &raw)
+{
+    if (size < RAW_CODEC_HEADER_SIZE || data[0] != RAW_CODEC_VERSION || data[1] > RAW_MODE_BOTH)
+    {
+        return false;
+    }
+
+    int mode = data[1];
+    int width = (int)get_le(data + 2, 2);
+    int height = (int)get_le(data + 4, 2);
+    int symbols = (int)get_le(data + 6, 2);
+    uint32_t number = (uint32_t)get_le(data + 8, 4);
+    std::size_t streamSize = get_le(data + 12, 4);
+    std::size_t escapes = get_le(data + 16, 4);
+    std::size_t pixels = (std::size_t)width * height;
+
+    if (width < 1 || height < 1 || width > RAW_CODEC_MAX_WIDTH || height > RAW_CODEC_MAX_HEIGHT || escapes > pixels ||
+        symbols < 1 || symbols > SYMBOLS || streamSize < 4 ||
+        size != RAW_CODEC_HEADER_SIZE + symbols * 2 + streamSize + escapes * ESCAPE_BYTES)
+    {
+        return false;
+    }
+
+    // Anything but an intra frame needs exactly the frame before it
+    if (mode != RAW_MODE_INTRA &&
+        (!havePrevious || number != frameNumber + 1 || previous.cols != width || previous.rows != height))
+    {
+        havePrevious = false;
+        return false;
+    }
+
+    uint32_t frequencies[SYMBOLS] = {0}, starts[SYMBOLS] = {0};
+    const uint8_t *in = data + RAW_CODEC_HEADER_SIZE;
+    uint32_t sum = 0;
+    for (int s = 0; s < symbols; s++, in += 2)
+    {
+        frequencies[s] = (uint32_t)get_le(in, 2);
+        starts[s] = sum;
+        sum += frequencies[s];
+    }
+    if (sum != SCALE)
+    {
+        return false;
+    }
+
+    symbolOf.resize(SCALE);
+    for (int s = 0; s < symbols; s++)
+    {
+        std::fill(symbolOf.begin() + starts[s], symbolOf.begin() + starts[s] + frequencies[s], (uint16_t)s);
+    }
+
+    // Decode all residuals first, reconstruction needs whole rows of them
+    std::vector<uint32_t> residuals(pixels);
+    const uint8_t *cursor = in, *streamEnd = in + streamSize;
+    const uint8_t *escape = streamEnd, *escapeEnd = escape + escapes * ESCAPE_BYTES;
+    uint32_t state = (uint32_t)get_le(cursor, 4);
+    cursor += 4;
+    for (std::size_t i = 0; i < pixels; i++)
+    {
+        uint32_t slot = state & (SCALE - 1);
+        uint32_t symbol = symbolOf[slot];
+        state = frequencies[symbol] * (state >> SCALE_BITS) + slot - starts[symbol];
+        while (state < RANS_L && cursor < streamEnd)
+        {
+            state = (state << 8) | *cursor++;
+        }
+
+        if (symbol == ESCAPE)
+        {
+            if (escape == escapeEnd)
+            {
+                return false;
+            }
+            residuals[i] = (uint32_t)get_le(escape, ESCAPE_BYTES);
+            escape += ESCAPE_BYTES;
+        }
+        else
+        {
+            residuals[i] = symbol;
+        }
+    }
+
+    raw.create(height, width, CV_16UC1);
+    for (int y = 0; y < height; y++)
+    {
+        const uint32_t *row = residuals.data() + (std::size_t)y * width;
+        switch (mode)
+        {
+        case RAW_MODE_TEMPORAL:
+            reconstruct_row<RAW_MODE_TEMPORAL>(raw, previous, y, row);
+            break;
+        case RAW_MODE_BOTH:
+            reconstruct_row<RAW_MODE_BOTH>(raw, previous, y, row);
+            break;
+        default:
+            reconstruct_row<RAW_MODE_INTRA>(raw, previous, y, row);
+            break;
+        }
+    }
+
+    raw.copyTo(previous);
+    havePrevious = true;
+    frameNumber = number;
+    return true;
+}
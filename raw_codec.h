@@ -0,0 +1,93 @@
+#ifndef RAW_CODEC_H
+#define RAW_CODEC_H
+
+#include <opencv2/core/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless codec for raw CV_16UC1 frames (PAYLOAD_RAW16_DELTA).
+//
+// Each pixel is predicted and only the residual is coded. Per frame the encoder picks whichever
+//  prediction leaves the smallest residuals:
+//
+//   RAW_MODE_INTRA     MED (LOCO-I) predictor from the left, upper and upper left neighbours
+//   RAW_MODE_TEMPORAL  the same pixel in the previous frame
+//   RAW_MODE_BOTH      MED applied to the difference against the previous frame
+//
+// Residuals are zigzag mapped; values below 255 are symbols of their own, anything larger is symbol 255
+//  plus a 3 byte escape. Symbols are coded with a static rANS coder using the frame's own frequencies.
+//
+// Payload, little endian:
+//
+//    0  u8   codec version
+//    1  u8   mode
+//    2  u16  width
+//    4  u16  height
+//    6  u16  symbols in the frequency table
+//    8  u32  frame number, consecutive per encoder; non-intra frames predict from frame number - 1
+//   12  u32  rANS stream size
+//   16  u32  escape count
+//   20  u16  frequencies, one per symbol, summing to 1 << RAW_CODEC_SCALE_BITS
+//       ...  rANS stream, then 3 bytes per escape
+//
+// Intra frames stand alone. A decoder that missed a frame fails until the next one, which the encoder
+//  sends every keyframeInterval frames.
+
+const uint8_t RAW_CODEC_VERSION = 1;
+const std::size_t RAW_CODEC_HEADER_SIZE = 20;
+
+// Largest frame a decoder accepts, with room to spare over the Compact Pro's 320x240. The size comes from
+//  the payload, so this is all that stands between a hostile packet and a huge allocation.
+const int RAW_CODEC_MAX_WIDTH = 640;
+const int RAW_CODEC_MAX_HEIGHT = 512;
+
+enum RawCodecMode : uint8_t
+{
+    RAW_MODE_INTRA = 0,
+    RAW_MODE_TEMPORAL = 1,
+    RAW_MODE_BOTH = 2,
+};
+
+class RawEncoder
+{
+public:
+    // Frames between intra frames, so late joiners and lossy links resync
+    int keyframeInterval = 30;
+
+    // Next frame is coded intra
+    void reset();
+
+    void encode(const cv::Mat &raw, std::vector<uint8_t> &out);
+
+    // Whether the last encode() produced an intra frame
+    bool lastWasIntra() const { return lastIntra; }
+
+private:
+    cv::Mat previous;
+    uint32_t frameNumber = 0;
+    int sinceKeyframe = 0;
+    bool lastIntra = false;
+    std::vector<uint32_t> residuals; // zigzag mapped
+    std::vector<uint8_t> stream;
+};
+
+class RawDecoder
+{
+public:
+    void reset();
+
+    // Returns false on a corrupt payload or a non-intra frame without its reference
+    bool decode(const uint8_t *data, std::size_t size, cv::Mat &raw);
+
+    // Mode of the payload, without decoding it
+    static bool is_intra(const uint8_t *data, std::size_t size);
+
+private:
+    cv::Mat previous;
+    bool havePrevious = false;
+    uint32_t frameNumber = 0;
+    std::vector<uint16_t> symbolOf; // cumulative frequency -> symbol
+};
+
+#endif
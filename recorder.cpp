@@ -0,0 +1,431 @@
+#include "recorder.h"
+#include "protocol.h"
+#include "thermal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(RecordingHeader) <= RECORDING_INDEX_OFFSET, "RecordingHeader outgrew its page");
+static_assert(sizeof(RecordingIndexEntry) == 64, "RecordingIndexEntry is a fixed 64 byte stride");
+
+static const uint64_t PAGE_SIZE_BYTES = 4096;
+
+static uint64_t page_align(uint64_t value)
+{
+    return (value + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES * PAGE_SIZE_BYTES;
+}
+
+RecordingWriter::~RecordingWriter()
+{
+    close();
+}
+
+bool RecordingWriter::create(const std::string &fileName, cv::Size frameSize, uint64_t frameCapacity)
+{
+    // Page aligned slots keep each frame on its own pages, so writeback of one never touches another
+    uint64_t frameStride = page_align((uint64_t)frameSize.area() * 2);
+    uint64_t dataOffset = page_align(RECORDING_INDEX_OFFSET + frameCapacity * sizeof(RecordingIndexEntry));
+    uint64_t fileSize = dataOffset + frameCapacity * frameStride;
+    if (fileSize > std::numeric_limits<std::size_t>::max() / 2)
+    {
+        std::cerr << "A segment of " << frameCapacity << " frames is too large to map, record fewer frames per segment" << std::endl;
+        return false;
+    }
+    mappingSize = (std::size_t)fileSize;
+
+    fd = ::open(fileName.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Could not create recording " << fileName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int error = posix_fallocate(fd, 0, mappingSize);
+    if (error != 0)
+    {
+        std::cerr << "Could not reserve " << mappingSize << " bytes for " << fileName << ": " << strerror(error) << std::endl;
+        ::close(fd);
+        unlink(fileName.c_str());
+        fd = -1;
+        return false;
+    }
+
+    mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Could not map recording " << fileName << ": " << strerror(errno) << std::endl;
+        mapping = nullptr;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // Written sequentially and rarely read back while recording
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+    header = (RecordingHeader *)mapping;
+    memset(header, 0, sizeof(RecordingHeader));
+    header->magic = RECORDING_MAGIC;
+    header->version = RECORDING_VERSION;
+    header->width = frameSize.width;
+    header->height = frameSize.height;
+    header->frameCapacity = frameCapacity;
+    header->indexOffset = RECORDING_INDEX_OFFSET;
+    header->dataOffset = dataOffset;
+    header->frameStride = frameStride;
+    header->createdUs = timestamp_us();
+    dataEnd = dataOffset;
+
+    return true;
+}
+
+void RecordingWriter::close()
+{
+    if (!mapping)
+    {
+        return;
+    }
+
+    msync(mapping, mappingSize, MS_SYNC);
+    munmap(mapping, mappingSize);
+    if (ftruncate(fd, dataEnd) != 0)
+    {
+        std::cerr << "Could not trim recording: " << strerror(errno) << std::endl;
+    }
+    ::close(fd);
+
+    fd = -1;
+    mapping = nullptr;
+    header = nullptr;
+}
+
+bool RecordingWriter::append(const cv::Mat &raw, const RecordedFrameInfo &info)
+{
+    if (isFull() || raw.type() != CV_16UC1 || raw.cols != (int)header->width || raw.rows != (int)header->height)
+    {
+        return false;
+    }
+
+    cv::Mat slot(raw.rows, raw.cols, CV_16UC1, (uint8_t *)mapping + dataEnd);
+    raw.copyTo(slot);
+
+    commit(raw.total() * 2, PAYLOAD_RAW16, true, info);
+    return true;
+}
+
+bool RecordingWriter::append(const uint8_t *payload, std::size_t size, uint8_t payloadType, bool intra, const RecordedFrameInfo &info)
+{
+    if (isFull() || size > maxPayloadSize())
+    {
+        return false;
+    }
+
+    memcpy((uint8_t *)mapping + dataEnd, payload, size);
+
+    commit(size, payloadType, intra, info);
+    return true;
+}
+
+void RecordingWriter::commit(std::size_t size, uint8_t payloadType, bool intra, const RecordedFrameInfo &info)
+{
+    uint64_t index = header->frameCount;
+    RecordingIndexEntry *entry = (RecordingIndexEntry *)((uint8_t *)mapping + header->indexOffset) + index;
+    memset(entry, 0, sizeof(RecordingIndexEntry));
+    entry->sequence = info.sequence;
+    entry->captureTimeUs = info.captureTimeUs;
+    entry->deviceTempSensor = info.deviceTempSensor;
+    entry->payloadSize = (uint32_t)size;
+    entry->payloadType = payloadType;
+    entry->flags = intra ? RECORDING_FRAME_INTRA : 0;
+    entry->preAdd = info.preAdd;
+    entry->multiplier = info.multiplier;
+    entry->postAdd = info.postAdd;
+    entry->offset = dataEnd;
+
+    // Count the frame only once it's all there
+    std::atomic_thread_fence(std::memory_order_release);
+    header->frameCount = index + 1;
+
+    // The pages won't be touched again, let the kernel write them out now instead of in one burst later
+    sync_file_range(fd, dataEnd, size, SYNC_FILE_RANGE_WRITE);
+    dataEnd += size;
+}
+
+RecordingReader::~RecordingReader()
+{
+    close();
+}
+
+bool RecordingReader::open(const std::string &fileName)
+{
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Could not open recording " << fileName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < RECORDING_INDEX_OFFSET)
+    {
+        std::cerr << fileName << " is not a recording" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    mappingSize = info.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        return false;
+    }
+
+    header = (const RecordingHeader *)mapping;
+    if (header->magic != RECORDING_MAGIC || header->version < 1 || header->version > RECORDING_VERSION)
+    {
+        std::cerr << fileName << " is not a recording" << std::endl;
+        close();
+        return false;
+    }
+
+    // A recording cut short (crash, full disk) may claim more frames than the file holds, read() checks
+    //  every payload against the file size
+    count = header->frameCount;
+    if (header->dataOffset > mappingSize || header->indexOffset + count * sizeof(RecordingIndexEntry) > header->dataOffset)
+    {
+        count = 0;
+    }
+    decoder.reset();
+    decodedIndex = UINT64_MAX;
+
+    return true;
+}
+
+void RecordingReader::close()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        header = nullptr;
+        count = 0;
+    }
+}
+
+const RecordingIndexEntry *RecordingReader::entry(uint64_t index) const
+{
+    return (const RecordingIndexEntry *)((const uint8_t *)mapping + header->indexOffset) + index;
+}
+
+bool RecordingReader::read(uint64_t index, cv::Mat &frame, RecordedFrameInfo &info)
+{
+    if (index >= count)
+    {
+        return false;
+    }
+
+    const RecordingIndexEntry *e = entry(index);
+    info.sequence = e->sequence;
+    info.captureTimeUs = e->captureTimeUs;
+    info.deviceTempSensor = e->deviceTempSensor;
+    info.preAdd = e->preAdd;
+    info.multiplier = e->multiplier;
+    info.postAdd = e->postAdd;
+
+    if (header->version == 1)
+    {
+        uint64_t offset = header->dataOffset + index * header->frameStride;
+        if (offset + header->frameStride > mappingSize)
+        {
+            return false;
+        }
+        frame = cv::Mat(header->height, header->width, CV_16UC1, (uint8_t *)mapping + offset);
+        return true;
+    }
+
+    if (e->offset + e->payloadSize > mappingSize)
+    {
+        return false;
+    }
+
+    if (e->payloadType == PAYLOAD_RAW16)
+    {
+        frame = cv::Mat(header->height, header->width, CV_16UC1, (uint8_t *)mapping + e->offset);
+        return true;
+    }
+
+    if (e->payloadType == PAYLOAD_RAW16_DELTA && decode(index))
+    {
+        frame = decoded;
+        return true;
+    }
+
+    return false;
+}
+
+bool RecordingReader::decode(uint64_t index)
+{
+    if (index == decodedIndex)
+    {
+        return true;
+    }
+
+    // Compressed frames build on the one before, back to the last intra frame
+    uint64_t first = index;
+    if (decodedIndex == UINT64_MAX || index != decodedIndex + 1)
+    {
+        while (first > 0 && !(entry(first)->flags & RECORDING_FRAME_INTRA))
+        {
+            first--;
+        }
+        decoder.reset();
+    }
+
+    for (uint64_t i = first; i <= index; i++)
+    {
+        const RecordingIndexEntry *e = entry(i);
+        if (e->offset + e->payloadSize > mappingSize ||
+            !decoder.decode((const uint8_t *)mapping + e->offset, e->payloadSize, decoded))
+        {
+            decodedIndex = UINT64_MAX;
+            return false;
+        }
+    }
+
+    decodedIndex = index;
+    return true;
+}
+
+Recorder::~Recorder()
+{
+    stop();
+}
+
+bool Recorder::start(const std::string &prefix, uint64_t framesPerSegment, int queueDepth, bool compress)
+{
+    this->prefix = prefix;
+    this->framesPerSegment = framesPerSegment;
+    this->compress = compress;
+    queue.resize(queueDepth);
+    stopping = false;
+    writer = std::thread(&Recorder::run, this);
+    return true;
+}
+
+void Recorder::stop()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    segment.close();
+}
+
+bool Recorder::record(const cv::Mat &raw, uint64_t sequence, uint64_t captureTimeUs, int deviceTempSensor)
+{
+    std::size_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queued == queue.size())
+        {
+            framesDropped++;
+            return false;
+        }
+        slot = (head + queued) % queue.size();
+    }
+
+    // The writer only ever looks at queued slots, so this one can be filled without the lock
+    Pending &pending = queue[slot];
+    raw.copyTo(pending.raw);
+    pending.info.sequence = sequence;
+    pending.info.captureTimeUs = captureTimeUs;
+    pending.info.deviceTempSensor = deviceTempSensor;
+    pending.info.preAdd = preAdd;
+    pending.info.multiplier = multiplier;
+    pending.info.postAdd = postAdd;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    wake.notify_one();
+    return true;
+}
+
+bool Recorder::nextSegment(cv::Size frameSize)
+{
+    segment.close();
+
+    // Every segment starts with an intra frame so it can be played on its own
+    encoder.reset();
+
+    char fileName[32];
+    sprintf(fileName, "_%04d.tsrec", segmentNumber++);
+    return segment.create(prefix + fileName, frameSize, framesPerSegment);
+}
+
+void Recorder::run()
+{
+    while (true)
+    {
+        std::size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0)
+            {
+                return;
+            }
+            slot = head;
+        }
+
+        Pending &pending = queue[slot];
+        if (!segment.isOpen() || segment.isFull() || segment.frameSize() != pending.raw.size())
+        {
+            nextSegment(pending.raw.size());
+        }
+
+        bool written = false;
+        if (segment.isOpen() && compress)
+        {
+            encoder.encode(pending.raw, encoded);
+            written = segment.append(encoded.data(), encoded.size(), PAYLOAD_RAW16_DELTA, encoder.lastWasIntra(), pending.info);
+        }
+        if (segment.isOpen() && !written)
+        {
+            // Noise the codec can't shrink is stored as is, the next frame then has to be intra again
+            written = segment.append(pending.raw, pending.info);
+            encoder.reset();
+        }
+
+        if (written)
+        {
+            framesWritten++;
+        }
+        else
+        {
+            framesDropped++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % queue.size();
+            queued--;
+        }
+    }
+}
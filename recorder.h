@@ -0,0 +1,188 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "raw_codec.h"
+
+// Full fidelity recordings of the raw CV_16UC1 frames.
+//
+// A recording is a set of segment files, each one preallocated for a fixed number of frames and
+//  written through a memory mapping:
+//
+//    0              RecordingHeader, padded to RECORDING_INDEX_OFFSET
+//    indexOffset    frameCapacity RecordingIndexEntry, 64 bytes each
+//    dataOffset     frame payloads back to back, each at the offset its index entry gives
+//
+// Space is reserved for frameCapacity uncompressed frames (frameStride bytes each) and the file is cut
+//  down to what was used on close. Frame i's metadata is at indexOffset + i * 64, so any frame can be found
+//  without scanning. Payloads are raw CV_16UC1 or PAYLOAD_RAW16_DELTA; the latter only decode from the
+//  last intra frame onwards, which the recorder writes at least every RawEncoder::keyframeInterval frames
+//  and at the start of every segment. frameCount in the header is bumped only after the frame and its
+//  index entry are in place, a crash loses at most the frame being written. Fields are host (little)
+//  endian. Version 1 files had no offsets and kept frame i at dataOffset + i * frameStride.
+
+const uint32_t RECORDING_MAGIC = 0x43525354; // "TSRC"
+const uint32_t RECORDING_VERSION = 2;
+const uint64_t RECORDING_INDEX_OFFSET = 4096;
+
+// Five minutes at the camera's 9 fps. A segment maps all of its frames at once, about 180 MB for a
+//  Compact and 420 MB for a Compact Pro, which still fits the address space of a 32-bit board.
+const uint64_t RECORDING_DEFAULT_SEGMENT_FRAMES = 9 * 300;
+// Frames that may wait for the disk
+const int RECORDER_QUEUE_DEPTH = 32;
+
+struct RecordingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height;
+    uint64_t frameCapacity;
+    uint64_t frameCount;
+    uint64_t indexOffset;
+    uint64_t dataOffset;
+    uint64_t frameStride;   // size of an uncompressed frame, page aligned
+    uint64_t createdUs;
+};
+
+struct RecordingIndexEntry
+{
+    uint64_t sequence;
+    uint64_t captureTimeUs;
+    int32_t deviceTempSensor;
+    uint32_t payloadSize;
+    uint8_t payloadType;   // PayloadType from protocol.h, PAYLOAD_RAW16 or PAYLOAD_RAW16_DELTA
+    uint8_t flags;         // RECORDING_FRAME_INTRA
+    uint8_t reserved[6];
+    double preAdd;         // calibration in effect when the frame was captured, see thermal.h
+    double multiplier;
+    double postAdd;
+    uint64_t offset;       // of the payload, from the start of the file
+};
+
+// Decodes without any earlier frame
+const uint8_t RECORDING_FRAME_INTRA = 1;
+
+// What gets stored next to every frame
+struct RecordedFrameInfo
+{
+    uint64_t sequence = 0;
+    uint64_t captureTimeUs = 0;
+    int deviceTempSensor = 0;
+    double preAdd = 0;
+    double multiplier = 0;
+    double postAdd = 0;
+};
+
+// One segment file, written synchronously
+class RecordingWriter
+{
+public:
+    ~RecordingWriter();
+
+    // Reserves the disk space for all frames up front, so running out of it shows up here rather than
+    //  as a SIGBUS halfway through the mapping
+    bool create(const std::string &fileName, cv::Size frameSize, uint64_t frameCapacity);
+    // Shrinks the file to the frames actually written
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+    bool isFull() const { return header->frameCount == header->frameCapacity || dataEnd + header->frameStride > mappingSize; }
+    cv::Size frameSize() const { return cv::Size(header->width, header->height); }
+    // Room for one uncompressed frame, encoded payloads larger than this have to go in raw
+    std::size_t maxPayloadSize() const { return header->frameStride; }
+
+    bool append(const cv::Mat &raw, const RecordedFrameInfo &info);
+    bool append(const uint8_t *payload, std::size_t size, uint8_t payloadType, bool intra, const RecordedFrameInfo &info);
+
+private:
+    void commit(std::size_t size, uint8_t payloadType, bool intra, const RecordedFrameInfo &info);
+
+    int fd = -1;
+    uint64_t dataEnd = 0;
+    void *mapping = nullptr;
+    std::size_t mappingSize = 0;
+    RecordingHeader *header = nullptr;
+};
+
+class RecordingReader
+{
+public:
+    ~RecordingReader();
+
+    bool open(const std::string &fileName);
+    void close();
+
+    uint64_t frameCount() const { return count; }
+    cv::Size frameSize() const { return cv::Size(header->width, header->height); }
+
+    // frame points into the mapping or the decoder, clone() it to keep it past the next read() or close().
+    //  Reading compressed frames in order decodes each once; jumping decodes from the last intra frame.
+    bool read(uint64_t index, cv::Mat &frame, RecordedFrameInfo &info);
+
+private:
+    const RecordingIndexEntry *entry(uint64_t index) const;
+    bool decode(uint64_t index);
+
+    void *mapping = nullptr;
+    std::size_t mappingSize = 0;
+    const RecordingHeader *header = nullptr;
+    uint64_t count = 0;
+
+    RawDecoder decoder;
+    cv::Mat decoded;
+    uint64_t decodedIndex = UINT64_MAX;
+};
+
+// Records into <prefix>_0000.tsrec, <prefix>_0001.tsrec, ... starting a new segment whenever one is full
+//  or the frame size changes. record() only copies the frame into a queue, a writer thread does the
+//  rest, so a slow disk drops frames (counted in framesDropped) instead of stalling capture. Meant to be
+//  fed from a single capture thread. With compress set frames are stored as PAYLOAD_RAW16_DELTA, encoded on
+//  the writer thread.
+class Recorder
+{
+public:
+    ~Recorder();
+
+    bool start(const std::string &prefix, uint64_t framesPerSegment, int queueDepth, bool compress);
+    // Writes out whatever is still queued
+    void stop();
+
+    bool record(const cv::Mat &raw, uint64_t sequence, uint64_t captureTimeUs, int deviceTempSensor);
+
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesDropped{0};
+
+private:
+    struct Pending
+    {
+        cv::Mat raw;
+        RecordedFrameInfo info;
+    };
+
+    void run();
+    bool nextSegment(cv::Size frameSize);
+
+    std::string prefix;
+    uint64_t framesPerSegment = 0;
+    int segmentNumber = 0;
+    RecordingWriter segment;
+    bool compress = false;
+    RawEncoder encoder;
+    std::vector<uint8_t> encoded;
+
+    std::vector<Pending> queue; // ring, preallocated so record() never allocates once warm
+    std::size_t head = 0, queued = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+};
+
+#endif
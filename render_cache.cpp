@@ -0,0 +1,32 @@
+#include "render_cache.h"
+#include <algorithm>
+
+RenderCache::RenderCache(std::size_t capacity)
+    : capacity(std::max<std::size_t>(capacity, 1))
+{
+}
+
+RenderCache::Frame RenderCache::get(uint32_t sequence, const RenderParams &params, uint8_t payloadType,
+                                    const std::function<void(RenderedFrame &)> &render)
+{
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        if (it->sequence == sequence && it->payloadType == payloadType && it->params == params)
+        {
+            entries.splice(entries.begin(), entries, it);
+            hits++;
+            return entries.front().frame;
+        }
+    }
+
+    std::shared_ptr<RenderedFrame> frame = std::make_shared<RenderedFrame>();
+    render(*frame);
+    misses++;
+
+    if (entries.size() >= capacity)
+    {
+        entries.pop_back();
+    }
+    entries.push_front(Entry{sequence, params, payloadType, frame});
+    return frame;
+}
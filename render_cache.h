@@ -0,0 +1,52 @@
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <opencv2/core/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+#include "protocol.h"
+
+// An encoded frame as it goes out to clients
+struct RenderedFrame
+{
+    std::vector<uchar> payload;
+    int width = 0;
+    int height = 0;
+};
+
+// The last few renderings, keyed by frame sequence, render parameters and payload type, so clients that
+//  asked for the same rendering of a frame share one process_frame and one encode. Least recently used
+//  renderings go first; a handful covers every client of a frame, older frames are never asked for again.
+//
+// Used by one thread at a time. Handed out frames stay valid for as long as they're held.
+class RenderCache
+{
+public:
+    typedef std::shared_ptr<const RenderedFrame> Frame;
+
+    explicit RenderCache(std::size_t capacity = 8);
+
+    // The rendering, with render filling it in on a miss
+    Frame get(uint32_t sequence, const RenderParams &params, uint8_t payloadType, const std::function<void(RenderedFrame &)> &render);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+private:
+    struct Entry
+    {
+        uint32_t sequence;
+        RenderParams params;
+        uint8_t payloadType;
+        Frame frame;
+    };
+
+    std::size_t capacity;
+    std::list<Entry> entries; // most recently used first
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "roi_index.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include "thermal.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace cv;
+
+// Largest k with 2^k <= n, n > 0
+static int floor_log2(int n)
+{
+    int k = 0;
+    while ((2 << k) <= n)
+    {
+        k++;
+    }
+    return k;
+}
+
+void RoiIndex::build(const Mat &raw, int deviceTempSensor, uint32_t sequence, WorkerPool *pool)
+{
+    this->sequence = sequence;
+    size = raw.size();
+    device_k = device_sensor_to_k(deviceTempSensor);
+    levelsX = floor_log2(raw.cols) + 1;
+    levelsY = floor_log2(raw.rows) + 1;
+
+    auto part = [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            if (i == 0)
+            {
+                integral(raw, sum, CV_64F);
+            }
+            else
+            {
+                buildLevels(raw, i == 1 ? maxLevels : minLevels, i == 1);
+            }
+        }
+    };
+    if (pool)
+    {
+        pool->parallel_for(3, 1, part);
+    }
+    else
+    {
+        part(0, 3);
+    }
+}
+
+void RoiIndex::buildLevels(const Mat &raw, std::vector<Mat> &levels, bool max)
+{
+    levels.resize(levelsX * levelsY);
+    for (int ky = 0; ky < levelsY; ky++)
+    {
+        for (int kx = 0; kx < levelsX; kx++)
+        {
+            Mat &level = levels[ky * levelsX + kx];
+            if (ky == 0 && kx == 0)
+            {
+                raw.copyTo(level);
+                continue;
+            }
+
+            // Two blocks of the level before, side by side or one above the other
+            const Mat &from = kx > 0 ? levels[ky * levelsX + kx - 1] : levels[(ky - 1) * levelsX];
+            int step = kx > 0 ? 1 << (kx - 1) : 1 << (ky - 1);
+            Rect first, second;
+            if (kx > 0)
+            {
+                first = Rect(0, 0, from.cols - step, from.rows);
+                second = Rect(step, 0, from.cols - step, from.rows);
+            }
+            else
+            {
+                first = Rect(0, 0, from.cols, from.rows - step);
+                second = Rect(0, step, from.cols, from.rows - step);
+            }
+            level.create(first.size(), CV_16UC1);
+            if (max)
+            {
+                cv::max(from(first), from(second), level);
+            }
+            else
+            {
+                cv::min(from(first), from(second), level);
+            }
+        }
+    }
+}
+
+int RoiIndex::levelAt(const std::vector<Mat> &levels, const Rect &rect, bool max) const
+{
+    int kx = floor_log2(rect.width);
+    int ky = floor_log2(rect.height);
+    const Mat &level = levels[ky * levelsX + kx];
+    int right = rect.x + rect.width - (1 << kx);
+    int bottom = rect.y + rect.height - (1 << ky);
+
+    uint16_t a = level.at<uint16_t>(rect.y, rect.x);
+    uint16_t b = level.at<uint16_t>(rect.y, right);
+    uint16_t c = level.at<uint16_t>(bottom, rect.x);
+    uint16_t d = level.at<uint16_t>(bottom, right);
+    return max ? std::max(std::max(a, b), std::max(c, d)) : std::min(std::min(a, b), std::min(c, d));
+}
+
+bool RoiIndex::query(Rect rect, RoiStats &stats) const
+{
+    rect &= Rect(0, 0, size.width, size.height);
+    if (rect.area() <= 0 || sum.empty())
+    {
+        return false;
+    }
+
+    double total = sum.at<double>(rect.y + rect.height, rect.x + rect.width) - sum.at<double>(rect.y, rect.x + rect.width) -
+                   sum.at<double>(rect.y + rect.height, rect.x) + sum.at<double>(rect.y, rect.x);
+
+    stats.rect = rect;
+    stats.meanRaw = total / rect.area();
+    stats.minRaw = levelAt(minLevels, rect, false);
+    stats.maxRaw = levelAt(maxLevels, rect, true);
+    // temp_from_raw is linear, so the mean of the temperatures is the temperature of the mean
+    stats.mean = temp_from_raw(0, device_k) + stats.meanRaw * (temp_from_raw(1, device_k) - temp_from_raw(0, device_k));
+    stats.min = temp_from_raw(stats.minRaw, device_k);
+    stats.max = temp_from_raw(stats.maxRaw, device_k);
+    return true;
+}
+
+void RoiIndexPublisher::publish(const Mat &raw, int deviceTempSensor, uint32_t sequence, WorkerPool *pool)
+{
+    // Reuse the tables of the frame before last unless a query still holds it
+    if (!spare || spare.use_count() > 1)
+    {
+        spare = std::make_shared<RoiIndex>();
+    }
+    spare->build(raw, deviceTempSensor, sequence, pool);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::swap(current, spare);
+}
+
+std::shared_ptr<const RoiIndex> RoiIndexPublisher::latest() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current;
+}
+
+std::string roi_stats_json(const RoiIndex *index, const Rect &rect)
+{
+    RoiStats stats;
+    if (!index)
+    {
+        return "{\"error\":\"no frame yet\"}";
+    }
+    if (!index->query(rect, stats))
+    {
+        return "{\"error\":\"rectangle outside the frame\"}";
+    }
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"sequence\":%u,\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,"
+             "\"mean\":%.2f,\"min\":%.2f,\"max\":%.2f,\"meanRaw\":%.2f,\"minRaw\":%d,\"maxRaw\":%d}",
+             index->sequence, stats.rect.x, stats.rect.y, stats.rect.width, stats.rect.height,
+             stats.mean, stats.min, stats.max, stats.meanRaw, stats.minRaw, stats.maxRaw);
+    return json;
+}
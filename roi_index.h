@@ -0,0 +1,70 @@
+#ifndef ROI_INDEX_H
+#define ROI_INDEX_H
+
+#include <opencv2/core/core.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "worker_pool.h"
+
+// Statistics of a rectangle of the raw frame, the Celcius ones at the frame's device temperature
+struct RoiStats
+{
+    cv::Rect rect; // clipped to the frame
+    double meanRaw = 0;
+    int minRaw = 0;
+    int maxRaw = 0;
+    double mean = 0;
+    double min = 0;
+    double max = 0;
+};
+
+// Constant time mean, min and max of any rectangle of one raw frame.
+//
+// The mean comes from a summed-area table (cv::integral), min and max from 2D sparse tables: level
+//  (ky, kx) holds the min/max of the 2^ky by 2^kx block at every position, and any rectangle is covered
+//  by four, possibly overlapping, blocks of one level. Every level is cv::min/cv::max of two shifted
+//  views of the one before, which OpenCV vectorizes. For a 320x240 frame the tables are about 16MB.
+class RoiIndex
+{
+public:
+    // Tables for raw (CV_16UC1), max and min built side by side on the pool when there is one
+    void build(const cv::Mat &raw, int deviceTempSensor, uint32_t sequence, WorkerPool *pool = nullptr);
+
+    // False when rect doesn't overlap the frame, otherwise the statistics of the part that does
+    bool query(cv::Rect rect, RoiStats &stats) const;
+
+    uint32_t sequence = 0;
+    cv::Size size;
+
+private:
+    void buildLevels(const cv::Mat &raw, std::vector<cv::Mat> &levels, bool max);
+    int levelAt(const std::vector<cv::Mat> &levels, const cv::Rect &rect, bool max) const;
+
+    cv::Mat sum; // (rows + 1) x (cols + 1) CV_64F
+    std::vector<cv::Mat> maxLevels, minLevels; // [ky * levelsX + kx], CV_16UC1
+    int levelsX = 0, levelsY = 0;
+    double device_k = 0;
+};
+
+// Hands the index of the latest frame to queries on any thread while the capture thread builds the next
+//  one into a spare. Queries hold on to the index they got, so neither side ever waits for the other.
+class RoiIndexPublisher
+{
+public:
+    void publish(const cv::Mat &raw, int deviceTempSensor, uint32_t sequence, WorkerPool *pool = nullptr);
+
+    // nullptr before the first frame
+    std::shared_ptr<const RoiIndex> latest() const;
+
+private:
+    std::shared_ptr<RoiIndex> current, spare;
+    mutable std::mutex mutex; // only around swapping the pointers
+};
+
+// {"sequence":..,"x":..,...} for the socket protocol's answer to a query, or {"error":".."}
+std::string roi_stats_json(const RoiIndex *index, const cv::Rect &rect);
+
+#endif
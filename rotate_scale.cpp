@@ -0,0 +1,237 @@
+#include "rotate_scale.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace cv;
+
+// Fixed point weights, as cv::resize uses for 8 bit images
+static const int COEF_BITS = 11;
+static const int COEF_SCALE = 1 << COEF_BITS;
+
+// Rotated pixel (r, c) is at src.data + rowTerm(r) + colTerm(c)
+template <int Rotation>
+struct Rotated;
+
+template <>
+struct Rotated<0>
+{
+    static int rows(const Mat &src) { return src.rows; }
+    static int cols(const Mat &src) { return src.cols; }
+    static std::ptrdiff_t rowTerm(const Mat &src, int r) { return r * (std::ptrdiff_t)src.step; }
+    static std::ptrdiff_t colTerm(const Mat &src, int c) { return c; }
+};
+
+// transpose, then mirror left to right
+template <>
+struct Rotated<90>
+{
+    static int rows(const Mat &src) { return src.cols; }
+    static int cols(const Mat &src) { return src.rows; }
+    static std::ptrdiff_t rowTerm(const Mat &src, int r) { return r; }
+    static std::ptrdiff_t colTerm(const Mat &src, int c) { return (src.rows - 1 - c) * (std::ptrdiff_t)src.step; }
+};
+
+template <>
+struct Rotated<180>
+{
+    static int rows(const Mat &src) { return src.rows; }
+    static int cols(const Mat &src) { return src.cols; }
+    static std::ptrdiff_t rowTerm(const Mat &src, int r) { return (src.rows - 1 - r) * (std::ptrdiff_t)src.step; }
+    static std::ptrdiff_t colTerm(const Mat &src, int c) { return src.cols - 1 - c; }
+};
+
+// transpose, then mirror top to bottom
+template <>
+struct Rotated<270>
+{
+    static int rows(const Mat &src) { return src.cols; }
+    static int cols(const Mat &src) { return src.rows; }
+    static std::ptrdiff_t rowTerm(const Mat &src, int r) { return src.cols - 1 - r; }
+    static std::ptrdiff_t colTerm(const Mat &src, int c) { return c * (std::ptrdiff_t)src.step; }
+};
+
+// Source index and weight of the following one for a destination index, centre aligned and clamped at
+//  the edges the way cv::resize does it
+static void linear_tap(int d, int factor, int srcSize, int &s0, int &s1, int &weight)
+{
+    double s = (d + 0.5) / factor - 0.5;
+    s0 = (int)std::floor(s);
+    double fraction = s - s0;
+    if (s0 < 0)
+    {
+        s0 = 0;
+        fraction = 0;
+    }
+    if (s0 >= srcSize - 1)
+    {
+        s0 = srcSize - 1;
+        fraction = 0;
+    }
+    s1 = std::min(s0 + 1, srcSize - 1);
+    weight = (int)std::lround(fraction * COEF_SCALE);
+}
+
+template <int Rotation>
+static void rotate_scale_nearest(const Mat &src, Mat &dst, int factor, int begin, int end)
+{
+    typedef Rotated<Rotation> R;
+    static thread_local std::vector<std::ptrdiff_t> columns;
+
+    columns.resize(dst.cols);
+    for (int x = 0; x < dst.cols; x++)
+    {
+        columns[x] = R::colTerm(src, std::min(x / factor, R::cols(src) - 1));
+    }
+
+    for (int y = begin; y < end; y++)
+    {
+        const uchar *row = src.data + R::rowTerm(src, std::min(y / factor, R::rows(src) - 1));
+        uchar *out = dst.ptr<uchar>(y);
+        for (int x = 0; x < dst.cols; x++)
+        {
+            out[x] = row[columns[x]];
+        }
+    }
+}
+
+// Every rotated row is interpolated horizontally once, into one of two buffers, and every destination row
+//  blends the two around it. The buffers are a few KB; rotated by 90 or 270 a rotated row walks down a
+//  source column and the next one reuses the same cache lines, so the working set of a band stays in L1.
+template <int Rotation>
+static void rotate_scale_bilinear(const Mat &src, Mat &dst, int factor, int begin, int end)
+{
+    typedef Rotated<Rotation> R;
+    static thread_local std::vector<std::ptrdiff_t> columns0, columns1;
+    static thread_local std::vector<int> weights;
+    static thread_local std::vector<int> interpolated[2];
+
+    columns0.resize(dst.cols);
+    columns1.resize(dst.cols);
+    weights.resize(dst.cols);
+    for (int x = 0; x < dst.cols; x++)
+    {
+        int c0, c1;
+        linear_tap(x, factor, R::cols(src), c0, c1, weights[x]);
+        columns0[x] = R::colTerm(src, c0);
+        columns1[x] = R::colTerm(src, c1);
+    }
+
+    int interpolatedRow[2] = {-1, -1};
+    auto horizontal = [&](int r, int avoid) -> const int * {
+        for (int i = 0; i < 2; i++)
+        {
+            if (interpolatedRow[i] == r)
+            {
+                return interpolated[i].data();
+            }
+        }
+
+        int slot = interpolatedRow[0] == avoid ? 1 : 0;
+        interpolated[slot].resize(dst.cols);
+        interpolatedRow[slot] = r;
+        const uchar *row = src.data + R::rowTerm(src, r);
+        int *h = interpolated[slot].data();
+        for (int x = 0; x < dst.cols; x++)
+        {
+            h[x] = row[columns0[x]] * (COEF_SCALE - weights[x]) + row[columns1[x]] * weights[x];
+        }
+        return h;
+    };
+
+    for (int y = begin; y < end; y++)
+    {
+        int r0, r1, wy;
+        linear_tap(y, factor, R::rows(src), r0, r1, wy);
+        const int *h0 = horizontal(r0, r1);
+        const int *h1 = horizontal(r1, r0);
+
+        uchar *out = dst.ptr<uchar>(y);
+        for (int x = 0; x < dst.cols; x++)
+        {
+            out[x] = (uchar)((h0[x] * (COEF_SCALE - wy) + h1[x] * wy + (1 << (2 * COEF_BITS - 1))) >> (2 * COEF_BITS));
+        }
+    }
+}
+
+RotateScaleKernel rotate_scale_kernel(int rotate, int interpolation)
+{
+    bool nearest = interpolation == INTER_NEAREST;
+    if (!nearest && interpolation != INTER_LINEAR)
+    {
+        return nullptr;
+    }
+
+    switch (rotate)
+    {
+    case 0:
+        return nearest ? rotate_scale_nearest<0> : rotate_scale_bilinear<0>;
+    case 90:
+        return nearest ? rotate_scale_nearest<90> : rotate_scale_bilinear<90>;
+    case 180:
+        return nearest ? rotate_scale_nearest<180> : rotate_scale_bilinear<180>;
+    case 270:
+        return nearest ? rotate_scale_nearest<270> : rotate_scale_bilinear<270>;
+    default:
+        return nullptr;
+    }
+}
+
+Size rotate_scale_size(Size src, int rotate, int factor)
+{
+    if (rotate == 90 || rotate == 270)
+    {
+        return Size(src.height * factor, src.width * factor);
+    }
+    return Size(src.width * factor, src.height * factor);
+}
+
+Point rotate_point(Point p, Size src, int rotate)
+{
+    switch (rotate)
+    {
+    case 90:
+        return Point(src.height - 1 - p.y, p.x);
+    case 180:
+        return Point(src.width - 1 - p.x, src.height - 1 - p.y);
+    case 270:
+        return Point(p.y, src.width - 1 - p.x);
+    default:
+        return p;
+    }
+}
+
+template <int Rotation>
+static Point find_in(const Mat &src, uchar value)
+{
+    typedef Rotated<Rotation> R;
+    for (int r = 0; r < R::rows(src); r++)
+    {
+        const uchar *row = src.data + R::rowTerm(src, r);
+        for (int c = 0; c < R::cols(src); c++)
+        {
+            if (row[R::colTerm(src, c)] == value)
+            {
+                return Point(c, r);
+            }
+        }
+    }
+    return Point(0, 0);
+}
+
+Point find_rotated(const Mat &src, int rotate, uchar value)
+{
+    switch (rotate)
+    {
+    case 90:
+        return find_in<90>(src, value);
+    case 180:
+        return find_in<180>(src, value);
+    case 270:
+        return find_in<270>(src, value);
+    default:
+        return find_in<0>(src, value);
+    }
+}
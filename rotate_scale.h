@@ -0,0 +1,32 @@
+#ifndef ROTATE_SCALE_H
+#define ROTATE_SCALE_H
+
+#include <opencv2/core/core.hpp>
+
+// Rotation by a multiple of 90 degrees and upscaling by a whole number factor in one pass over a CV_8UC1
+//  frame, in place of transpose + flip + resize and the images between them.
+//
+// Rotations are clockwise, like process_frame's (90 = transpose then mirror). Every kernel is a template
+//  instance for one rotation: rotated pixel (r, c) sits at a fixed row term plus column term into the
+//  source, so the inner loops are plain table lookups with no per-pixel branching on the angle.
+//
+// Bilinear upscaling samples at the same centre aligned positions as cv::resize with INTER_LINEAR, in
+//  11 bit fixed point with exact rounding; cv::resize rounds its SIMD path differently, so values can be
+//  1 apart. Nearest picks the same pixels as INTER_NEAREST.
+
+// Fills destination rows [begin, end). dst must be rotate_scale_size() big, it may be a ROI.
+typedef void (*RotateScaleKernel)(const cv::Mat &src, cv::Mat &dst, int factor, int begin, int end);
+
+// interpolation is cv::INTER_NEAREST or cv::INTER_LINEAR. nullptr for anything else, or an angle that
+//  isn't 0, 90, 180 or 270.
+RotateScaleKernel rotate_scale_kernel(int rotate, int interpolation);
+
+cv::Size rotate_scale_size(cv::Size src, int rotate, int factor);
+
+// Where pixel p of src ends up in the rotated (unscaled) frame
+cv::Point rotate_point(cv::Point p, cv::Size src, int rotate);
+
+// Where minMaxLoc would find value in the rotated (unscaled) frame: the first match in its row order
+cv::Point find_rotated(const cv::Mat &src, int rotate, uchar value);
+
+#endif
@@ -0,0 +1,248 @@
+#include "shm_ring.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const std::size_t PLANE_ALIGNMENT = 64;
+
+static std::size_t align_up(std::size_t value)
+{
+    return (value + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+}
+
+// The ring is shared between processes, so no FUTEX_PRIVATE_FLAG
+static long futex(const std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout)
+{
+    return syscall(SYS_futex, (uint32_t *)word, op, value, timeout, nullptr, 0);
+}
+
+static std::string shm_path(const std::string &name)
+{
+    return name[0] == '/' ? name : "/" + name;
+}
+
+static uint8_t *slot_at(const ShmRingHeader *header, uint64_t slot)
+{
+    return (uint8_t *)header + align_up(sizeof(ShmRingHeader)) + slot * header->slotStride;
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    close();
+}
+
+bool ShmRingWriter::create(const std::string &name, uint32_t slots, cv::Size rawSize, cv::Size bgrSize)
+{
+    this->name = shm_path(name);
+
+    std::size_t rawOffset = align_up(sizeof(ShmSlotHeader));
+    std::size_t bgrOffset = rawOffset + align_up((std::size_t)rawSize.area() * 2);
+    std::size_t slotStride = bgrOffset + align_up((std::size_t)bgrSize.area() * 3);
+    mappingSize = align_up(sizeof(ShmRingHeader)) + slots * slotStride;
+
+    // A stale ring from a previous run may have a different layout, start from scratch
+    shm_unlink(this->name.c_str());
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Could not create shared memory " << this->name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, mappingSize) != 0)
+    {
+        std::cerr << "Could not size shared memory " << this->name << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        shm_unlink(this->name.c_str());
+        return false;
+    }
+
+    mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        shm_unlink(this->name.c_str());
+        return false;
+    }
+
+    // ftruncate zero fills, so the atomics start out at 0 and every seqlock even
+    header = (ShmRingHeader *)mapping;
+    header->version = SHM_RING_VERSION;
+    header->slotCount = slots;
+    header->slotStride = slotStride;
+    header->rawWidth = rawSize.width;
+    header->rawHeight = rawSize.height;
+    header->bgrWidth = bgrSize.width;
+    header->bgrHeight = bgrSize.height;
+    header->rawOffset = rawOffset;
+    header->bgrOffset = bgrOffset;
+
+    // Readers check the magic last, so they never see a half initialized header
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_RING_MAGIC;
+
+    return true;
+}
+
+void ShmRingWriter::close()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        shm_unlink(name.c_str());
+        mapping = nullptr;
+        header = nullptr;
+    }
+}
+
+void ShmRingWriter::publish(const cv::Mat &raw, const cv::Mat &bgr, uint64_t sequence, uint64_t captureTimeUs, int deviceTempSensor)
+{
+    uint64_t index = header->published.load(std::memory_order_relaxed);
+    uint8_t *slot = slot_at(header, index % header->slotCount);
+    ShmSlotHeader *slotHeader = (ShmSlotHeader *)slot;
+
+    uint32_t lock = slotHeader->lock.load(std::memory_order_relaxed);
+    slotHeader->lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slotHeader->sequence = sequence;
+    slotHeader->captureTimeUs = captureTimeUs;
+    slotHeader->deviceTempSensor = deviceTempSensor;
+
+    // Mats that don't match the ring's layout are left out rather than overflowing the slot
+    if (header->rawWidth && raw.type() == CV_16UC1 && raw.cols == (int)header->rawWidth && raw.rows == (int)header->rawHeight)
+    {
+        cv::Mat plane(raw.rows, raw.cols, CV_16UC1, slot + header->rawOffset);
+        raw.copyTo(plane);
+    }
+    if (header->bgrWidth && bgr.type() == CV_8UC3 && bgr.cols == (int)header->bgrWidth && bgr.rows == (int)header->bgrHeight)
+    {
+        cv::Mat plane(bgr.rows, bgr.cols, CV_8UC3, slot + header->bgrOffset);
+        bgr.copyTo(plane);
+    }
+
+    slotHeader->lock.store(lock + 2, std::memory_order_release);
+    header->published.store(index + 1, std::memory_order_release);
+
+    // Readers map the ring read-only and can't say whether they are waiting, one wake per frame is cheap
+    header->futexWord.fetch_add(1, std::memory_order_release);
+    futex(&header->futexWord, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    close();
+}
+
+bool ShmRingReader::open(const std::string &name)
+{
+    int fd = shm_open(shm_path(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (std::size_t)info.st_size < sizeof(ShmRingHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    mappingSize = info.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        return false;
+    }
+
+    header = (const ShmRingHeader *)mapping;
+    if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION)
+    {
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    lastSeen = header->published.load(std::memory_order_acquire);
+    return true;
+}
+
+void ShmRingReader::close()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        header = nullptr;
+    }
+}
+
+bool ShmRingReader::acquire(ShmFrameView &view, int timeoutMs)
+{
+    while (true)
+    {
+        uint32_t word = header->futexWord.load(std::memory_order_acquire);
+        uint64_t published = header->published.load(std::memory_order_acquire);
+
+        if (published > lastSeen)
+        {
+            uint64_t index = published - 1;
+            uint8_t *slot = slot_at(header, index % header->slotCount);
+            const ShmSlotHeader *slotHeader = (const ShmSlotHeader *)slot;
+
+            uint32_t lock = slotHeader->lock.load(std::memory_order_acquire);
+            if (lock & 1)
+            {
+                continue; // lapped by the writer while we looked, try the next newest
+            }
+
+            view.sequence = slotHeader->sequence;
+            view.captureTimeUs = slotHeader->captureTimeUs;
+            view.deviceTempSensor = slotHeader->deviceTempSensor;
+            view.raw = header->rawWidth ? cv::Mat(header->rawHeight, header->rawWidth, CV_16UC1, slot + header->rawOffset) : cv::Mat();
+            view.bgr = header->bgrWidth ? cv::Mat(header->bgrHeight, header->bgrWidth, CV_8UC3, slot + header->bgrOffset) : cv::Mat();
+            view.slot = index % header->slotCount;
+            view.lock = lock;
+
+            if (!valid(view))
+            {
+                continue;
+            }
+
+            skipped += published - lastSeen - 1;
+            lastSeen = published;
+            return true;
+        }
+
+        if (timeoutMs == 0)
+        {
+            return false;
+        }
+
+        timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+        long result = futex(&header->futexWord, FUTEX_WAIT, word, timeoutMs < 0 ? nullptr : &timeout);
+        if (result != 0 && errno == ETIMEDOUT)
+        {
+            return false;
+        }
+    }
+}
+
+bool ShmRingReader::valid(const ShmFrameView &view) const
+{
+    const ShmSlotHeader *slotHeader = (const ShmSlotHeader *)slot_at(header, view.slot);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slotHeader->lock.load(std::memory_order_relaxed) == view.lock;
+}
@@ -0,0 +1,102 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Shared memory output for consumers on the same box: a POSIX shm object holding a ring of slots with the
+//  raw CV_16UC1 frame and/or the processed BGR frame, so local readers skip the JPEG encode, the socket
+//  copy and the decode entirely.
+//
+// Every slot is guarded by a seqlock: the writer makes the slot's lock odd while it copies into it and
+//  even again when done. Readers map the ring read-only, look at a slot in place and afterwards check the
+//  lock is unchanged; if not, the writer lapped them and what they read may be torn. With N slots that
+//  only happens to a reader more than N - 1 frames behind. New frames are announced on a futex word in
+//  the ring header, so waiting readers cost nothing until then.
+
+const uint32_t SHM_RING_MAGIC = 0x52535354; // "TSSR"
+const uint32_t SHM_RING_VERSION = 1;
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotStride; // bytes from one slot header to the next
+    uint32_t rawWidth, rawHeight; // 0 when the ring carries no raw plane
+    uint32_t bgrWidth, bgrHeight; // 0 when the ring carries no BGR plane
+    uint32_t rawOffset, bgrOffset; // from the start of a slot
+    std::atomic<uint64_t> published; // frames written so far, the newest lives in slot (published - 1) % slotCount
+    std::atomic<uint32_t> futexWord; // bumped on every publish
+};
+
+struct alignas(64) ShmSlotHeader
+{
+    std::atomic<uint32_t> lock; // seqlock, odd while being written
+    uint32_t reserved;
+    uint64_t sequence;          // capture sequence number, as in FrameHeader
+    uint64_t captureTimeUs;
+    int32_t deviceTempSensor;
+};
+
+class ShmRingWriter
+{
+public:
+    ~ShmRingWriter();
+
+    // Either size may be empty to leave that plane out
+    bool create(const std::string &name, uint32_t slots, cv::Size rawSize, cv::Size bgrSize);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    void publish(const cv::Mat &raw, const cv::Mat &bgr, uint64_t sequence, uint64_t captureTimeUs, int deviceTempSensor);
+
+private:
+    std::string name;
+    void *mapping = nullptr;
+    std::size_t mappingSize = 0;
+    ShmRingHeader *header = nullptr;
+};
+
+// A frame looked at in place. raw and bgr point into the shared memory and are only trustworthy as long
+//  as ShmRingReader::valid() says so; clone() them to keep them around.
+struct ShmFrameView
+{
+    uint64_t sequence = 0;
+    uint64_t captureTimeUs = 0;
+    int deviceTempSensor = 0;
+    cv::Mat raw;
+    cv::Mat bgr;
+
+    uint32_t slot = 0;
+    uint32_t lock = 0;
+};
+
+class ShmRingReader
+{
+public:
+    ~ShmRingReader();
+
+    bool open(const std::string &name);
+    void close();
+
+    // Waits up to timeoutMs (-1 = forever) for a frame newer than the last one acquired and points view
+    //  at the newest one. Returns false on timeout.
+    bool acquire(ShmFrameView &view, int timeoutMs);
+
+    // True if the writer hasn't touched the view's slot since acquire()
+    bool valid(const ShmFrameView &view) const;
+
+    // Frames published while this reader wasn't looking
+    uint64_t skipped = 0;
+
+private:
+    void *mapping = nullptr;
+    std::size_t mappingSize = 0;
+    const ShmRingHeader *header = nullptr;
+    uint64_t lastSeen = 0;
+};
+
+#endif
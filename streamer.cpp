@@ -9,37 +9,63 @@
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
 #include <utility>
+#include <algorithm>
 #include <chrono>
+#include <memory>
+#include <thread>
 #include "args.h"
+#include "camera_rig.h"
+#include "event_clip.h"
+#include "frame_source.h"
+#include "process_frame.h"
+#include "multicast.h"
+#include "grey_frame.h"
+#include "parallel_jpeg.h"
+#include "protocol.h"
+#include "raw_codec.h"
+#include "recorder.h"
+#include "hotspot_tracker.h"
+#include "render_cache.h"
+#include "roi_index.h"
+#include "video_sink.h"
+#include "zone_alarm.h"
+#include "nuc.h"
+#include "shm_ring.h"
+#include "thermal.h"
 
 using namespace cv;
 using namespace LibSeek;
 
 // Setup sig handling
 static volatile sig_atomic_t sigflag = 0;
-
-enum CustomLineTypes
-{
-    LINE_AA = 16
-};
+// Bumped by SIGUSR1, every camera recaptures its NUC offsets when it sees it change
+static volatile sig_atomic_t offsetRecaptures = 0;
 
 enum OperationMode
 {
     ConnectToServer,
     WaitForCommand,
     SendImage,
+    FreeRun,
     Exit,
 };
 
 const auto DEFAULT_HOST = "127.0.0.1";
 const auto DEFAULT_PORT = 9000;
 
-double preAdd = -32.0;
-double multiplier = 5.0 / 9.0;
-double postAdd = 0;
+// Frames kept around an alarm, the ring is sized for the Compact Pro's frame rate
+const double DEFAULT_CLIP_SECONDS = 5.0;
+const double CLIP_MAX_FPS = 15.0;
+
+// Frame rate written into video files when the source doesn't set one, the Seek's own
+const double DEFAULT_VIDEO_FPS = 9.0;
+
+// Frames averaged to find bad pixels, about 10 seconds of a Seek
+const int DEFAULT_CALIBRATION_FRAMES = 100;
+
+// Frames averaged into new NUC offsets, about 3 seconds
+const int DEFAULT_OFFSET_FRAMES = 30;
 
-auto fireWarningText = "DEMAM";
-auto fireThresholdCelcius = 35;
 void connectToServer(sf::TcpSocket &socket, const char *remoteAddress, const int remotePort);
 
 std::stringstream getTime();
@@ -50,249 +76,895 @@ void handle_sig(int sig)
     sigflag = 1;
 }
 
-double device_sensor_to_k(double sensor)
+void handle_recapture_sig(int sig)
+{
+    (void)sig;
+    offsetRecaptures = offsetRecaptures + 1;
+}
+
+std::stringstream getTime()
+{
+    auto time = std::time(nullptr);
+
+    std::stringstream stringStream;
+
+    stringStream << localtime(&time)->tm_year + 1900
+                 << " " << localtime(&time)->tm_mon + 1
+                 << "/" << localtime(&time)->tm_mday
+                 << " " << localtime(&time)->tm_hour
+                 << ":" << localtime(&time)->tm_min
+                 << ":" << localtime(&time)->tm_sec;
+
+    return stringStream;
+}
+
+void connect(sf::TcpSocket &socket, const char *remoteAddress, const int remotePort)
+{
+    printf("Attempting to connect...\n");
+
+    while (true)
+    {
+        if (socket.connect(remoteAddress, remotePort) == sf::Socket::Done)
+        {
+            printf("Successfully connected...\n");
+            break;
+        }
+    }
+}
+
+void printSocketStatus(sf::Socket::Status &socketStatus)
+{
+    switch (socketStatus)
+    {
+    case sf::Socket::Done:
+        printf("DONE.\n");
+        break;
+    case sf::Socket::NotReady:
+        printf("NOT_READY.\n");
+        break;
+    case sf::Socket::Partial:
+        printf("PARTIAL.\n");
+        break;
+    case sf::Socket::Disconnected:
+        printf("DISCONNECTED.\n");
+        break;
+    case sf::Socket::Error:
+        printf("ERROR.\n");
+        break;
+    default:
+        printf("UNKNOWN.\n");
+        break;
+    }
+}
+
+// Sends an encoded payload behind the header format the server negotiated, version 0 being ":::%010lu"
+bool sendPayload(sf::TcpSocket &socket, const std::vector<uchar> &buffer, int headerVersion, FrameHeader &header)
+{
+    unsigned long imageSize = buffer.size() * sizeof(uchar);
+
+    char imageSizeText[100];
+    std::size_t headerSize;
+    if (headerVersion == 0)
+    {
+        sprintf(imageSizeText, ":::%0.10lu", imageSize);
+        headerSize = strlen(imageSizeText);
+    }
+    else
+    {
+        header.version = (uint8_t)headerVersion;
+        header.payloadSize = imageSize;
+        header.payloadCrc = crc32(buffer.data(), imageSize);
+        header.sendTimeUs = timestamp_us();
+        write_frame_header(header, (uint8_t *)imageSizeText);
+        headerSize = FRAME_HEADER_SIZE;
+    }
+
+    sf::Socket::Status socketStatus;
+
+    socketStatus = socket.send(imageSizeText, headerSize);
+    if ((socketStatus == sf::Socket::Disconnected) || (socketStatus == sf::Socket::Error))
+    {
+        return false;
+    }
+
+    socketStatus = socket.send(&buffer[0], imageSize);
+    if ((socketStatus == sf::Socket::Disconnected) || (socketStatus == sf::Socket::Error))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Sends a frame rendered for this connection, see renderFrame
+bool sendRendered(sf::TcpSocket &socket, const RenderedFrame &rendered, int payloadType, int headerVersion, FrameHeader &header)
 {
-    // formula from http://aterlux.ru/article/ntcresistor-en
-    double ref_temp = 297.0;    // 23C from table
-    double ref_sensor = 6616.0; // ref value from table
-    double beta = 200;          // best beta coef we've found
-    double part3 = log(sensor) - log(ref_sensor);
-    double parte = part3 / beta + 1.0 / ref_temp;
-    return 1.0 / parte;
+    header.payloadType = payloadType;
+    header.width = rendered.width;
+    header.height = rendered.height;
+
+    return sendPayload(socket, rendered.payload, headerVersion, header);
 }
 
-double temp_from_raw(int x, double device_k)
+// Sends the raw sensor frame through the lossless codec instead of the colorized JPEG
+bool sendRaw(sf::TcpSocket &socket, std::vector<uchar> &buffer, const cv::Mat &raw, RawEncoder &encoder, int headerVersion, FrameHeader &header)
 {
-    // Constants below are taken from linear trend line in Excel.
-    // -273 is translation of Kelvin to Celsius
-    // 330 is max temperature supported by Seek device
-    // 16384 is full 14 bits value, max possible ()
-    double base = x * 330 / 16384.0;
-    double lin_k = -1.5276;        // derived from Excel linear model
-    double lin_offset = -470.8979; // same Excel model
-
-    auto fahrenheit = base - device_k * lin_k + lin_offset - 273.0;
-    return ((fahrenheit + preAdd) * multiplier) + postAdd;
+    encoder.encode(raw, buffer);
+
+    header.payloadType = PAYLOAD_RAW16_DELTA;
+    header.width = raw.cols;
+    header.height = raw.rows;
+
+    return sendPayload(socket, buffer, headerVersion, header);
 }
 
-void overlay_values(Mat &outframe, Point coord, const Scalar &color)
+// 'V', 'P' and 'R' change how frames go out rather than which ones, returns false for any other command
+bool applyConnectionSetting(const Command &command, int &headerVersion, int &payloadType, RenderParams &render, RawEncoder &encoder)
 {
-    int gap = 2;
-    int arrLen = 7;
-    int weight = 1;
-    line(outframe, coord - Point(-arrLen, -arrLen), coord - Point(-gap, -gap), color, weight);
-    line(outframe, coord - Point(arrLen, arrLen), coord - Point(gap, gap), color, weight);
-    line(outframe, coord - Point(-arrLen, arrLen), coord - Point(-gap, gap), color, weight);
-    line(outframe, coord - Point(arrLen, -arrLen), coord - Point(gap, -gap), color, weight);
+    if (command.type == CommandType::SetHeaderVersion)
+    {
+        headerVersion = command.headerVersion;
+        return true;
+    }
+    if (command.type == CommandType::SetPayloadType)
+    {
+        payloadType = command.payloadType;
+        encoder.reset();
+        return true;
+    }
+    if (command.type == CommandType::SetRender)
+    {
+        render = command.render;
+        return true;
+    }
+    return false;
 }
 
-void draw_temp(Mat &outframe, double temp, const Point &coord, Scalar color)
+// Answers a 'Q' with the statistics of its rectangle on the latest frame, returns false when the send failed
+bool answerQuery(sf::TcpSocket &socket, const Command &command, const RoiIndexPublisher &roi, bool enabled, int headerVersion,
+                 std::vector<uchar> &buffer)
 {
-    char txt[64];
-    sprintf(txt, "%5.1f", temp);
-    putText(outframe, txt, coord - Point(40, -20), FONT_HERSHEY_COMPLEX, 1, std::move(color), 2, CustomLineTypes::LINE_AA);
+    std::shared_ptr<const RoiIndex> index = roi.latest();
+    std::string json = enabled ? roi_stats_json(index.get(), cv::Rect(command.x, command.y, command.width, command.height))
+                               : "{\"error\":\"queries need --roi-queries\"}";
+    buffer.assign(json.begin(), json.end());
+
+    FrameHeader header;
+    header.payloadType = PAYLOAD_METADATA;
+    header.sequence = index ? index->sequence : 0;
+    header.captureTimeUs = timestamp_us();
+    return sendPayload(socket, buffer, headerVersion, header);
 }
 
-void draw_text(Mat &outframe, const char *text, const Point &coord, Scalar color)
+// Copies the frame into the shared memory ring, creating it on the first frame once the sizes are known
+void publishLocal(ShmRingWriter &ring, const std::string &name, int slots, const std::string &planes,
+                  const cv::Mat &raw, const cv::Mat &processed, const FrameHeader &header, int deviceTempSensor)
+{
+    if (!ring.isOpen())
+    {
+        cv::Size rawSize = planes != "bgr" ? raw.size() : cv::Size();
+        cv::Size bgrSize = planes != "raw" ? processed.size() : cv::Size();
+        if (!ring.create(name, slots, rawSize, bgrSize))
+        {
+            return;
+        }
+    }
+
+    ring.publish(raw, processed, header.sequence, header.captureTimeUs, deviceTempSensor);
+}
+
+// Reads a command byte and its argument. Unless blocking, returns NotReady when nothing has been sent.
+//  A hello is answered and switches extended on for the connection, until then every byte is one frame.
+sf::Socket::Status receiveCommand(sf::TcpSocket &socket, Command &command, bool &extended, bool block)
+{
+    char commandByte;
+    std::size_t receivedCount;
+    sf::Socket::Status socketStatus;
+
+    while (true)
+    {
+        socket.setBlocking(block);
+        socketStatus = socket.receive(&commandByte, 1, receivedCount);
+        socket.setBlocking(true);
+        if (socketStatus != sf::Socket::Done)
+        {
+            return socketStatus;
+        }
+        if (commandByte != COMMAND_HELLO)
+        {
+            break;
+        }
+
+        extended = true;
+        socketStatus = socket.send(&COMMAND_HELLO_ACK, 1);
+        if (socketStatus != sf::Socket::Done)
+        {
+            return socketStatus;
+        }
+    }
+
+    // The argument digits are sent together with the command byte, wait for all of them
+    char argument[COMMAND_MAX_ARGUMENT_LENGTH];
+    std::size_t argumentLength = command_argument_length(commandByte, extended);
+    std::size_t receivedCountSum = 0;
+    while (receivedCountSum < argumentLength)
+    {
+        socketStatus = socket.receive(argument + receivedCountSum, argumentLength - receivedCountSum, receivedCount);
+        if (socketStatus != sf::Socket::Done)
+        {
+            return socketStatus;
+        }
+        receivedCountSum += receivedCount;
+    }
+
+    command = parse_command(commandByte, argument, extended);
+    return sf::Socket::Done;
+}
+
+void printConnectingToServerInfo() {
+    std::cout << "Diconnected from the server." << std::endl;
+    std::cout << "Attempting to connect to the server..." << std::endl;
+}
+
+void writeLogMessage(char const *logMessage) {
+    // std::cout << logMessage << std::endl;
+}
+
+// Everything besides the server connection that frames can go to, as given on the command line
+struct OutputOptions
+{
+    std::string multicastGroup; // empty for no multicast
+    int multicastPort = 0;
+    int multicastTtl = 1;
+    int mtu = MULTICAST_DEFAULT_MTU;
+    std::string multicastInterface;
+    uint8_t multicastPayload = PAYLOAD_JPEG; // or PAYLOAD_RAW16_DELTA, PAYLOAD_GREY_JPEG
+    std::string shmName;        // empty for no shared memory ring
+    int shmSlots = 4;
+    std::string shmPlanes = "both";
+    std::string recordPrefix;   // empty for no recording
+    uint64_t recordSegmentFrames = RECORDING_DEFAULT_SEGMENT_FRAMES;
+    bool recordCompress = false;
+    std::string clipPrefix;     // empty for no alarm clips
+    double clipPre = DEFAULT_CLIP_SECONDS;
+    double clipPost = DEFAULT_CLIP_SECONDS;
+    VideoSinkOptions video;     // no video files unless video.path is set
+    double rangeHysteresis = 0.5; // Celcius, see ColormapCache
+    bool fixedRange = false;      // colors over fixedLow..fixedHigh Celcius instead of the frame's range
+    double fixedLow = 0;
+    double fixedHigh = 0;
+    RenderParams render;          // how frames are rendered for the outputs, clients pick their own
+    bool roiQueries = false;      // index every frame for 'Q' commands
+    std::vector<Zone> zones;      // alarm zones, in raw sensor pixels
+    std::string alarmTarget;      // host:port the zone alarm events go to, empty for stdout only
+    bool hotspots = false;        // mark every blob over hotspotCelcius, not just the hottest pixel
+    double hotspotCelcius = 0;
+    std::string nucPath;          // NUC tables, empty for no non-uniformity correction
+
+    bool any() const
+    {
+        return !multicastGroup.empty() || !shmName.empty() || !recordPrefix.empty() || !clipPrefix.empty() || !video.path.empty() ||
+               !zones.empty();
+    }
+};
+
+// One camera's outputs and the scratch its frames go through. Used by one thread at a time.
+struct CameraOutputs
 {
-    putText(outframe, text, coord - Point(40, -20), FONT_HERSHEY_COMPLEX, 1, std::move(color), 2, CustomLineTypes::LINE_AA);
+    int cameraId = 0;
+    std::string shmName;
+    MulticastSender multicast;
+    RawEncoder multicastEncoder;
+    ParallelJpegEncoder jpeg;
+    ColormapCache palette;
+    ShmRingWriter ring;
+    Recorder recorder;
+    EventClipRecorder clips;
+    VideoSink video;
+    RoiIndexPublisher roi;
+    ZoneAlarms zones;
+    AlarmChannel alarmChannel;
+    std::vector<ZoneEvent> zoneEvents;
+    HotspotDetector hotspots;
+    HotspotTracker tracker;
+    TrackAlarm trackAlarms[MAX_TRACKS];
+    bool detectHotspots = false;
+    NonUniformityCorrection nuc;
+    int offsetRecapturesSeen = 0;
+
+    FrameAnalysis analysis; // of the frame with analysisSequence, shared by every rendering of it
+    uint32_t analysisSequence = 0;
+    bool haveAnalysis = false;
+    cv::Mat grey, processed;
+    FrameStats stats;
+    cv::Mat renderGrey, renderProcessed; // scratch of renderFrame
+    std::vector<uchar> buffer;
+};
+
+// Tells the outputs of several cameras apart: "rec" -> "rec_cam1", with the extension kept "out/a.mp4" -> "out/a_cam1.mp4"
+std::string cameraPath(const std::string &path, int cameraId, bool keepExtension)
+{
+    std::string suffix = "_cam" + std::to_string(cameraId);
+    auto dot = path.rfind('.');
+    auto slash = path.rfind('/');
+    if (keepExtension && dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        return path.substr(0, dot) + suffix + path.substr(dot);
+    }
+    return path + suffix;
 }
 
-// Function to process a raw (corrected) seek frame
-void process_frame(Mat &inframe, Mat &outframe, float scale, int colormap, int rotate, int device_temp_sensor)
+// With perCamera set every camera gets its own files, ring and multicast port (base port + camera id)
+bool openOutputs(CameraOutputs &outputs, const OutputOptions &options, int cameraId, bool perCamera, cv::Size rawSize)
 {
-    Mat frame_g8_nograd, frame_g16; // Transient Mat containers for processing
+    outputs.cameraId = cameraId;
+    outputs.palette.hysteresisCelcius = options.rangeHysteresis;
+    outputs.palette.fixed = options.fixedRange;
+    outputs.palette.fixedLowCelcius = options.fixedLow;
+    outputs.palette.fixedHighCelcius = options.fixedHigh;
+
+    outputs.detectHotspots = options.hotspots;
+    outputs.hotspots.thresholdCelcius = options.hotspotCelcius;
+    outputs.tracker.alarmCelcius = fireThresholdCelcius;
+    outputs.zones.setup(options.zones, rawSize);
+    if (!options.nucPath.empty() && !outputs.nuc.load(perCamera ? cameraPath(options.nucPath, cameraId, true) : options.nucPath))
+    {
+        return false;
+    }
+    if (!options.alarmTarget.empty() && !outputs.alarmChannel.open(options.alarmTarget))
+    {
+        return false;
+    }
 
-    // get raw max/min/central values
-    double min, max, central;
-    minMaxIdx(inframe, &min, &max);
-    Scalar valat = inframe.at<uint16_t>(Point(inframe.cols / 2.0, inframe.rows / 2.0));
-    central = valat[0];
+    if (!options.multicastGroup.empty())
+    {
+        int port = options.multicastPort + (perCamera ? cameraId : 0);
+        if (!outputs.multicast.open(options.multicastGroup, port, options.multicastTtl, options.mtu, options.multicastInterface))
+        {
+            std::cerr << "Could not set up multicast output to " << options.multicastGroup << ":" << port << std::endl;
+            return false;
+        }
+        outputs.multicast.cameraId = cameraId;
+    }
 
-    double device_k = device_sensor_to_k(device_temp_sensor);
+    outputs.shmName = perCamera ? cameraPath(options.shmName, cameraId, false) : options.shmName;
 
-    double mintemp = temp_from_raw(min, device_k);
-    double maxtemp = temp_from_raw(max, device_k);
-    double centraltemp = temp_from_raw(central, device_k);
+    // Raw frames go to disk from a writer thread, a slow disk drops frames rather than stalling capture
+    if (!options.recordPrefix.empty())
+    {
+        std::string prefix = perCamera ? cameraPath(options.recordPrefix, cameraId, false) : options.recordPrefix;
+        outputs.recorder.start(prefix, options.recordSegmentFrames, RECORDER_QUEUE_DEPTH, options.recordCompress);
+    }
 
-    // printf("rmin,rmax,central,devtempsns: %d %d %d %d\t", (int)min, (int)max, (int)central, (int)device_temp_sensor);
-    // printf("min-max-center-device: %.1f %.1f %.1f %.1f\n", mintemp, maxtemp, centraltemp, device_k - 273.0);
+    if (!options.clipPrefix.empty())
+    {
+        std::string prefix = perCamera ? cameraPath(options.clipPrefix, cameraId, false) : options.clipPrefix;
+        outputs.clips.start(prefix, options.clipPre, options.clipPost, CLIP_MAX_FPS, rawSize);
+    }
 
-    normalize(inframe, frame_g16, 0, 65535, NORM_MINMAX);
+    // Video files are encoded on their own thread and drop frames rather than hold up the live output
+    if (!options.video.path.empty())
+    {
+        VideoSinkOptions video = options.video;
+        if (perCamera)
+        {
+            video.path = cameraPath(video.path, cameraId, true);
+        }
+        if (!outputs.video.start(video))
+        {
+            return false;
+        }
+    }
 
-    // Convert seek CV_16UC1 to CV_8UC1
-    frame_g16.convertTo(frame_g8_nograd, CV_8UC1, 1.0 / 256.0);
+    return true;
+}
 
-    // Rotate image
-    if (rotate == 90)
+// Starts averaging the next frames into new NUC offsets, 0 frames for the default
+void recaptureOffsets(CameraOutputs &outputs, const OutputOptions &options, int frames)
+{
+    if (options.nucPath.empty())
     {
-        transpose(frame_g8_nograd, frame_g8_nograd);
-        flip(frame_g8_nograd, frame_g8_nograd, 1);
+        std::cerr << "NUC offsets can only be recaptured with --nuc" << std::endl;
+        return;
     }
-    else if (rotate == 180)
+    frames = frames > 0 ? frames : DEFAULT_OFFSET_FRAMES;
+    std::cout << "Camera " << outputs.cameraId << ": recapturing NUC offsets over " << frames << " frames" << std::endl;
+    outputs.nuc.recapture(frames);
+}
+
+// Works out the frame's range, grey levels and hotspots, once however many ways it gets rendered
+void analyzeFrame(CameraOutputs &outputs, cv::Mat &raw, int deviceTempSensor, uint32_t sequence, WorkerPool &pool)
+{
+    if (outputs.haveAnalysis && outputs.analysisSequence == sequence)
     {
-        flip(frame_g8_nograd, frame_g8_nograd, -1);
+        return;
     }
-    else if (rotate == 270)
+    analyze_frame(raw, deviceTempSensor, outputs.analysis, &pool, &outputs.palette, outputs.detectHotspots ? &outputs.hotspots : nullptr);
+    outputs.analysisSequence = sequence;
+    outputs.haveAnalysis = true;
+}
+
+// Processes a captured frame into outputs.grey and outputs.processed, in row bands on the pool, and hands it
+//  to every output. Only as far as the outputs need: clips only want the alarm, grey multicast no colors.
+void publishFrame(CameraOutputs &outputs, const OutputOptions &options, cv::Mat &raw, const FrameHeader &header, int deviceTempSensor, WorkerPool &pool)
+{
+    // Non-uniformity correction goes first, everything after it, recordings included, gets the corrected frame
+    if (!options.nucPath.empty())
+    {
+        if (outputs.offsetRecapturesSeen != offsetRecaptures)
+        {
+            outputs.offsetRecapturesSeen = offsetRecaptures;
+            recaptureOffsets(outputs, options, 0);
+        }
+        if (outputs.nuc.apply(raw))
+        {
+            std::cout << "Camera " << outputs.cameraId << ": NUC offsets recaptured" << std::endl;
+        }
+    }
+
+    if (!options.recordPrefix.empty())
     {
-        transpose(frame_g8_nograd, frame_g8_nograd);
-        flip(frame_g8_nograd, frame_g8_nograd, 0);
+        outputs.recorder.record(raw, header.sequence, header.captureTimeUs, deviceTempSensor);
     }
 
-    Point minp, maxp, centralp;
-    minMaxLoc(frame_g8_nograd, NULL, NULL, &minp, &maxp); // doing it here, so we take rotation into account
-    centralp = Point(frame_g8_nograd.cols / 2.0, frame_g8_nograd.rows / 2.0);
-    minp *= scale;
-    maxp *= scale;
-    centralp *= scale;
+    if (options.roiQueries)
+    {
+        outputs.roi.publish(raw, deviceTempSensor, header.sequence, &pool);
+    }
+
+    const RenderParams &render = options.render;
+    bool colorize = !options.video.path.empty() || (!options.shmName.empty() && options.shmPlanes != "raw") ||
+                    (!options.multicastGroup.empty() && options.multicastPayload == PAYLOAD_JPEG);
+    bool grey = colorize || !options.clipPrefix.empty() || (!options.multicastGroup.empty() && options.multicastPayload == PAYLOAD_GREY_JPEG);
+    if (grey || outputs.detectHotspots)
+    {
+        analyzeFrame(outputs, raw, deviceTempSensor, header.sequence, pool);
+    }
 
-    // Resize image: http://docs.opencv.org/3.2.0/da/d54/group__imgproc__transform.html#ga5bb5a1fea74ea38e1a5445ca803ff121
-    // Note this is expensive computationally, only do if option set != 1
-    if (scale != 1.0)
-        resize(frame_g8_nograd, frame_g8_nograd, Size(), scale, scale, INTER_LINEAR);
+    // Hotspots alarm once per track, however many frames the person stays in view. Tracked before any
+    //  rendering, so every rendering's markers carry their track ids.
+    if (outputs.detectHotspots)
+    {
+        FrameStats &analyzed = outputs.analysis.stats;
+        int alarms = outputs.tracker.update(analyzed.hotspots, analyzed.hotspotCount, outputs.trackAlarms);
+        for (int i = 0; i < alarms; i++)
+        {
+            const TrackAlarm &alarm = outputs.trackAlarms[i];
+            std::cout << "Camera " << outputs.cameraId << ": hotspot " << alarm.id << " alarm, peak " << alarm.peakCelcius << std::endl;
+            outputs.alarmChannel.send(track_alarm_json(alarm, outputs.cameraId, header.sequence, header.captureTimeUs));
+        }
+    }
+    if (grey)
+    {
+        render_frame_grey(outputs.analysis, outputs.grey, render.scale, render.rotate, outputs.stats, &pool);
+    }
+    if (colorize)
+    {
+        colorize_frame(outputs.grey, outputs.processed, render.colormap, outputs.stats, &pool, &outputs.palette, render.overlays);
+    }
+
+    // Zone alarms go out as soon as they change, ahead of everything that has to wait for the frame
+    bool zoneAlarm = false;
+    if (!outputs.zones.empty())
+    {
+        outputs.zoneEvents.clear();
+        zoneAlarm = outputs.zones.evaluate(raw, deviceTempSensor, header.sequence, header.captureTimeUs, outputs.zoneEvents);
+        for (const ZoneEvent &event : outputs.zoneEvents)
+        {
+            std::cout << "Camera " << outputs.cameraId << ": zone " << event.zone << (event.raised ? " alarm" : " clear") << ", max "
+                      << event.max << " mean " << event.mean << std::endl;
+            outputs.alarmChannel.send(zone_event_json(event, outputs.cameraId));
+        }
+    }
+
+    if (!options.clipPrefix.empty())
+    {
+        outputs.clips.push(raw, header.sequence, header.captureTimeUs, deviceTempSensor, outputs.stats.alarm || zoneAlarm);
+    }
+
+    if (!options.video.path.empty())
+    {
+        outputs.video.push(outputs.processed);
+    }
+
+    if (!options.shmName.empty())
+    {
+        publishLocal(outputs.ring, outputs.shmName, options.shmSlots, options.shmPlanes, raw, outputs.processed, header, deviceTempSensor);
+    }
 
-    // add gradient
-    Mat frame_g8(Size(frame_g8_nograd.cols + 20, frame_g8_nograd.rows), CV_8U, Scalar(128));
-    for (int r = 0; r < frame_g8.rows - 1; r++)
+    if (!options.multicastGroup.empty())
     {
-        frame_g8.row(r).setTo(255.0 * (frame_g8.rows - r) / ((float)frame_g8.rows));
+        if (options.multicastPayload == PAYLOAD_RAW16_DELTA)
+        {
+            outputs.multicastEncoder.encode(raw, outputs.buffer);
+        }
+        else if (options.multicastPayload == PAYLOAD_GREY_JPEG)
+        {
+            encode_grey_frame(outputs.grey, options.render.colormap, outputs.stats, outputs.jpeg, &pool, outputs.buffer, options.render.overlays);
+        }
+        else
+        {
+            outputs.jpeg.encode(outputs.processed, outputs.buffer, &pool);
+        }
+        if (!outputs.multicast.send(header.sequence, options.multicastPayload, outputs.buffer.data(), outputs.buffer.size()))
+        {
+            writeLogMessage("Failed to send multicast frame.");
+        }
     }
-    frame_g8_nograd.copyTo(frame_g8(Rect(0, 0, frame_g8_nograd.cols, frame_g8_nograd.rows)));
+}
 
-    // Apply colormap: http://docs.opencv.org/3.2.0/d3/d50/group__imgproc__colormap.html#ga9a805d8262bcbe273f16be9ea2055a65
-    if (colormap != -1)
+// Renders a frame the way a client asked for it and encodes it as a JPEG or a grey JPEG. Only the rotation,
+//  scaling and colors are per rendering, the frame is analysed once (see analyzeFrame).
+void renderFrame(CameraOutputs &outputs, cv::Mat &raw, int deviceTempSensor, uint32_t sequence, const RenderParams &render, int payloadType,
+                 WorkerPool &pool, RenderedFrame &rendered)
+{
+    analyzeFrame(outputs, raw, deviceTempSensor, sequence, pool);
+    FrameStats stats;
+    render_frame_grey(outputs.analysis, outputs.renderGrey, render.scale, render.rotate, stats, &pool);
+    if (payloadType == PAYLOAD_GREY_JPEG)
     {
-        applyColorMap(frame_g8, outframe, colormap);
+        encode_grey_frame(outputs.renderGrey, render.colormap, stats, outputs.jpeg, &pool, rendered.payload, render.overlays);
     }
     else
     {
-        cv::cvtColor(frame_g8, outframe, cv::COLOR_GRAY2BGR);
+        colorize_frame(outputs.renderGrey, outputs.renderProcessed, render.colormap, stats, &pool, &outputs.palette, render.overlays);
+        outputs.jpeg.encode(outputs.renderProcessed, rendered.payload, &pool);
+    }
+    rendered.width = outputs.renderGrey.cols;
+    rendered.height = outputs.renderGrey.rows;
+}
+
+// Flushes the writers and prints what they did, label goes in front of every line
+void closeOutputs(CameraOutputs &outputs, const OutputOptions &options, const std::string &label)
+{
+    if (!options.recordPrefix.empty())
+    {
+        outputs.recorder.stop();
+        std::cout << label << outputs.recorder.framesWritten << " frames recorded, " << outputs.recorder.framesDropped << " dropped" << std::endl;
+    }
+    if (!options.video.path.empty())
+    {
+        outputs.video.stop();
+        std::cout << label << outputs.video.framesWritten << " video frames in " << outputs.video.segmentsWritten << " files, " << outputs.video.framesDropped << " dropped" << std::endl;
     }
+}
 
-    // overlay marks
-    draw_temp(outframe, mintemp, Point(outframe.cols - 49, outframe.rows - 29), Scalar(255, 255, 255));
-    draw_temp(outframe, mintemp, Point(outframe.cols - 51, outframe.rows - 31), Scalar(0, 0, 0));
-    draw_temp(outframe, mintemp, Point(outframe.cols - 50, outframe.rows - 30), Scalar(255, 0, 0));
+// Starts the pool process_frame splits frames over. OpenCV's own threads would only compete with its
+//  workers for the cores, the bands run single threaded.
+void startWorkers(WorkerPool &pool, int workers, bool pinWorkers)
+{
+    cv::setNumThreads(0);
+    pool.start(workers, pinWorkers);
+}
 
-    draw_temp(outframe, maxtemp, Point(outframe.cols - 49, 0), Scalar(255, 255, 255));
-    draw_temp(outframe, maxtemp, Point(outframe.cols - 51, 2), Scalar(0, 0, 0));
-    draw_temp(outframe, maxtemp, Point(outframe.cols - 50, 1), Scalar(0, 0, 255));
+// Per worker share of the time spent running tasks, and how many it took off other workers
+void printWorkerStats(const WorkerPool &pool)
+{
+    auto stats = pool.stats();
+    for (std::size_t i = 0; i < stats.size(); i++)
+    {
+        std::cout << "Worker " << i << ": " << (int)(stats[i].utilization * 100 + 0.5) << "% busy, "
+                  << stats[i].tasks << " tasks, " << stats[i].stolen << " stolen" << std::endl;
+    }
+}
 
-    draw_temp(outframe, centraltemp, centralp + Point(-1, -1), Scalar(255, 255, 255));
-    draw_temp(outframe, centraltemp, centralp + Point(1, 1), Scalar(0, 0, 0));
-    draw_temp(outframe, centraltemp, centralp + Point(0, 0), Scalar(128, 128, 128));
+// Averages frames of an evenly warm scene into a bad pixel map, see bad_pixels.h
+int calibrateBadPixels(FrameSource &source, int frames, const std::string &path)
+{
+    std::cout << "Point the camera at something evenly warm, a lens cap or a wall. Capturing " << frames << " frames..." << std::endl;
 
-    overlay_values(outframe, centralp + Point(-1, -1), Scalar(0, 0, 0));
-    overlay_values(outframe, centralp + Point(1, 1), Scalar(255, 255, 255));
-    overlay_values(outframe, centralp, Scalar(128, 128, 128));
+    BadPixelCalibration calibration;
+    Mat raw;
+    while (!sigflag && calibration.frames < frames && source.read(raw))
+    {
+        calibration.add(raw);
+    }
 
-    overlay_values(outframe, minp + Point(-1, -1), Scalar(0, 0, 0));
-    overlay_values(outframe, minp + Point(1, 1), Scalar(255, 255, 255));
-    overlay_values(outframe, minp, Scalar(255, 0, 0));
+    BadPixelMap map;
+    if (!calibration.finish(map) || !map.save(path))
+    {
+        return 1;
+    }
 
-    overlay_values(outframe, maxp + Point(-1, -1), Scalar(0, 0, 0));
-    overlay_values(outframe, maxp + Point(1, 1), Scalar(255, 255, 255));
-    overlay_values(outframe, maxp, Scalar(0, 0, 255));
+    std::cout << map.pixels.size() << " bad pixels in " << calibration.frames << " frames, saved to " << path << std::endl;
+    if (map.pixels.size() * 100 > (std::size_t)map.size.area())
+    {
+        std::cout << "That's over 1% of the sensor, the scene probably wasn't even enough" << std::endl;
+    }
+    return 0;
+}
 
-    if (maxtemp > fireThresholdCelcius)
+// Two flat fields, a cool and a warm one, into non-uniformity correction tables, see nuc.h
+int calibrateNuc(FrameSource &source, int frames, const std::string &path)
+{
+    FlatField cool, warm;
+    Mat raw;
+    std::cout << "Point the camera at something evenly cool, a lens cap or a wall. Capturing " << frames << " frames..." << std::endl;
+    while (!sigflag && cool.frames < frames && source.read(raw))
+    {
+        cool.add(raw);
+    }
+
+    std::cout << "Now at something evenly warm, a few degrees or more above it, and press Enter" << std::endl;
+    std::cin.get();
+    while (!sigflag && warm.frames < frames && source.read(raw))
+    {
+        warm.add(raw);
+    }
+    if (cool.frames == 0 || warm.frames == 0)
+    {
+        return 1;
+    }
+
+    NonUniformityCorrection nuc;
+    if (!nuc.calibrate(cool.mean(), warm.mean()))
+    {
+        std::cout << "The two flat fields are too close together for gains, only the offsets are corrected" << std::endl;
+    }
+    if (!nuc.save(path))
+    {
+        return 1;
+    }
+    std::cout << "NUC tables from " << cool.frames << " + " << warm.frames << " frames saved to " << path << std::endl;
+    return 0;
+}
+
+// Several cameras at once: a capture thread per camera, processing and encoding on a shared worker pool.
+//  Frames only go to the local and multicast outputs, the server protocol drives a single camera. Camera
+//  ids are positions in sources; with skipUnopened a camera that can't be opened is left out with a
+//  warning, and the others keep their ids.
+int runCameraRig(const std::vector<FrameSourceOptions> &sources, const OutputOptions &options, int workers, bool pinWorkers, bool skipUnopened)
+{
+    if (!options.any())
+    {
+        std::cerr << "Several cameras need --multicast, --shm, --record, --clip or --video to send their frames to" << std::endl;
+        return 1;
+    }
+
+    // Declared so the rig stops before the pool, and both before the outputs they feed
+    std::vector<std::unique_ptr<CameraOutputs>> outputs;
+    WorkerPool pool;
+    CameraRig rig;
+
+    for (std::size_t i = 0; i < sources.size(); i++)
+    {
+        auto source = create_frame_source(sources[i]);
+        if (!source)
+        {
+            std::cerr << "Unknown frame source " << sources[i].kind << std::endl;
+            return 1;
+        }
+
+        Mat first;
+        if (!source->open() || !source->read(first))
+        {
+            std::cerr << (skipUnopened ? "Skipping camera " : "Error accessing camera ") << i << " (" << sources[i].kind << " "
+                      << sources[i].device << ")" << std::endl;
+            if (skipUnopened)
+            {
+                continue;
+            }
+            return 1;
+        }
+
+        outputs.emplace_back(new CameraOutputs());
+        if (!openOutputs(*outputs.back(), options, (int)i, true, first.size()))
+        {
+            return 1;
+        }
+        rig.add(std::move(source));
+    }
+    if (rig.size() == 0)
     {
-        draw_text(outframe, fireWarningText, maxp + Point(-1, -1), Scalar(255, 255, 255));
-        draw_text(outframe, fireWarningText, maxp + Point(1, 1), Scalar(0, 0, 0));
-        draw_text(outframe, fireWarningText, maxp + Point(0, 0), Scalar(0, 0, 255));
+        std::cerr << "None of the cameras could be opened" << std::endl;
+        return 1;
     }
-}
 
-std::stringstream getTime()
-{
-    auto time = std::time(nullptr);
+    startWorkers(pool, workers, pinWorkers);
+    rig.start(pool, [&outputs, &options, &pool](int camera, cv::Mat &raw, uint32_t sequence, uint64_t captureTimeUs, int deviceTempSensor) {
+        FrameHeader header;
+        header.sequence = sequence;
+        header.captureTimeUs = captureTimeUs;
+        header.cameraId = outputs[camera]->cameraId;
+        publishFrame(*outputs[camera], options, raw, header, deviceTempSensor, pool);
+    });
+    std::cout << "Driving " << rig.size() << " cameras on " << pool.size() << " workers" << std::endl;
+
+    while (!sigflag && rig.active())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
 
-    std::stringstream stringStream;
+    rig.stop();
+    printWorkerStats(pool);
+    pool.stop();
 
-    stringStream << localtime(&time)->tm_year + 1900
-                 << " " << localtime(&time)->tm_mon + 1
-                 << "/" << localtime(&time)->tm_mday
-                 << " " << localtime(&time)->tm_hour
-                 << ":" << localtime(&time)->tm_min
-                 << ":" << localtime(&time)->tm_sec;
+    for (int i = 0; i < rig.size(); i++)
+    {
+        std::string label = "Camera " + std::to_string(outputs[i]->cameraId) + ": ";
+        std::cout << label << rig.stats(i).captured << " frames captured, " << rig.stats(i).dropped << " dropped while the workers were busy" << std::endl;
+        closeOutputs(*outputs[i], options, label);
+    }
 
-    return stringStream;
+    return 0;
 }
 
-void connect(sf::TcpSocket &socket, const char *remoteAddress, const int remotePort)
+// A client of --listen, on its own connection with the same protocol as the server connection
+struct ListenClient
 {
-    printf("Attempting to connect...\n");
+    std::unique_ptr<sf::TcpSocket> socket;
+    int framesRemaining = 0; // -1 while subscribed
+    std::chrono::steady_clock::duration interval = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::time_point nextFrame;
+    bool extended = false; // sent the hello
+    int headerVersion = 0;
+    int payloadType = PAYLOAD_JPEG;
+    RenderParams render;
+    RawEncoder rawEncoder;
+    std::vector<uchar> buffer;
+    bool connected = true;
+};
 
+// Takes every command a client has sent so far, returns false once it has gone
+bool serviceClient(ListenClient &client, CameraOutputs &outputs, const OutputOptions &options)
+{
+    Command command;
     while (true)
     {
-        if (socket.connect(remoteAddress, remotePort) == sf::Socket::Done)
+        sf::Socket::Status socketStatus = receiveCommand(*client.socket, command, client.extended, false);
+        if (socketStatus == sf::Socket::NotReady)
         {
-            printf("Successfully connected...\n");
-            break;
+            return true;
+        }
+        if (socketStatus != sf::Socket::Done)
+        {
+            return false;
+        }
+
+        if (applyConnectionSetting(command, client.headerVersion, client.payloadType, client.render, client.rawEncoder))
+        {
+            continue;
+        }
+        if (command.type == CommandType::Query)
+        {
+            if (!answerQuery(*client.socket, command, outputs.roi, options.roiQueries, client.headerVersion, client.buffer))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (command.type == CommandType::RecaptureOffsets)
+        {
+            recaptureOffsets(outputs, options, command.offsetFrames);
+            continue;
         }
+
+        client.framesRemaining = command.count;
+        client.interval = command.fps > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / command.fps))
+                                          : std::chrono::steady_clock::duration::zero();
+        client.nextFrame = std::chrono::steady_clock::now();
     }
 }
 
-void printSocketStatus(sf::Socket::Status &socketStatus)
+// Serves any number of clients connecting to port, each with its own stream, payload and rendering. A frame
+//  is rendered once per distinct rendering asked for and shared by every client that wants it. Sends
+//  block, so one slow client holds up the others.
+int runListenServer(FrameSource &source, const OutputOptions &options, int port, int workers, bool pinWorkers, cv::Size rawSize)
 {
-    switch (socketStatus)
+    sf::TcpListener listener;
+    if (listener.listen(port) != sf::Socket::Done)
     {
-    case sf::Socket::Done:
-        printf("DONE.\n");
-        break;
-    case sf::Socket::NotReady:
-        printf("NOT_READY.\n");
-        break;
-    case sf::Socket::Partial:
-        printf("PARTIAL.\n");
-        break;
-    case sf::Socket::Disconnected:
-        printf("DISCONNECTED.\n");
-        break;
-    case sf::Socket::Error:
-        printf("ERROR.\n");
-        break;
-    default:
-        printf("UNKNOWN.\n");
-        break;
+        std::cerr << "Could not listen on port " << port << std::endl;
+        return 1;
     }
-}
+    listener.setBlocking(false);
 
-bool sendImage(sf::TcpSocket &socket, std::vector<uchar> &buffer, cv::Mat &source)
-{
-    cv::imencode("image.jpeg", source, buffer);
-    unsigned long imageSize = buffer.size() * sizeof(uchar);
+    CameraOutputs outputs;
+    if (!openOutputs(outputs, options, 0, false, rawSize))
+    {
+        return 1;
+    }
 
-    char imageSizeText[100];
-    sprintf(imageSizeText, ":::%0.10lu", imageSize);
+    WorkerPool pool;
+    startWorkers(pool, workers, pinWorkers);
 
-    sf::Socket::Status socketStatus;
+    RenderCache cache;
+    std::vector<std::unique_ptr<ListenClient>> clients;
+    Mat raw;
+    uint32_t frameSequence = 0;
+    std::cout << "Listening for clients on port " << port << std::endl;
 
-    socketStatus = socket.send(imageSizeText, strlen(imageSizeText));
-    if ((socketStatus == sf::Socket::Disconnected) || (socketStatus == sf::Socket::Error))
+    while (!sigflag)
     {
-        return false;
-    }
+        std::unique_ptr<sf::TcpSocket> socket(new sf::TcpSocket());
+        while (listener.accept(*socket) == sf::Socket::Done)
+        {
+            std::cout << "Client " << socket->getRemoteAddress().toString() << ":" << socket->getRemotePort() << " connected" << std::endl;
+            clients.emplace_back(new ListenClient());
+            clients.back()->socket = std::move(socket);
+            socket.reset(new sf::TcpSocket());
+        }
 
-    socketStatus = socket.send(&buffer[0], imageSize);
-    if ((socketStatus == sf::Socket::Disconnected) || (socketStatus == sf::Socket::Error))
-    {
-        return false;
-    }
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [&](const std::unique_ptr<ListenClient> &client) {
+                          return !client->connected || !serviceClient(*client, outputs, options);
+                      }),
+                      clients.end());
+
+        auto due = [](const ListenClient &client, std::chrono::steady_clock::time_point now) {
+            return client.framesRemaining != 0 && now >= client.nextFrame;
+        };
+        auto now = std::chrono::steady_clock::now();
+        bool wanted = options.any();
+        for (auto &client : clients)
+        {
+            wanted = wanted || due(*client, now);
+        }
+        if (!wanted)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
 
-    return true;
-}
+        if (!source.read(raw))
+        {
+            break;
+        }
 
-void printConnectingToServerInfo() {
-    std::cout << "Diconnected from the server." << std::endl;
-    std::cout << "Attempting to connect to the server..." << std::endl;
-}
+        FrameHeader header;
+        header.sequence = frameSequence++;
+        header.captureTimeUs = timestamp_us();
+        int deviceTempSensor = source.device_temp_sensor();
+        publishFrame(outputs, options, raw, header, deviceTempSensor, pool);
 
-void writeLogMessage(char const *logMessage) {
-    // std::cout << logMessage << std::endl;
+        now = std::chrono::steady_clock::now();
+        for (auto &client : clients)
+        {
+            if (!due(*client, now))
+            {
+                continue;
+            }
+
+            bool sent;
+            FrameHeader clientHeader = header;
+            if (client->payloadType == PAYLOAD_RAW16_DELTA)
+            {
+                // Delta coded against the last frame this client got, nothing to share
+                sent = sendRaw(*client->socket, client->buffer, raw, client->rawEncoder, client->headerVersion, clientHeader);
+            }
+            else
+            {
+                const ListenClient &c = *client;
+                RenderCache::Frame frame = cache.get(header.sequence, c.render, c.payloadType, [&](RenderedFrame &rendered) {
+                    renderFrame(outputs, raw, deviceTempSensor, header.sequence, c.render, c.payloadType, pool, rendered);
+                });
+                sent = sendRendered(*client->socket, *frame, client->payloadType, client->headerVersion, clientHeader);
+            }
+
+            if (!sent)
+            {
+                client->connected = false;
+                continue;
+            }
+            if (client->framesRemaining > 0)
+            {
+                client->framesRemaining--;
+            }
+            client->nextFrame = std::max(client->nextFrame + client->interval, now);
+        }
+    }
+
+    std::cout << "Rendered " << cache.misses << " frames for clients, shared " << cache.hits << " renderings between them" << std::endl;
+    printWorkerStats(pool);
+    pool.stop();
+    closeOutputs(outputs, options, "");
+    return 0;
 }
 
 int main(int argc, char const *argv[])
 {
+    fireWarningText = "DEMAM";
+    fireThresholdCelcius = 35;
+
     args::ArgumentParser parser("Seek Thermal Data Streamer");
     args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
     args::ValueFlag<std::string> arg_target_host(parser, "arg_target_host", "Target host", {"host"});
@@ -300,6 +972,47 @@ int main(int argc, char const *argv[])
     args::ValueFlag<std::string> arg_preadd(parser, "arg_preadd", "Pre-Addition Temp Shift", {"preadd"});
     args::ValueFlag<std::string> arg_postadd(parser, "arg_postadd", "Post-Addition Temp Shift", {"postadd"});
     args::ValueFlag<std::string> arg_multiplier(parser, "arg_multiplier", "Multiplier for Temp", {"multiplier"});
+    args::ValueFlag<std::string> arg_source(parser, "arg_source", "Frame source: seek, seekpro, synthetic, synthetic-pro, replay or recording", {"source"});
+    args::ValueFlag<std::string> arg_source_path(parser, "arg_source_path", "FFC file for seek, image glob for replay, segment glob for recording", {"source-path"});
+    args::ValueFlag<std::string> arg_source_fps(parser, "arg_source_fps", "Frame rate of synthetic/replay/recording sources, 0 = unthrottled", {"source-fps"});
+    args::ValueFlag<std::string> arg_sensor_temp(parser, "arg_sensor_temp", "Device sensor temperature of synthetic/replay sources (Celcius)", {"sensor-temp"});
+    args::ValueFlag<std::string> arg_multicast(parser, "arg_multicast", "Push frames to this UDP multicast group:port instead of a server", {"multicast"});
+    args::ValueFlag<std::string> arg_multicast_ttl(parser, "arg_multicast_ttl", "Multicast TTL, 1 = local segment only", {"multicast-ttl"});
+    args::ValueFlag<std::string> arg_multicast_if(parser, "arg_multicast_if", "Address of the interface to send multicast on", {"multicast-if"});
+    args::ValueFlag<std::string> arg_mtu(parser, "arg_mtu", "MTU used to size multicast datagrams", {"mtu"});
+    args::ValueFlag<std::string> arg_multicast_payload(parser, "arg_multicast_payload", "Multicast payload: jpeg, raw (lossless raw frames) or grey (colorized by the receiver)", {"multicast-payload"});
+    args::ValueFlag<std::string> arg_shm(parser, "arg_shm", "Also publish frames to this shared memory ring for local readers", {"shm"});
+    args::ValueFlag<std::string> arg_shm_slots(parser, "arg_shm_slots", "Slots in the shared memory ring", {"shm-slots"});
+    args::ValueFlag<std::string> arg_shm_planes(parser, "arg_shm_planes", "Planes in the shared memory ring: raw, bgr or both", {"shm-planes"});
+    args::ValueFlag<std::string> arg_record(parser, "arg_record", "Record raw frames to <prefix>_NNNN.tsrec segments", {"record"});
+    args::ValueFlag<std::string> arg_record_segment(parser, "arg_record_segment", "Frames per recording segment", {"record-segment-frames"});
+    args::ValueFlag<std::string> arg_record_codec(parser, "arg_record_codec", "Recording payload: raw or delta (lossless compression)", {"record-codec"});
+    args::ValueFlag<std::string> arg_clip(parser, "arg_clip", "Save raw clips around fever alarms to <prefix>_<sequence>.tsrec", {"clip"});
+    args::ValueFlag<std::string> arg_clip_pre(parser, "arg_clip_pre", "Seconds kept before an alarm", {"clip-pre"});
+    args::ValueFlag<std::string> arg_clip_post(parser, "arg_clip_post", "Seconds kept after the last alarming frame", {"clip-post"});
+    args::ValueFlag<std::string> arg_video(parser, "arg_video", "Write the processed frames to video files, e.g. out/cam.mp4 for out/cam_0000.mp4, ...", {"video"});
+    args::ValueFlag<std::string> arg_video_encoder(parser, "arg_video_encoder", "Video encoder: opencv (VideoWriter) or ffmpeg (pipe)", {"video-encoder"});
+    args::ValueFlag<std::string> arg_video_codec(parser, "arg_video_codec", "Fourcc for opencv (default MJPG), encoder for ffmpeg (default libx264)", {"video-codec"});
+    args::ValueFlag<std::string> arg_video_segment_seconds(parser, "arg_video_segment_seconds", "Start a new video file after this many seconds", {"video-segment-seconds"});
+    args::ValueFlag<std::string> arg_video_segment_mb(parser, "arg_video_segment_mb", "Start a new video file once it reaches this many megabytes", {"video-segment-mb"});
+    args::ValueFlag<std::string> arg_fixed_range(parser, "arg_fixed_range", "Colors span this fixed low:high Celcius range, e.g. 20:45, instead of the frame's", {"fixed-range"});
+    args::ValueFlag<std::string> arg_range_hysteresis(parser, "arg_range_hysteresis", "Celcius the min/max have to move inside the color range before it narrows", {"range-hysteresis"});
+    args::ValueFlag<std::string> arg_fire_threshold(parser, "arg_fire_threshold", "Alarm when the frame's max goes over this many Celcius (default 35)", {"fire-threshold"});
+    args::ValueFlag<std::string> arg_hotspots(parser, "arg_hotspots", "Mark every hotspot over this many Celcius, not just the hottest pixel", {"hotspots"});
+    args::ValueFlag<std::string> arg_zones(parser, "arg_zones", "Alarm zones with their own thresholds, from a YAML/JSON file", {"zones"});
+    args::ValueFlag<std::string> arg_alarm_udp(parser, "arg_alarm_udp", "Send zone alarm events as JSON datagrams to this host:port", {"alarm-udp"});
+    args::Flag arg_roi_queries(parser, "arg_roi_queries", "Index every frame so clients can query rectangle temperatures with 'Q'", {"roi-queries"});
+    args::ValueFlag<std::string> arg_upscale(parser, "arg_upscale", "Upscaling: bilinear (default) or nearest", {"upscale"});
+    args::ValueFlag<std::string> arg_cameras(parser, "arg_cameras", "Drive this many cameras of --source at once, or all for every Seek attached", {"cameras"});
+    args::ValueFlag<std::string> arg_workers(parser, "arg_workers", "Worker threads processing frames in row bands, 0 = one per core", {"workers"});
+    args::Flag arg_pin_workers(parser, "arg_pin_workers", "Pin every worker thread to a core of its own", {"pin-workers"});
+    args::ValueFlag<std::string> arg_listen(parser, "arg_listen", "Serve any number of clients connecting to this port instead of connecting to a server", {"listen"});
+    args::ValueFlag<std::string> arg_bad_pixels(parser, "arg_bad_pixels", "Correct the pixels listed in this bad pixel map (see --calibrate-bad-pixels)", {"bad-pixels"});
+    args::ValueFlag<std::string> arg_calibrate_bad_pixels(parser, "arg_calibrate_bad_pixels", "Find the bad pixels in frames of an evenly warm scene, save them to this file and exit", {"calibrate-bad-pixels"});
+    args::ValueFlag<std::string> arg_calibration_frames(parser, "arg_calibration_frames", "Frames to find bad pixels in, or of each flat field for --calibrate-nuc (default 100)", {"calibration-frames"});
+    args::ValueFlag<std::string> arg_nuc(parser, "arg_nuc", "Correct every pixel's gain and offset from these NUC tables (see --calibrate-nuc)", {"nuc"});
+    args::ValueFlag<std::string> arg_calibrate_nuc(parser, "arg_calibrate_nuc", "Capture a cool and a warm flat field into correction tables, save them to this file and exit", {"calibrate-nuc"});
+    args::Flag arg_list_cameras(parser, "arg_list_cameras", "List the Seek cameras attached and exit", {"list-cameras"});
 
     // Parse command line arguments
     try
@@ -336,15 +1049,238 @@ int main(int argc, char const *argv[])
         multiplier = std::stod(args::get(arg_multiplier));
     }
 
+    if (arg_fire_threshold)
+    {
+        if (!parse_celcius(args::get(arg_fire_threshold), fireThresholdCelcius))
+        {
+            std::cerr << "Fire threshold needs a temperature in Celcius, got " << args::get(arg_fire_threshold) << std::endl;
+            return 1;
+        }
+    }
+
+    if (arg_upscale)
+    {
+        std::string upscale = args::get(arg_upscale);
+        if (upscale == "nearest")
+        {
+            upscaleInterpolation = cv::INTER_NEAREST;
+        }
+        else if (upscale != "bilinear")
+        {
+            std::cerr << "Unknown upscaling " << upscale << std::endl;
+            std::cerr << parser;
+            return 1;
+        }
+    }
+
     // Register signals
     signal(SIGINT, handle_sig);
     signal(SIGTERM, handle_sig);
+    // A video encoder or client that went away shows up as a failed write instead of killing the process
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, handle_recapture_sig);
+
+    // Setup frame source, a seek camera unless told otherwise
+    FrameSourceOptions sourceOptions;
+    if (arg_source)
+    {
+        sourceOptions.kind = args::get(arg_source);
+    }
+    if (arg_source_path)
+    {
+        sourceOptions.path = args::get(arg_source_path);
+    }
+    if (arg_source_fps)
+    {
+        sourceOptions.fps = std::stod(args::get(arg_source_fps));
+    }
+    if (arg_sensor_temp)
+    {
+        sourceOptions.sensorCelcius = std::stod(args::get(arg_sensor_temp));
+    }
+    // Calibration looks at the frames as they come from the sensor
+    if (arg_bad_pixels && !arg_calibrate_bad_pixels)
+    {
+        sourceOptions.badPixels = args::get(arg_bad_pixels);
+    }
+
+    if (arg_list_cameras)
+    {
+        for (auto &device : list_seek_devices())
+        {
+            std::cout << (device.pro ? "seekpro " : "seek ") << device.index << ": bus " << device.bus << " address " << device.address << std::endl;
+        }
+        return 0;
+    }
+
+    OutputOptions outputOptions;
+    outputOptions.roiQueries = arg_roi_queries;
+    if (arg_nuc && !arg_calibrate_nuc)
+    {
+        outputOptions.nucPath = args::get(arg_nuc);
+    }
+    if (arg_zones && !load_zones(args::get(arg_zones), outputOptions.zones))
+    {
+        return 1;
+    }
+    if (arg_hotspots)
+    {
+        outputOptions.hotspots = true;
+        outputOptions.hotspotCelcius = std::stod(args::get(arg_hotspots));
+    }
+    if (arg_alarm_udp)
+    {
+        outputOptions.alarmTarget = args::get(arg_alarm_udp);
+    }
+    if (arg_range_hysteresis)
+    {
+        outputOptions.rangeHysteresis = std::stod(args::get(arg_range_hysteresis));
+    }
+    if (arg_fixed_range)
+    {
+        std::string range = args::get(arg_fixed_range);
+        if (!parse_fixed_range(range, outputOptions.fixedLow, outputOptions.fixedHigh))
+        {
+            std::cerr << "Fixed range needs low:high Celcius with low below high, got " << range << std::endl;
+            return 1;
+        }
+        outputOptions.fixedRange = true;
+    }
+    if (arg_multicast)
+    {
+        std::string target = args::get(arg_multicast);
+        auto colon = target.rfind(':');
+        if (colon == std::string::npos)
+        {
+            std::cerr << "Multicast output needs group:port, got " << target << std::endl;
+            return 1;
+        }
+        outputOptions.multicastGroup = target.substr(0, colon);
+        outputOptions.multicastPort = std::stoi(target.substr(colon + 1));
+        outputOptions.multicastTtl = arg_multicast_ttl ? std::stoi(args::get(arg_multicast_ttl)) : 1;
+        outputOptions.mtu = arg_mtu ? std::stoi(args::get(arg_mtu)) : MULTICAST_DEFAULT_MTU;
+        outputOptions.multicastInterface = arg_multicast_if ? args::get(arg_multicast_if) : "";
+        std::string payload = arg_multicast_payload ? args::get(arg_multicast_payload) : "jpeg";
+        if (payload == "raw")
+        {
+            outputOptions.multicastPayload = PAYLOAD_RAW16_DELTA;
+        }
+        else if (payload == "grey")
+        {
+            outputOptions.multicastPayload = PAYLOAD_GREY_JPEG;
+        }
+        else if (payload != "jpeg")
+        {
+            std::cerr << "Unknown multicast payload " << payload << std::endl;
+            return 1;
+        }
+    }
+    if (arg_shm)
+    {
+        outputOptions.shmName = args::get(arg_shm);
+        outputOptions.shmSlots = arg_shm_slots ? std::stoi(args::get(arg_shm_slots)) : 4;
+        outputOptions.shmPlanes = arg_shm_planes ? args::get(arg_shm_planes) : "both";
+        if (outputOptions.shmSlots < 2)
+        {
+            std::cerr << "The shared memory ring needs at least 2 slots" << std::endl;
+            return 1;
+        }
+    }
+    if (arg_record)
+    {
+        outputOptions.recordPrefix = args::get(arg_record);
+        outputOptions.recordSegmentFrames = arg_record_segment ? std::stoull(args::get(arg_record_segment)) : RECORDING_DEFAULT_SEGMENT_FRAMES;
+        outputOptions.recordCompress = arg_record_codec && args::get(arg_record_codec) == "delta";
+    }
+    if (arg_clip)
+    {
+        outputOptions.clipPrefix = args::get(arg_clip);
+        outputOptions.clipPre = arg_clip_pre ? std::stod(args::get(arg_clip_pre)) : DEFAULT_CLIP_SECONDS;
+        outputOptions.clipPost = arg_clip_post ? std::stod(args::get(arg_clip_post)) : DEFAULT_CLIP_SECONDS;
+    }
+    if (arg_video)
+    {
+        outputOptions.video.path = args::get(arg_video);
+        outputOptions.video.fps = sourceOptions.fps > 0 ? sourceOptions.fps : DEFAULT_VIDEO_FPS;
+        if (arg_video_encoder)
+        {
+            outputOptions.video.encoder = args::get(arg_video_encoder);
+        }
+        if (arg_video_codec)
+        {
+            outputOptions.video.codec = args::get(arg_video_codec);
+        }
+        if (arg_video_segment_seconds)
+        {
+            outputOptions.video.segmentSeconds = std::stod(args::get(arg_video_segment_seconds));
+        }
+        if (arg_video_segment_mb)
+        {
+            outputOptions.video.segmentBytes = (uint64_t)(std::stod(args::get(arg_video_segment_mb)) * 1024 * 1024);
+        }
+    }
+
+    int workers = arg_workers ? std::stoi(args::get(arg_workers)) : 0;
+
+    // Several cameras: one FrameSourceOptions each, camera ids follow the order here
+    if (arg_cameras)
+    {
+        std::vector<FrameSourceOptions> cameraSources;
+        if (args::get(arg_cameras) == "all")
+        {
+            for (auto &device : list_seek_devices())
+            {
+                FrameSourceOptions options = sourceOptions;
+                options.kind = device.pro ? "seekpro" : "seek";
+                options.device = device.index;
+                cameraSources.push_back(options);
+            }
+        }
+        else
+        {
+            int count = std::stoi(args::get(arg_cameras));
+            for (int i = 0; i < count; i++)
+            {
+                FrameSourceOptions options = sourceOptions;
+                options.device = i;
+                options.seed = sourceOptions.seed + i;
+                cameraSources.push_back(options);
+            }
+        }
+
+        if (cameraSources.empty())
+        {
+            std::cerr << "No cameras to drive" << std::endl;
+            return 1;
+        }
+        if (cameraSources.size() > 1)
+        {
+            // Flat field corrections and bad pixel maps belong to one camera, each gets <ffc>_camN and <map>_camN.
+            //  NUC tables are named the same way by openOutputs
+            for (std::size_t i = 0; i < cameraSources.size(); i++)
+            {
+                if ((cameraSources[i].kind == "seek" || cameraSources[i].kind == "seekpro") && !cameraSources[i].path.empty())
+                {
+                    cameraSources[i].path = cameraPath(cameraSources[i].path, (int)i, true);
+                }
+                if (!cameraSources[i].badPixels.empty())
+                {
+                    cameraSources[i].badPixels = cameraPath(cameraSources[i].badPixels, (int)i, true);
+                }
+            }
 
-    // Setup seek camera
-    LibSeek::SeekCam *seek;
-    LibSeek::SeekThermal seekClassic("");
+            return runCameraRig(cameraSources, outputOptions, workers, arg_pin_workers, args::get(arg_cameras) == "all");
+        }
+        sourceOptions = cameraSources[0];
+    }
 
-    seek = &seekClassic;
+    auto seek = create_frame_source(sourceOptions);
+    if (!seek)
+    {
+        std::cerr << "Unknown frame source " << sourceOptions.kind << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
 
     if (!seek->open())
     {
@@ -353,7 +1289,7 @@ int main(int argc, char const *argv[])
     }
 
     // Mat containers for seek frames
-    Mat seekFrame, outFrame;
+    Mat seekFrame;
 
     // Retrieve a single frame, resize to requested scaling value and then determine size of matrix
     //  so we can size the VideoWriter stream correctly
@@ -363,6 +1299,22 @@ int main(int argc, char const *argv[])
         return 1;
     }
 
+    if (arg_calibrate_bad_pixels)
+    {
+        int frames = arg_calibration_frames ? std::stoi(args::get(arg_calibration_frames)) : DEFAULT_CALIBRATION_FRAMES;
+        return calibrateBadPixels(*seek, frames, args::get(arg_calibrate_bad_pixels));
+    }
+    if (arg_calibrate_nuc)
+    {
+        int frames = arg_calibration_frames ? std::stoi(args::get(arg_calibration_frames)) : DEFAULT_CALIBRATION_FRAMES;
+        return calibrateNuc(*seek, frames, args::get(arg_calibrate_nuc));
+    }
+
+    if (arg_listen)
+    {
+        return runListenServer(*seek, outputOptions, std::stoi(args::get(arg_listen)), workers, arg_pin_workers, seekFrame.size());
+    }
+
     /* Will be retrieved from cli arguments */
     const char *remoteAddress = DEFAULT_HOST;
     int remotePort = DEFAULT_PORT;
@@ -378,13 +1330,38 @@ int main(int argc, char const *argv[])
     std::vector<uchar> imageBuffer;
     sf::Socket::Status socketStatus;
 
-    char receivedData[100];
-    std::size_t receivedCount;
-    std::size_t receivedCountSum = 0;
+    Command command;
+    int framesRemaining = 0; // -1 while subscribed
+    FramePacer pacer(0);
+
+    bool extended = false;
+    int headerVersion = 0;
+    int payloadType = PAYLOAD_JPEG;
+    RenderParams render;
+    RenderedFrame rendered;
+    RawEncoder rawEncoder;
+    FrameHeader frameHeader;
+    uint32_t frameSequence = 0;
 
     auto mode = OperationMode::ConnectToServer;
     auto num = 1;
 
+    CameraOutputs outputs;
+    if (!openOutputs(outputs, outputOptions, 0, false, seekFrame.size()))
+    {
+        return 1;
+    }
+
+    WorkerPool pool;
+    startWorkers(pool, workers, arg_pin_workers);
+
+    // Multicast viewers, local readers, recorders and video files don't need a server, keep capturing for
+    //  them unless one was given. With one they get the frames it asks for.
+    if (outputOptions.any() && !(arg_target_host && arg_target_port))
+    {
+        mode = OperationMode::FreeRun;
+    }
+
     while (!sigflag)
     {
         switch (mode)
@@ -394,6 +1371,10 @@ int main(int argc, char const *argv[])
 
             if (socket.connect(remoteAddress, remotePort) == sf::Socket::Done) {
                 writeLogMessage("Successfully connected.");
+                extended = false;
+                headerVersion = 0;
+                payloadType = PAYLOAD_JPEG;
+                render = RenderParams();
                 mode = OperationMode::WaitForCommand;
             }
             
@@ -401,24 +1382,75 @@ int main(int argc, char const *argv[])
         case OperationMode::WaitForCommand:
             writeLogMessage("Waiting for command.");
 
-            if (socket.receive(receivedData, 1, receivedCount) != sf::Socket::Done) {
+            if (receiveCommand(socket, command, extended, true) != sf::Socket::Done) {
                 mode = OperationMode::ConnectToServer;
                 printConnectingToServerInfo();
                 break;
             }
 
-            receivedCountSum += receivedCount;
-            
-            if (receivedCount >= 1) {
-                mode = OperationMode::SendImage;
-                receivedCountSum = 0;
+            if (applyConnectionSetting(command, headerVersion, payloadType, render, rawEncoder))
+            {
+                break;
+            }
+            if (command.type == CommandType::Query)
+            {
+                if (!answerQuery(socket, command, outputs.roi, outputOptions.roiQueries, headerVersion, imageBuffer))
+                {
+                    mode = OperationMode::ConnectToServer;
+                    printConnectingToServerInfo();
+                }
+                break;
+            }
+            if (command.type == CommandType::RecaptureOffsets)
+            {
+                recaptureOffsets(outputs, outputOptions, command.offsetFrames);
                 break;
             }
 
+            framesRemaining = command.count;
+            pacer = FramePacer(command.fps);
+            mode = framesRemaining == 0 ? OperationMode::WaitForCommand : OperationMode::SendImage;
             break;
         case OperationMode::SendImage:
             writeLogMessage("Sending image...");
 
+            /* While pushing several frames, a new command replaces the running stream */
+            if (framesRemaining != 1)
+            {
+                socketStatus = receiveCommand(socket, command, extended, false);
+                if (socketStatus == sf::Socket::Done && command.type == CommandType::Query)
+                {
+                    if (!answerQuery(socket, command, outputs.roi, outputOptions.roiQueries, headerVersion, imageBuffer))
+                    {
+                        mode = OperationMode::ConnectToServer;
+                        printConnectingToServerInfo();
+                        break;
+                    }
+                }
+                else if (socketStatus == sf::Socket::Done && command.type == CommandType::RecaptureOffsets)
+                {
+                    recaptureOffsets(outputs, outputOptions, command.offsetFrames);
+                }
+                else if (socketStatus == sf::Socket::Done && !applyConnectionSetting(command, headerVersion, payloadType, render, rawEncoder))
+                {
+                    framesRemaining = command.count;
+                    pacer = FramePacer(command.fps);
+                    if (framesRemaining == 0)
+                    {
+                        mode = OperationMode::WaitForCommand;
+                        break;
+                    }
+                }
+                else if (socketStatus != sf::Socket::Done && socketStatus != sf::Socket::NotReady)
+                {
+                    mode = OperationMode::ConnectToServer;
+                    printConnectingToServerInfo();
+                    break;
+                }
+            }
+
+            pacer.wait();
+
             /* If signal for interrupt/termination was received, break out of main loop and exit */
             if (!seek->read(seekFrame))
             {
@@ -426,15 +1458,43 @@ int main(int argc, char const *argv[])
                 break;
             }
 
-            process_frame(seekFrame, outFrame, 4.0f, 11, 90, seek->device_temp_sensor());
+            frameHeader.sequence = frameSequence++;
+            frameHeader.captureTimeUs = timestamp_us();
+
+            publishFrame(outputs, outputOptions, seekFrame, frameHeader, seek->device_temp_sensor(), pool);
 
-            if (!sendImage(socket, imageBuffer, outFrame)) {
+            if (payloadType != PAYLOAD_RAW16_DELTA)
+            {
+                renderFrame(outputs, seekFrame, seek->device_temp_sensor(), frameHeader.sequence, render, payloadType, pool, rendered);
+            }
+            if (payloadType == PAYLOAD_RAW16_DELTA ? !sendRaw(socket, imageBuffer, seekFrame, rawEncoder, headerVersion, frameHeader)
+                                                   : !sendRendered(socket, rendered, payloadType, headerVersion, frameHeader)) {
                 mode = OperationMode::ConnectToServer;
                 printConnectingToServerInfo();
                 break;
             }
-            
-            mode = OperationMode::WaitForCommand;
+
+            if (framesRemaining > 0)
+            {
+                framesRemaining--;
+            }
+            if (framesRemaining == 0)
+            {
+                mode = OperationMode::WaitForCommand;
+            }
+            break;
+        case OperationMode::FreeRun:
+            /* No server to wait for, every frame goes out as soon as it is ready */
+            if (!seek->read(seekFrame))
+            {
+                mode = OperationMode::Exit;
+                break;
+            }
+
+            frameHeader.sequence = frameSequence++;
+            frameHeader.captureTimeUs = timestamp_us();
+
+            publishFrame(outputs, outputOptions, seekFrame, frameHeader, seek->device_temp_sensor(), pool);
             break;
         case OperationMode::Exit:
             writeLogMessage("Exiting...");
@@ -446,5 +1506,9 @@ int main(int argc, char const *argv[])
 
     exit_loop: ;
 
+    printWorkerStats(pool);
+    pool.stop();
+    closeOutputs(outputs, outputOptions, "");
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "test.h"
+#include "../args.h"
+#include <iostream>
+#include <regex>
+#include <vector>
+
+namespace test
+{
+
+struct Case
+{
+    std::string name;
+    std::function<void()> body;
+};
+
+// Function local so registrations from other translation units don't depend on initialization order
+static std::vector<Case> &cases()
+{
+    static std::vector<Case> list;
+    return list;
+}
+
+static int failures = 0;
+
+void add(const std::string &name, std::function<void()> body)
+{
+    cases().push_back({name, std::move(body)});
+}
+
+void check(bool passed, const char *condition, const char *file, int line)
+{
+    if (!passed)
+    {
+        std::cerr << file << ":" << line << ": CHECK(" << condition << ") failed" << std::endl;
+        failures++;
+    }
+}
+
+} // namespace test
+
+int main(int argc, char const *argv[])
+{
+    args::ArgumentParser parser("Seek Thermal pipeline tests");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::Positional<std::string> arg_filter(parser, "regex", "Only run tests whose name matches");
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help)
+    {
+        std::cout << parser;
+        return 0;
+    }
+    catch (args::ParseError e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::regex pattern(arg_filter ? args::get(arg_filter) : ".*");
+    int failedCases = 0, ran = 0;
+    for (auto &c : test::cases())
+    {
+        if (!std::regex_search(c.name, pattern))
+        {
+            continue;
+        }
+
+        int before = test::failures;
+        c.body();
+        bool passed = test::failures == before;
+        std::cout << (passed ? "[ OK ] " : "[FAIL] ") << c.name << std::endl;
+        failedCases += !passed;
+        ran++;
+    }
+
+    std::cout << ran - failedCases << " of " << ran << " tests passed" << std::endl;
+    return failedCases == 0 ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Minimal test runner for the bit-exact paths: every test_*.cpp registers its cases with TEST_CASE, the
+//  runner executes those matching an optional regex and exits non-zero when any CHECK failed, so ctest
+//  picks the failures up. A failed CHECK reports where it was and the case carries on.
+
+#include <functional>
+#include <string>
+
+namespace test
+{
+
+void add(const std::string &name, std::function<void()> body);
+void check(bool passed, const char *condition, const char *file, int line);
+
+struct Registration
+{
+    Registration(const std::string &name, std::function<void()> body) { add(name, std::move(body)); }
+};
+
+} // namespace test
+
+#define TEST_CONCAT_(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_(a, b)
+
+#define TEST_CASE(name) \
+    static void TEST_CONCAT(test_case_, __LINE__)(); \
+    static test::Registration TEST_CONCAT(test_registration_, __LINE__)(name, TEST_CONCAT(test_case_, __LINE__)); \
+    static void TEST_CONCAT(test_case_, __LINE__)()
+
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,117 @@
+// BadPixelMap's neighbour table: the 3x3 median, the 5x5 one when the whole 3x3 is bad, and pixels with
+//  no good neighbours or frames of another size left alone
+
+#include "test.h"
+#include "../bad_pixels.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace cv;
+
+static const int WIDTH = 206;
+static const int HEIGHT = 156;
+
+static Mat random_frame(std::mt19937 &rng, Size size = Size(WIDTH, HEIGHT))
+{
+    Mat raw(size, CV_16UC1);
+    for (int y = 0; y < raw.rows; y++)
+    {
+        for (int x = 0; x < raw.cols; x++)
+        {
+            raw.at<uint16_t>(y, x) = (uint16_t)(rng() % 65536);
+        }
+    }
+    return raw;
+}
+
+// Every pixel of the square of that radius around center
+static void add_square(std::vector<Point> &pixels, Point center, int radius)
+{
+    for (int y = center.y - radius; y <= center.y + radius; y++)
+    {
+        for (int x = center.x - radius; x <= center.x + radius; x++)
+        {
+            pixels.push_back(Point(x, y));
+        }
+    }
+}
+
+// What correct() picks from the values of the good neighbours: the upper median for an even count
+static uint16_t median(std::vector<uint16_t> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+TEST_CASE("bad_pixels/neighbour_medians")
+{
+    std::mt19937 rng(1);
+    const Point single(50, 50), block3(100, 80), block5(150, 40);
+
+    std::vector<Point> bad = {single};
+    add_square(bad, block3, 1);
+    add_square(bad, block5, 2);
+    BadPixelMap map;
+    map.set(Size(WIDTH, HEIGHT), bad);
+
+    for (int trial = 0; trial < 20; trial++)
+    {
+        Mat raw = random_frame(rng);
+        Mat corrected = raw.clone();
+        map.correct(corrected);
+
+        // The 8 around a lone bad pixel
+        std::vector<uint16_t> around;
+        for (int y = -1; y <= 1; y++)
+        {
+            for (int x = -1; x <= 1; x++)
+            {
+                if (x != 0 || y != 0)
+                {
+                    around.push_back(raw.at<uint16_t>(single.y + y, single.x + x));
+                }
+            }
+        }
+        CHECK(corrected.at<uint16_t>(single) == median(around));
+
+        // The ring of 16 between the 3x3 and the 5x5 around the middle of a bad 3x3
+        std::vector<uint16_t> ring;
+        for (int y = -2; y <= 2; y++)
+        {
+            for (int x = -2; x <= 2; x++)
+            {
+                if (std::abs(x) == 2 || std::abs(y) == 2)
+                {
+                    ring.push_back(raw.at<uint16_t>(block3.y + y, block3.x + x));
+                }
+            }
+        }
+        CHECK(corrected.at<uint16_t>(block3) == median(ring));
+
+        // Nothing to go by in the middle of a bad 5x5
+        CHECK(corrected.at<uint16_t>(block5) == raw.at<uint16_t>(block5));
+
+        // Good pixels stay as they are
+        Mat mask = Mat::ones(raw.size(), CV_8UC1);
+        for (const Point &pixel : bad)
+        {
+            mask.at<uchar>(pixel) = 0;
+        }
+        CHECK(norm(raw, corrected, NORM_INF, mask) == 0);
+    }
+}
+
+TEST_CASE("bad_pixels/other_sizes_untouched")
+{
+    std::mt19937 rng(2);
+    std::vector<Point> bad;
+    add_square(bad, Point(20, 20), 1);
+    BadPixelMap map;
+    map.set(Size(WIDTH, HEIGHT), bad);
+
+    Mat raw = random_frame(rng, Size(WIDTH * 2, HEIGHT * 2));
+    Mat corrected = raw.clone();
+    map.correct(corrected);
+    CHECK(norm(raw, corrected, NORM_INF) == 0);
+}
@@ -0,0 +1,90 @@
+// ColormapCache's smoothed range and its fixed scale, and the --fixed-range parser
+
+#include "test.h"
+#include "../colormap_cache.h"
+#include "../thermal.h"
+#include <cmath>
+
+using namespace cv;
+
+static const double DEVICE_K = 300;
+
+static int fixed_raw(double celcius, double device_k)
+{
+    return (int)std::lround(raw_from_temp(celcius, device_k));
+}
+
+// Stretched over the whole grey scale, one entry per raw value of the range
+static bool spans_range(const ColormapCache::Table &table, int low, int high)
+{
+    return table.low == low && table.high == high && table.grey.cols == high - low + 1 && table.grey.at<uchar>(0) == 0 &&
+           table.grey.at<uchar>(table.grey.cols - 1) == 255;
+}
+
+TEST_CASE("colormap_cache/hysteresis")
+{
+    ColormapCache palette;
+    palette.hysteresisCelcius = 0.5;
+    double hysteresis = 0.5 * std::abs(raw_from_temp(1, 0) - raw_from_temp(0, 0));
+    CHECK(hysteresis > 40 && hysteresis < 50);
+
+    const ColormapCache::Table *first = &palette.range(1000, 2000, DEVICE_K);
+    CHECK(spans_range(*first, 1000, 2000));
+
+    // Noise inside the hysteresis keeps the range, and the same table
+    CHECK(&palette.range(1030, 1970, DEVICE_K) == first);
+    CHECK(&palette.range(1000 + hysteresis - 1, 2000 - hysteresis + 1, DEVICE_K) == first);
+
+    // Widens as soon as a frame goes outside
+    CHECK(spans_range(palette.range(990, 2000, DEVICE_K), 990, 2000));
+    CHECK(spans_range(palette.range(990, 2010, DEVICE_K), 990, 2010));
+
+    // Narrows only past the hysteresis
+    CHECK(spans_range(palette.range(990 + hysteresis - 1, 2010, DEVICE_K), 990, 2010));
+    CHECK(spans_range(palette.range(1050, 2010, DEVICE_K), 1050, 2010));
+    CHECK(spans_range(palette.range(1050, 1950, DEVICE_K), 1050, 1950));
+
+    // Back to a range seen before, its table comes from the cache
+    palette.hysteresisCelcius = 0;
+    CHECK(&palette.range(1000, 2000, DEVICE_K) == first);
+    CHECK(spans_range(*first, 1000, 2000));
+}
+
+TEST_CASE("colormap_cache/fixed_scale")
+{
+    ColormapCache palette;
+    palette.fixed = true;
+    palette.fixedLowCelcius = 20;
+    palette.fixedHighCelcius = 45;
+    palette.driftCelcius = 0.1;
+
+    // The frame's own range doesn't matter
+    const ColormapCache::Table *table = &palette.range(5000, 9000, DEVICE_K);
+    CHECK(spans_range(*table, fixed_raw(20, DEVICE_K), fixed_raw(45, DEVICE_K)));
+    CHECK(&palette.range(100, 60000, DEVICE_K) == table);
+
+    // A device temperature drift worth less than driftCelcius keeps the table
+    double rawPerKelvin = std::abs(raw_from_temp(20, DEVICE_K + 1) - raw_from_temp(20, DEVICE_K));
+    double driftKelvin = palette.driftCelcius * std::abs(raw_from_temp(1, 0) - raw_from_temp(0, 0)) / rawPerKelvin;
+    CHECK(&palette.range(5000, 9000, DEVICE_K + driftKelvin * 0.5) == table);
+
+    // More than that rebuilds it for the new device temperature
+    double drifted = DEVICE_K + driftKelvin * 5;
+    CHECK(spans_range(palette.range(5000, 9000, drifted), fixed_raw(20, drifted), fixed_raw(45, drifted)));
+    CHECK(fixed_raw(20, drifted) != fixed_raw(20, DEVICE_K));
+}
+
+TEST_CASE("colormap_cache/parse_fixed_range")
+{
+    double low = 0, high = 0;
+    CHECK(parse_fixed_range("20:45", low, high) && low == 20 && high == 45);
+    CHECK(parse_fixed_range("-5.5:37.5", low, high) && low == -5.5 && high == 37.5);
+
+    CHECK(!parse_fixed_range("30:20", low, high));
+    CHECK(!parse_fixed_range("25:25", low, high));
+    CHECK(!parse_fixed_range("a:b", low, high));
+    CHECK(!parse_fixed_range("20:45x", low, high));
+    CHECK(!parse_fixed_range(":45", low, high));
+    CHECK(!parse_fixed_range("20", low, high));
+    CHECK(!parse_fixed_range("", low, high));
+}
@@ -0,0 +1,132 @@
+// HotspotTracker's Hungarian assignment against brute force, and ids that last from frame to frame
+
+#include "test.h"
+#include "../hotspot_tracker.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace cv;
+
+static double squared_distance(Point2f a, Point2f b)
+{
+    Point2f offset = a - b;
+    return (double)offset.x * offset.x + (double)offset.y * offset.y;
+}
+
+TEST_CASE("hotspot_tracker/assignment_is_optimal")
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coordinate(0, 200);
+    TrackAlarm alarms[MAX_TRACKS];
+
+    for (int trial = 0; trial < 2000; trial++)
+    {
+        HotspotTracker tracker;
+        tracker.gatePixels = trial % 2 ? 60 : 1000; // some pairs out of the gate, or none
+        double gate = (double)tracker.gatePixels * tracker.gatePixels;
+
+        // Tracks standing still at random spots, so their predictions are where they are
+        Hotspot hotspots[MAX_HOTSPOTS];
+        int tracks = rng() % 6 + 1;
+        for (int i = 0; i < tracks; i++)
+        {
+            hotspots[i].centroid = Point2f(coordinate(rng), coordinate(rng));
+        }
+        tracker.update(hotspots, tracks, alarms);
+        Track before[MAX_TRACKS];
+        for (int slot = 0; slot < MAX_TRACKS; slot++)
+        {
+            before[slot] = tracker.track(slot);
+        }
+
+        int count = rng() % 5 + 1;
+        for (int i = 0; i < count; i++)
+        {
+            hotspots[i] = Hotspot();
+            hotspots[i].centroid = Point2f(coordinate(rng), coordinate(rng));
+        }
+
+        // Every hotspot to a distinct track within the gate, or to a new track at the cost of the gate
+        double best = 1e300;
+        std::function<void(int, double, int)> search = [&](int i, double total, int usedSlots) {
+            if (i == count)
+            {
+                best = std::min(best, total);
+                return;
+            }
+            search(i + 1, total + gate, usedSlots);
+            for (int slot = 0; slot < MAX_TRACKS; slot++)
+            {
+                if (before[slot].id == 0 || usedSlots & (1 << slot))
+                {
+                    continue;
+                }
+                double distance = squared_distance(hotspots[i].centroid, before[slot].position);
+                if (distance <= gate)
+                {
+                    search(i + 1, total + distance, usedSlots | (1 << slot));
+                }
+            }
+        };
+        search(0, 0, 0);
+
+        tracker.update(hotspots, count, alarms);
+        double total = 0;
+        for (int i = 0; i < count; i++)
+        {
+            CHECK(hotspots[i].trackId != 0);
+            const Track *track = std::find_if(before, before + MAX_TRACKS, [&](const Track &t) { return t.id != 0 && t.id == hotspots[i].trackId; });
+            total += track == before + MAX_TRACKS ? gate : squared_distance(hotspots[i].centroid, track->position);
+            for (int j = 0; j < i; j++)
+            {
+                CHECK(hotspots[j].trackId != hotspots[i].trackId);
+            }
+        }
+        CHECK(std::fabs(total - best) <= 1e-9 * std::max(best, 1.0));
+    }
+}
+
+TEST_CASE("hotspot_tracker/ids_follow_movement")
+{
+    // Two people walking towards each other past a third standing still, hotspots in shuffled order
+    HotspotTracker tracker;
+    tracker.alarmCelcius = 37.5;
+    TrackAlarm alarms[MAX_TRACKS];
+    std::mt19937 rng(2);
+    int ids[3] = {0, 0, 0};
+    std::vector<int> alarmed;
+
+    for (int frame = 0; frame < 100; frame++)
+    {
+        Point2f people[3] = {Point2f(10.f + frame * 2, 50.f), Point2f(210.f - frame * 2, 56.f), Point2f(110.f, 20.f)};
+        int order[3] = {0, 1, 2};
+        std::shuffle(order, order + 3, rng);
+
+        Hotspot hotspots[3];
+        for (int i = 0; i < 3; i++)
+        {
+            hotspots[i].centroid = people[order[i]];
+            hotspots[i].peakCelcius = order[i] == 1 ? 36.0 : 38.0;
+        }
+        int count = tracker.update(hotspots, 3, alarms);
+        for (int a = 0; a < count; a++)
+        {
+            alarmed.push_back(alarms[a].id);
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            CHECK(hotspots[i].trackId != 0);
+            CHECK(frame == 0 || hotspots[i].trackId == ids[order[i]]);
+            ids[order[i]] = hotspots[i].trackId;
+        }
+    }
+
+    // The two over alarmCelcius alarm once each
+    CHECK(alarmed.size() == 2);
+    CHECK(std::find(alarmed.begin(), alarmed.end(), ids[0]) != alarmed.end());
+    CHECK(std::find(alarmed.begin(), alarmed.end(), ids[2]) != alarmed.end());
+}
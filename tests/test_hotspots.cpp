@@ -0,0 +1,177 @@
+// HotspotDetector's run-based labelling against cv::connectedComponentsWithStats
+
+#include "test.h"
+#include "../hotspots.h"
+#include "../thermal.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace cv;
+
+static const int SENSOR = 30000;
+static const int LEVEL = 9000; // hottest raw value that isn't a hotspot
+
+struct Expected
+{
+    int area;
+    Point2d centroid;
+    Point peak; // first of the hottest pixels in row order
+    uint16_t peakRaw;
+};
+
+// A threshold half way between LEVEL and the next raw value, so which pixels are hot is beyond doubt
+static double threshold_celcius()
+{
+    double device_k = device_sensor_to_k(SENSOR);
+    return (temp_from_raw(LEVEL, device_k) + temp_from_raw(LEVEL + 1, device_k)) / 2;
+}
+
+static Mat random_frame(int width, int height, double hotFraction, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::uniform_int_distribution<int> cold(7000, LEVEL), hot(LEVEL + 1, LEVEL + 2000);
+    Mat raw(height, width, CV_16UC1);
+    for (int y = 0; y < height; y++)
+    {
+        uint16_t *p = raw.ptr<uint16_t>(y);
+        for (int x = 0; x < width; x++)
+        {
+            p[x] = (uint16_t)(coin(rng) < hotFraction ? hot(rng) : cold(rng));
+        }
+    }
+    return raw;
+}
+
+// Blobs of at least minArea pixels the way OpenCV labels them, 8-connected
+static std::vector<Expected> reference(const Mat &raw, int minArea)
+{
+    Mat mask(raw.rows, raw.cols, CV_8UC1);
+    for (int y = 0; y < raw.rows; y++)
+    {
+        const uint16_t *in = raw.ptr<uint16_t>(y);
+        uchar *m = mask.ptr<uchar>(y);
+        for (int x = 0; x < raw.cols; x++)
+        {
+            m[x] = in[x] > LEVEL ? 255 : 0;
+        }
+    }
+
+    Mat labels, stats, centroids;
+    int count = connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+    std::vector<Expected> blobs(count);
+    for (int label = 1; label < count; label++)
+    {
+        blobs[label].area = stats.at<int>(label, CC_STAT_AREA);
+        blobs[label].centroid = Point2d(centroids.at<double>(label, 0), centroids.at<double>(label, 1));
+        blobs[label].peakRaw = 0;
+    }
+    for (int y = 0; y < raw.rows; y++)
+    {
+        const uint16_t *in = raw.ptr<uint16_t>(y);
+        const int *l = labels.ptr<int>(y);
+        for (int x = 0; x < raw.cols; x++)
+        {
+            if (l[x] > 0 && in[x] > blobs[l[x]].peakRaw)
+            {
+                blobs[l[x]].peakRaw = in[x];
+                blobs[l[x]].peak = Point(x, y);
+            }
+        }
+    }
+
+    std::vector<Expected> kept;
+    for (int label = 1; label < count; label++)
+    {
+        if (blobs[label].area >= minArea)
+        {
+            kept.push_back(blobs[label]);
+        }
+    }
+    std::stable_sort(kept.begin(), kept.end(), [](const Expected &a, const Expected &b) { return a.peakRaw > b.peakRaw; });
+    return kept;
+}
+
+static void compare(const Mat &raw, int minArea)
+{
+    HotspotDetector detector;
+    detector.thresholdCelcius = threshold_celcius();
+    detector.minArea = minArea;
+    std::vector<Expected> expected = reference(raw, minArea);
+    std::vector<Hotspot> found(expected.size() + 1);
+    int count = detector.detect(raw, SENSOR, found.data(), (int)found.size());
+
+    CHECK(count == (int)expected.size());
+    CHECK(detector.blobs == (int)expected.size());
+    if (count != (int)expected.size())
+    {
+        return;
+    }
+
+    // Peaks tie between blobs now and then, so blobs are matched by their peak pixel rather than by rank
+    double device_k = device_sensor_to_k(SENSOR);
+    for (int i = 0; i < count; i++)
+    {
+        const Hotspot &hotspot = found[i];
+        auto match = std::find_if(expected.begin(), expected.end(), [&](const Expected &e) { return e.peak == hotspot.peak; });
+        CHECK(match != expected.end());
+        if (match == expected.end())
+        {
+            continue;
+        }
+        CHECK(hotspot.area == match->area);
+        CHECK(std::fabs(hotspot.centroid.x - match->centroid.x) < 1e-3);
+        CHECK(std::fabs(hotspot.centroid.y - match->centroid.y) < 1e-3);
+        CHECK(hotspot.peakCelcius == temp_from_raw(match->peakRaw, device_k));
+        CHECK(i == 0 || found[i - 1].peakCelcius >= hotspot.peakCelcius);
+    }
+}
+
+TEST_CASE("hotspots/matches_connected_components")
+{
+    std::mt19937 rng(1);
+    // Sparse specks, tangled blobs with diagonal joins, and nearly everything hot
+    const double fractions[] = {0.05, 0.3, 0.45, 0.6, 0.95};
+    for (double fraction : fractions)
+    {
+        for (int trial = 0; trial < 4; trial++)
+        {
+            Mat raw = random_frame(206, 156, fraction, rng);
+            compare(raw, 1);
+            compare(raw, 4);
+        }
+        compare(random_frame(320, 240, fraction, rng), 4);
+        compare(random_frame(1, 37, fraction, rng), 1);
+        compare(random_frame(37, 1, fraction, rng), 1);
+    }
+}
+
+TEST_CASE("hotspots/capacity_keeps_the_hottest")
+{
+    std::mt19937 rng(2);
+    Mat raw = random_frame(206, 156, 0.3, rng);
+    HotspotDetector detector;
+    detector.thresholdCelcius = threshold_celcius();
+    std::vector<Expected> expected = reference(raw, detector.minArea);
+
+    Hotspot found[MAX_HOTSPOTS];
+    int count = detector.detect(raw, SENSOR, found, MAX_HOTSPOTS);
+    CHECK(count == std::min((int)expected.size(), MAX_HOTSPOTS));
+    CHECK(detector.blobs == (int)expected.size());
+    double device_k = device_sensor_to_k(SENSOR);
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(found[i].peakCelcius == temp_from_raw(expected[i].peakRaw, device_k));
+    }
+}
+
+TEST_CASE("hotspots/nothing_hot")
+{
+    std::mt19937 rng(3);
+    HotspotDetector detector;
+    detector.thresholdCelcius = threshold_celcius();
+    Hotspot found[MAX_HOTSPOTS];
+    CHECK(detector.detect(random_frame(206, 156, 0, rng), SENSOR, found, MAX_HOTSPOTS) == 0);
+    CHECK(detector.blobs == 0);
+}
@@ -0,0 +1,176 @@
+// MulticastSender -> MulticastReceiver over loopback: frames come out byte for byte or are counted as
+//  dropped, with and without simulated loss, and forged fragments never make a frame
+
+#include "test.h"
+#include "../multicast.h"
+#include "../protocol.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+// Sent on the loopback interface only, nothing leaves the box
+static const char *GROUP = "239.255.71.31";
+static const int PORT = 47231;
+static const char *INTERFACE = "127.0.0.1";
+
+// Frame ids from here on only tell the receiver the test frames are over
+static const uint32_t SENTINEL_ID = 1000;
+
+static std::vector<uint8_t> frame_bytes(uint32_t id, std::size_t size)
+{
+    std::mt19937 rng(id);
+    std::vector<uint8_t> bytes(size);
+    for (auto &b : bytes)
+    {
+        b = (uint8_t)rng();
+    }
+    return bytes;
+}
+
+// Sends frames of the given sizes with ids 0, 1, ..., paced so the receive buffer keeps up, then
+//  one byte frames until done is set, as the last test frames may never complete
+static void send_frames(MulticastSender &sender, const std::vector<std::size_t> &sizes, std::atomic<bool> &done)
+{
+    for (uint32_t id = 0; id < sizes.size(); id++)
+    {
+        std::vector<uint8_t> bytes = frame_bytes(id, sizes[id]);
+        CHECK(sender.send(id, PAYLOAD_JPEG, bytes.data(), bytes.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    for (uint32_t id = SENTINEL_ID; !done && id < SENTINEL_ID + 5000; id++)
+    {
+        uint8_t byte = 0;
+        sender.send(id, PAYLOAD_JPEG, &byte, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Receives until the first sentinel, checking every test frame that comes out against what was sent.
+//  Returns the number of test frames received.
+static int receive_frames(MulticastReceiver &receiver, const std::vector<std::size_t> &sizes, std::atomic<bool> &done)
+{
+    int received = 0;
+    uint32_t previous = 0;
+    std::vector<uint8_t> frame;
+    uint32_t id;
+    uint8_t payloadType;
+    while (receiver.receive(frame, id, payloadType))
+    {
+        if (id >= SENTINEL_ID)
+        {
+            break;
+        }
+        CHECK(id < sizes.size());
+        CHECK(received == 0 || id > previous);
+        CHECK(payloadType == PAYLOAD_JPEG);
+        CHECK(id < sizes.size() && frame == frame_bytes(id, sizes[id]));
+        previous = id;
+        received++;
+    }
+    done = true;
+    return received;
+}
+
+TEST_CASE("multicast/round_trip")
+{
+    MulticastReceiver receiver;
+    MulticastSender sender;
+    CHECK(receiver.open(GROUP, PORT, INTERFACE));
+    CHECK(sender.open(GROUP, PORT, 1, MULTICAST_DEFAULT_MTU, INTERFACE));
+
+    // Empty, single fragment, right at and either side of the fragment payload, and many fragments
+    std::size_t fragment = MULTICAST_DEFAULT_MTU - 28 - MULTICAST_HEADER_SIZE;
+    std::vector<std::size_t> sizes = {0, 1, fragment - 1, fragment, fragment + 1, 20000, 100000};
+
+    std::atomic<bool> done(false);
+    std::thread sending(send_frames, std::ref(sender), std::cref(sizes), std::ref(done));
+    int received = receive_frames(receiver, sizes, done);
+    sending.join();
+
+    CHECK(received == (int)sizes.size());
+    CHECK(receiver.framesDropped == 0);
+}
+
+TEST_CASE("multicast/simulated_loss")
+{
+    MulticastReceiver receiver;
+    MulticastSender sender;
+    CHECK(receiver.open(GROUP, PORT, INTERFACE));
+    CHECK(sender.open(GROUP, PORT, 1, MULTICAST_DEFAULT_MTU, INTERFACE));
+    receiver.simulatedLoss = 0.05;
+
+    // 10 fragments a frame, about 60% of them make it. Losing all 10 of a frame, which the receiver
+    //  would never know about, is too unlikely to matter.
+    std::vector<std::size_t> sizes(60, 14000);
+
+    std::atomic<bool> done(false);
+    std::thread sending(send_frames, std::ref(sender), std::cref(sizes), std::ref(done));
+    int received = receive_frames(receiver, sizes, done);
+    sending.join();
+
+    CHECK(receiver.fragmentsLost > 0);
+    CHECK(received > 0);
+    CHECK(receiver.framesDropped > 0);
+    CHECK(received + (int)receiver.framesDropped == (int)sizes.size());
+}
+
+// One datagram as MulticastSender would frame it
+static void send_fragment(int fd, uint32_t id, uint16_t index, uint16_t count, uint32_t size, uint32_t offset, std::size_t length)
+{
+    std::vector<uint8_t> datagram(MULTICAST_HEADER_SIZE + length, 0xAB);
+    put_le(&datagram[0], MULTICAST_MAGIC, 4);
+    put_le(&datagram[4], id, 4);
+    put_le(&datagram[8], index, 2);
+    put_le(&datagram[10], count, 2);
+    put_le(&datagram[12], size, 4);
+    put_le(&datagram[16], offset, 4);
+    datagram[20] = PAYLOAD_JPEG;
+    datagram[21] = 0;
+    put_le(&datagram[22], 0, 2);
+
+    sockaddr_in destination;
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(PORT);
+    inet_pton(AF_INET, GROUP, &destination.sin_addr);
+    CHECK(sendto(fd, datagram.data(), datagram.size(), 0, (sockaddr *)&destination, sizeof(destination)) == (ssize_t)datagram.size());
+}
+
+TEST_CASE("multicast/forged_fragments")
+{
+    MulticastReceiver receiver;
+    MulticastSender sender;
+    CHECK(receiver.open(GROUP, PORT, INTERFACE));
+    CHECK(sender.open(GROUP, PORT, 1, MULTICAST_DEFAULT_MTU, INTERFACE));
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    in_addr interface;
+    inet_pton(AF_INET, INTERFACE, &interface);
+    CHECK(setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) == 0);
+
+    // Sizes no frame may have, or its fragments could never fill: ignored without allocating
+    send_fragment(fd, 1, 0, 1, 0xFFFFFFF0u, 0, 16);
+    send_fragment(fd, 2, 0, 2, 2 * 65507, 0, 16);
+    // Every fragment there, but overlapping or short of the size
+    send_fragment(fd, 3, 0, 2, 20, 0, 10);
+    send_fragment(fd, 3, 1, 2, 20, 0, 10);
+    send_fragment(fd, 4, 0, 2, 20, 0, 5);
+    send_fragment(fd, 4, 1, 2, 20, 5, 5);
+    close(fd);
+
+    std::vector<uint8_t> bytes = frame_bytes(5, 3000);
+    CHECK(sender.send(5, PAYLOAD_JPEG, bytes.data(), bytes.size()));
+
+    std::vector<uint8_t> frame;
+    uint32_t id;
+    uint8_t payloadType;
+    CHECK(receiver.receive(frame, id, payloadType));
+    CHECK(id == 5);
+    CHECK(frame == bytes);
+    CHECK(receiver.framesCompleted == 1);
+    CHECK(receiver.framesDropped == 2);
+}
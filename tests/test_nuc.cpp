@@ -0,0 +1,109 @@
+// NonUniformityCorrection's Q15 gain and int16 offset pass against gain * raw + offset in floating point,
+//  saturation at both ends included
+
+#include "test.h"
+#include "../nuc.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unistd.h>
+
+using namespace cv;
+
+static const int WIDTH = 206;
+static const int HEIGHT = 156;
+
+// Tables only reach apply() through tabulate(), which load() runs
+static void set_tables(NonUniformityCorrection &nuc, const Mat &gain, const Mat &offset)
+{
+    std::string path = std::string(P_tmpdir) + "/thermal_seek_test_nuc_" + std::to_string(getpid()) + ".yml";
+    NonUniformityCorrection tables;
+    tables.gain = gain;
+    tables.offset = offset;
+    CHECK(tables.save(path));
+    CHECK(nuc.load(path));
+    std::remove(path.c_str());
+}
+
+static double saturate(double value)
+{
+    return std::min(std::max(value, 0.0), 65535.0);
+}
+
+// Corrects raw with random tables, and checks it against the float formula: exactly once the gain is
+//  rounded to Q15 and the offset to whole counts as the tables do, within 2 counts without
+static void check_against_float(const Mat &raw, const Mat &gain, const Mat &offset)
+{
+    NonUniformityCorrection nuc;
+    set_tables(nuc, gain, offset);
+    Mat corrected = raw.clone();
+    nuc.apply(corrected);
+
+    for (int y = 0; y < raw.rows; y++)
+    {
+        for (int x = 0; x < raw.cols; x++)
+        {
+            float g = gain.at<float>(y, x), o = offset.at<float>(y, x);
+            int r = raw.at<uint16_t>(y, x);
+            int out = corrected.at<uint16_t>(y, x);
+
+            double q15 = std::lround(std::min(std::max(g, 0.0f), 1.99f) * 32768) / 32768.0;
+            double exact = saturate(std::floor(q15 * r + 0.5) + std::lround(o));
+            CHECK(out == exact);
+            CHECK(std::fabs(out - saturate(g * (float)r + o)) <= 2);
+        }
+    }
+}
+
+TEST_CASE("nuc/matches_float")
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> gains(0.5f, 1.99f);
+    std::uniform_real_distribution<float> offsets(-32768, 32767);
+
+    for (int trial = 0; trial < 20; trial++)
+    {
+        Mat raw(HEIGHT, WIDTH, CV_16UC1), gain(HEIGHT, WIDTH, CV_32FC1), offset(HEIGHT, WIDTH, CV_32FC1);
+        for (int y = 0; y < HEIGHT; y++)
+        {
+            for (int x = 0; x < WIDTH; x++)
+            {
+                raw.at<uint16_t>(y, x) = (uint16_t)(rng() % 65536);
+                gain.at<float>(y, x) = gains(rng);
+                offset.at<float>(y, x) = offsets(rng);
+            }
+        }
+        check_against_float(raw, gain, offset);
+    }
+}
+
+TEST_CASE("nuc/saturates")
+{
+    // Columns: the brightest count at the largest gain, with and without a positive offset, and small
+    //  counts with offsets taking them below 0. Rows step the offset.
+    Mat raw(8, 6, CV_16UC1), gain(8, 6, CV_32FC1), offset(8, 6, CV_32FC1);
+    const uint16_t counts[6] = {65535, 65535, 65535, 0, 100, 8000};
+    const float gainValues[6] = {1.99f, 1.99f, 1.0f, 1.0f, 1.5f, 0.5f};
+    for (int y = 0; y < raw.rows; y++)
+    {
+        for (int x = 0; x < raw.cols; x++)
+        {
+            raw.at<uint16_t>(y, x) = counts[x];
+            gain.at<float>(y, x) = gainValues[x];
+            offset.at<float>(y, x) = x < 3 ? (x == 0 ? 0.0f : 4000.0f * y) : -1.0f - 3000.0f * y;
+        }
+    }
+    check_against_float(raw, gain, offset);
+
+    NonUniformityCorrection nuc;
+    set_tables(nuc, gain, offset);
+    nuc.apply(raw);
+    for (int y = 0; y < raw.rows; y++)
+    {
+        CHECK(raw.at<uint16_t>(y, 0) == 65535);
+        CHECK(raw.at<uint16_t>(y, 1) == 65535);
+        CHECK(raw.at<uint16_t>(y, 3) == 0);
+        CHECK(y < 1 || raw.at<uint16_t>(y, 4) == 0);
+    }
+}
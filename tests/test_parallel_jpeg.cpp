@@ -0,0 +1,81 @@
+// ParallelJpegEncoder against a single cv::imencode of the whole frame, byte for byte
+
+#include "test.h"
+#include "../parallel_jpeg.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+using namespace cv;
+
+// Gradients with some texture, so every MCU codes something different
+static Mat pattern(int width, int height, int type)
+{
+    Mat image(height, width, type);
+    int channels = image.channels();
+    for (int y = 0; y < height; y++)
+    {
+        uchar *p = image.ptr<uchar>(y);
+        for (int x = 0; x < width * channels; x++)
+        {
+            p[x] = (uchar)(x / channels + 2 * y + ((x * 7 + y * 13) % 23) * 3 + (x % channels) * 40);
+        }
+    }
+    return image;
+}
+
+// What the stitched bands have to come out as: one restart per MCU row, 16 pixels wide for 4:2:0 colour
+//  and 8 for grey
+static std::vector<uchar> reference(const Mat &image, int quality)
+{
+    int mcuWidth = image.channels() == 1 ? 8 : 16;
+    std::vector<uchar> out;
+    imencode(".jpeg", image, out, {IMWRITE_JPEG_QUALITY, quality, IMWRITE_JPEG_RST_INTERVAL, (image.cols + mcuWidth - 1) / mcuWidth});
+    return out;
+}
+
+static std::vector<uchar> single(const Mat &image, int quality)
+{
+    std::vector<uchar> out;
+    imencode(".jpeg", image, out, {IMWRITE_JPEG_QUALITY, quality});
+    return out;
+}
+
+TEST_CASE("parallel_jpeg/matches_single_encode")
+{
+    // Frame sizes of the streamer, one with a partial last MCU row and column, and grey frames
+    const int sizes[][3] = {{844, 624, CV_8UC3}, {644, 824, CV_8UC3}, {621, 467, CV_8UC3}, {320, 240, CV_8UC1}, {206, 156, CV_8UC1}};
+
+    for (int workers = 1; workers <= 8; workers++)
+    {
+        WorkerPool pool;
+        pool.start(workers, false);
+        for (auto &size : sizes)
+        {
+            Mat image = pattern(size[0], size[1], size[2]);
+            ParallelJpegEncoder encoder;
+            std::vector<uchar> out;
+            CHECK(encoder.encode(image, out, &pool));
+            CHECK(out == reference(image, encoder.quality));
+        }
+        pool.stop();
+    }
+}
+
+TEST_CASE("parallel_jpeg/falls_back_to_single_encode")
+{
+    WorkerPool pool;
+    pool.start(4, false);
+    ParallelJpegEncoder encoder;
+    encoder.quality = 80;
+    std::vector<uchar> out;
+
+    // Too small to split
+    Mat small = pattern(77, 50, CV_8UC3);
+    CHECK(encoder.encode(small, out, &pool));
+    CHECK(out == single(small, encoder.quality));
+
+    // No pool
+    Mat large = pattern(844, 624, CV_8UC3);
+    CHECK(encoder.encode(large, out, nullptr));
+    CHECK(out == single(large, encoder.quality));
+    pool.stop();
+}
@@ -0,0 +1,39 @@
+// Command parsing before and after the hello: every byte is one frame until then, the letters are
+//  commands with their digits after it
+
+#include "test.h"
+#include "../protocol.h"
+
+TEST_CASE("protocol/legacy_until_hello")
+{
+    const char argument[COMMAND_MAX_ARGUMENT_LENGTH] = {'0', '0', '0', '3', '0'};
+    for (char commandByte : {COMMAND_SINGLE_FRAME, COMMAND_FRAMES, COMMAND_SUBSCRIBE, COMMAND_CANCEL,
+                             COMMAND_HEADER_VERSION, COMMAND_PAYLOAD_TYPE, COMMAND_RENDER, COMMAND_QUERY,
+                             COMMAND_RECAPTURE_OFFSETS, 'a', '\n', '\0'})
+    {
+        CHECK(command_argument_length(commandByte, false) == 0);
+        Command command = parse_command(commandByte, argument, false);
+        CHECK(command.type == CommandType::SingleFrame && command.count == 1);
+    }
+}
+
+TEST_CASE("protocol/extended_commands")
+{
+    CHECK(command_argument_length(COMMAND_SINGLE_FRAME, true) == 0);
+    CHECK(command_argument_length(COMMAND_FRAMES, true) == 5);
+    CHECK(command_argument_length(COMMAND_QUERY, true) == COMMAND_MAX_ARGUMENT_LENGTH);
+
+    Command command = parse_command(COMMAND_FRAMES, "00030", true);
+    CHECK(command.type == CommandType::Frames && command.count == 30);
+    command = parse_command(COMMAND_SUBSCRIBE, "015", true);
+    CHECK(command.type == CommandType::Subscribe && command.count == -1 && command.fps == 15);
+    command = parse_command(COMMAND_CANCEL, "", true);
+    CHECK(command.type == CommandType::Cancel && command.count == 0);
+    command = parse_command(COMMAND_HEADER_VERSION, "9", true);
+    CHECK(command.type == CommandType::SetHeaderVersion && command.headerVersion == FRAME_HEADER_VERSION);
+    command = parse_command(COMMAND_QUERY, "0001000200300040", true);
+    CHECK(command.type == CommandType::Query && command.x == 1 && command.y == 2 && command.width == 30 &&
+          command.height == 40);
+    command = parse_command('a', "", true);
+    CHECK(command.type == CommandType::SingleFrame && command.count == 1);
+}
@@ -0,0 +1,141 @@
+// Lossless round trips through RawEncoder / RawDecoder and rejection of payloads a decoder must not trust
+
+#include "test.h"
+#include "../raw_codec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace cv;
+
+static const int WIDTH = 206;
+static const int HEIGHT = 156;
+
+// Vignetted background, a warm blob moving right and sensor noise, like the synthetic source
+static Mat scene(int frame, std::mt19937 &rng)
+{
+    std::normal_distribution<double> noise(0, 6);
+    Mat raw(HEIGHT, WIDTH, CV_16UC1);
+    for (int y = 0; y < HEIGHT; y++)
+    {
+        uint16_t *p = raw.ptr<uint16_t>(y);
+        for (int x = 0; x < WIDTH; x++)
+        {
+            double vignette = -20 * std::hypot(x - WIDTH / 2.0, y - HEIGHT / 2.0);
+            double blob = 600 * std::exp(-(std::pow(x - 50 - frame, 2) + std::pow(y - 70, 2)) / 200.0);
+            p[x] = (uint16_t)std::min(std::max(8000 + vignette + blob + noise(rng), 0.0), 65535.0);
+        }
+    }
+    return raw;
+}
+
+static bool same(const Mat &a, const Mat &b)
+{
+    return a.size() == b.size() && a.type() == b.type() && memcmp(a.data, b.data, a.total() * a.elemSize()) == 0;
+}
+
+TEST_CASE("raw_codec/round_trip")
+{
+    std::mt19937 rng(1);
+    RawEncoder encoder;
+    RawDecoder decoder;
+    std::vector<uint8_t> payload;
+    bool modes[3] = {false, false, false};
+
+    for (int frame = 0; frame < 100; frame++)
+    {
+        Mat raw = scene(frame, rng);
+        if (frame == 50)
+        {
+            raw.at<uint16_t>(3, 3) = 65535; // a residual only an escape can hold
+        }
+        encoder.encode(raw, payload);
+        CHECK(RawDecoder::is_intra(payload.data(), payload.size()) == encoder.lastWasIntra());
+        if (payload.size() > 1 && payload[1] <= RAW_MODE_BOTH)
+        {
+            modes[payload[1]] = true;
+        }
+
+        Mat decoded;
+        CHECK(decoder.decode(payload.data(), payload.size(), decoded));
+        CHECK(same(decoded, raw));
+    }
+
+    CHECK(modes[RAW_MODE_INTRA]);
+    CHECK(modes[RAW_MODE_TEMPORAL] || modes[RAW_MODE_BOTH]);
+}
+
+TEST_CASE("raw_codec/incompressible")
+{
+    std::mt19937 rng(2);
+    Mat raw(HEIGHT, WIDTH, CV_16UC1);
+    for (size_t i = 0; i < raw.total(); i++)
+    {
+        ((uint16_t *)raw.data)[i] = (uint16_t)rng();
+    }
+
+    RawEncoder encoder;
+    RawDecoder decoder;
+    std::vector<uint8_t> payload;
+    encoder.encode(raw, payload);
+    Mat decoded;
+    CHECK(decoder.decode(payload.data(), payload.size(), decoded));
+    CHECK(same(decoded, raw));
+}
+
+TEST_CASE("raw_codec/missed_frame")
+{
+    std::mt19937 rng(3);
+    RawEncoder encoder;
+    RawDecoder decoder;
+    std::vector<uint8_t> payload;
+    Mat decoded;
+
+    encoder.encode(scene(0, rng), payload);
+    CHECK(decoder.decode(payload.data(), payload.size(), decoded));
+    encoder.encode(scene(1, rng), payload); // never reaches the decoder
+    encoder.encode(scene(2, rng), payload);
+    CHECK(!encoder.lastWasIntra());
+    CHECK(!decoder.decode(payload.data(), payload.size(), decoded));
+
+    // Back in sync with the next intra frame
+    encoder.reset();
+    Mat raw = scene(3, rng);
+    encoder.encode(raw, payload);
+    CHECK(decoder.decode(payload.data(), payload.size(), decoded));
+    CHECK(same(decoded, raw));
+}
+
+TEST_CASE("raw_codec/hostile_payloads")
+{
+    std::mt19937 rng(4);
+    RawEncoder encoder;
+    std::vector<uint8_t> payload;
+    encoder.encode(scene(0, rng), payload);
+    Mat decoded;
+
+    // Oversized frames are refused before anything gets allocated
+    std::vector<uint8_t> wide = payload;
+    wide[2] = (RAW_CODEC_MAX_WIDTH + 1) & 0xFF;
+    wide[3] = (RAW_CODEC_MAX_WIDTH + 1) >> 8;
+    CHECK(!RawDecoder().decode(wide.data(), wide.size(), decoded));
+
+    std::vector<uint8_t> tall = payload;
+    tall[4] = 0xFF;
+    tall[5] = 0xFF;
+    CHECK(!RawDecoder().decode(tall.data(), tall.size(), decoded));
+
+    // More escapes than pixels
+    std::vector<uint8_t> escapes = payload;
+    escapes[16] = escapes[17] = escapes[18] = escapes[19] = 0xFF;
+    CHECK(!RawDecoder().decode(escapes.data(), escapes.size(), decoded));
+
+    // Every truncation of a valid payload
+    for (size_t size = 0; size < payload.size(); size++)
+    {
+        CHECK(!RawDecoder().decode(payload.data(), size, decoded));
+    }
+
+    CHECK(RawDecoder().decode(payload.data(), payload.size(), decoded));
+}
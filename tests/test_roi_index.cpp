@@ -0,0 +1,108 @@
+// RoiIndex's summed-area and sparse tables against brute force over random rectangles
+
+#include "test.h"
+#include "../roi_index.h"
+#include "../thermal.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace cv;
+
+static Mat random_frame(Size size, std::mt19937 &rng)
+{
+    Mat raw(size, CV_16UC1);
+    for (int y = 0; y < raw.rows; y++)
+    {
+        for (int x = 0; x < raw.cols; x++)
+        {
+            raw.at<uint16_t>(y, x) = (uint16_t)(rng() % 65536);
+        }
+    }
+    return raw;
+}
+
+// Queries rect and checks it against the pixels of its part inside the frame
+static void check_query(const RoiIndex &index, const Mat &raw, Rect rect, int deviceTempSensor)
+{
+    Rect inside = rect & Rect(0, 0, raw.cols, raw.rows);
+    RoiStats stats;
+    bool found = index.query(rect, stats);
+    CHECK(found == (inside.area() > 0));
+    if (!found || inside.area() <= 0)
+    {
+        return;
+    }
+
+    int64_t total = 0;
+    int minRaw = 65535, maxRaw = 0;
+    for (int y = inside.y; y < inside.y + inside.height; y++)
+    {
+        for (int x = inside.x; x < inside.x + inside.width; x++)
+        {
+            int value = raw.at<uint16_t>(y, x);
+            total += value;
+            minRaw = std::min(minRaw, value);
+            maxRaw = std::max(maxRaw, value);
+        }
+    }
+    double meanRaw = (double)total / inside.area();
+    double device_k = device_sensor_to_k(deviceTempSensor);
+
+    CHECK(stats.rect == inside);
+    CHECK(std::fabs(stats.meanRaw - meanRaw) <= 1e-9 * meanRaw);
+    CHECK(stats.minRaw == minRaw);
+    CHECK(stats.maxRaw == maxRaw);
+    CHECK(std::fabs(stats.min - temp_from_raw(minRaw, device_k)) <= 1e-9);
+    CHECK(std::fabs(stats.max - temp_from_raw(maxRaw, device_k)) <= 1e-9);
+    CHECK(std::fabs(stats.mean - (temp_from_raw(0, device_k) + meanRaw * (temp_from_raw(1, device_k) - temp_from_raw(0, device_k)))) <= 1e-6);
+}
+
+TEST_CASE("roi_index/brute_force")
+{
+    std::mt19937 rng(1);
+    WorkerPool pool;
+    pool.start(3, false);
+    const int SENSOR = 6616;
+
+    for (Size size : {Size(206, 156), Size(320, 240)})
+    {
+        for (WorkerPool *onPool : {(WorkerPool *)nullptr, &pool})
+        {
+            Mat raw = random_frame(size, rng);
+            RoiIndex index;
+            index.build(raw, SENSOR, 7, onPool);
+            CHECK(index.sequence == 7);
+            CHECK(index.size == size);
+
+            // 1 pixel at the corners and inside, the full frame, powers of two and one either side
+            for (Point p : {Point(0, 0), Point(size.width - 1, 0), Point(0, size.height - 1), Point(size.width - 1, size.height - 1), Point(100, 77)})
+            {
+                check_query(index, raw, Rect(p, Size(1, 1)), SENSOR);
+            }
+            check_query(index, raw, Rect(0, 0, size.width, size.height), SENSOR);
+            for (int side : {2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 63, 64, 65, 127, 128, 129})
+            {
+                check_query(index, raw, Rect(3, 5, side, std::min(side + 1, size.height - 5)), SENSOR);
+                check_query(index, raw, Rect(size.width - side, size.height - side, side, side), SENSOR);
+            }
+
+            // Anywhere, partly or wholly off the frame
+            std::uniform_int_distribution<int> x(-60, size.width + 20), y(-60, size.height + 20);
+            std::uniform_int_distribution<int> width(1, size.width + 80), height(1, size.height + 80);
+            for (int trial = 0; trial < 2000; trial++)
+            {
+                check_query(index, raw, Rect(x(rng), y(rng), width(rng), height(rng)), SENSOR);
+            }
+            for (int trial = 0; trial < 2000; trial++)
+            {
+                std::uniform_int_distribution<int> small(1, 12);
+                check_query(index, raw, Rect(x(rng), y(rng), small(rng), small(rng)), SENSOR);
+            }
+
+            RoiStats stats;
+            CHECK(!index.query(Rect(size.width, 0, 10, 10), stats));
+            CHECK(!index.query(Rect(-10, -10, 10, 10), stats));
+        }
+    }
+}
@@ -0,0 +1,115 @@
+// The fused rotate + upscale kernels against transpose / flip + cv::resize, and rotate_point / find_rotated
+//  against the rotated frame itself
+
+#include "test.h"
+#include "../rotate_scale.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <random>
+
+using namespace cv;
+
+static const int ROTATIONS[] = {0, 90, 180, 270};
+
+// The way process_frame rotated before the kernels, clockwise
+static Mat rotated(const Mat &src, int rotate)
+{
+    Mat out;
+    switch (rotate)
+    {
+    case 90:
+        transpose(src, out);
+        flip(out, out, 1);
+        break;
+    case 180:
+        flip(src, out, -1);
+        break;
+    case 270:
+        transpose(src, out);
+        flip(out, out, 0);
+        break;
+    default:
+        out = src.clone();
+    }
+    return out;
+}
+
+static Mat random_frame(Size size, int levels, std::mt19937 &rng)
+{
+    Mat frame(size, CV_8UC1);
+    for (int y = 0; y < frame.rows; y++)
+    {
+        for (int x = 0; x < frame.cols; x++)
+        {
+            frame.at<uchar>(y, x) = (uchar)(rng() % levels);
+        }
+    }
+    return frame;
+}
+
+TEST_CASE("rotate_scale/matches_resize")
+{
+    std::mt19937 rng(1);
+    for (Size size : {Size(206, 156), Size(7, 5)})
+    {
+        Mat src = random_frame(size, 256, rng);
+        for (int rotate : ROTATIONS)
+        {
+            Mat reference = rotated(src, rotate);
+            for (int factor = 1; factor <= 4; factor++)
+            {
+                Size dstSize = rotate_scale_size(size, rotate, factor);
+                CHECK(dstSize == Size(reference.cols * factor, reference.rows * factor));
+
+                for (int interpolation : {INTER_NEAREST, INTER_LINEAR})
+                {
+                    RotateScaleKernel kernel = rotate_scale_kernel(rotate, interpolation);
+                    CHECK(kernel != nullptr);
+                    if (!kernel)
+                    {
+                        continue;
+                    }
+
+                    // In two bands, the way parallel_for calls it
+                    Mat dst(dstSize, CV_8UC1), expected;
+                    kernel(src, dst, factor, 0, dst.rows / 3);
+                    kernel(src, dst, factor, dst.rows / 3, dst.rows);
+                    resize(reference, expected, dstSize, 0, 0, interpolation);
+
+                    double difference = norm(dst, expected, NORM_INF);
+                    CHECK(interpolation == INTER_NEAREST ? difference == 0 : difference <= 1);
+                }
+            }
+        }
+    }
+
+    CHECK(rotate_scale_kernel(45, INTER_LINEAR) == nullptr);
+    CHECK(rotate_scale_kernel(90, INTER_CUBIC) == nullptr);
+}
+
+TEST_CASE("rotate_scale/points")
+{
+    std::mt19937 rng(2);
+    for (Size size : {Size(206, 156), Size(7, 5)})
+    {
+        for (int trial = 0; trial < 20; trial++)
+        {
+            // Few levels, so the max comes up many times and the first match in row order matters
+            Mat src = random_frame(size, trial % 2 ? 4 : 256, rng);
+            for (int rotate : ROTATIONS)
+            {
+                Mat reference = rotated(src, rotate);
+
+                Point p((int)(rng() % size.width), (int)(rng() % size.height));
+                Point moved = rotate_point(p, size, rotate);
+                CHECK(Rect(0, 0, reference.cols, reference.rows).contains(moved));
+                CHECK(reference.at<uchar>(moved) == src.at<uchar>(p));
+
+                double minValue, maxValue;
+                Point minLoc, maxLoc;
+                minMaxLoc(reference, &minValue, &maxValue, &minLoc, &maxLoc);
+                CHECK(find_rotated(src, rotate, (uchar)maxValue) == maxLoc);
+                CHECK(find_rotated(src, rotate, (uchar)minValue) == minLoc);
+            }
+        }
+    }
+}
@@ -0,0 +1,141 @@
+// ShmRingWriter -> ShmRingReader in one process: frames come through as published, a reader the writer
+//  lapped finds out, and a slot caught mid-write is read again once the writer is done
+
+#include "test.h"
+#include "../shm_ring.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace cv;
+
+static const uint32_t SLOTS = 4;
+static const Size RAW_SIZE(206, 156);
+static const Size BGR_SIZE(624, 824);
+
+static std::string ring_name()
+{
+    return "thermal_seek_test_ring_" + std::to_string(getpid());
+}
+
+static Mat raw_frame(int seed)
+{
+    Mat raw(RAW_SIZE, CV_16UC1);
+    randu(raw, Scalar(seed * 100), Scalar(seed * 100 + 5000));
+    return raw;
+}
+
+static Mat bgr_frame(int seed)
+{
+    Mat bgr(BGR_SIZE, CV_8UC3);
+    randu(bgr, Scalar::all(0), Scalar::all(256));
+    bgr.at<Vec3b>(0, 0) = Vec3b(seed, seed, seed);
+    return bgr;
+}
+
+static bool same(const Mat &a, const Mat &b)
+{
+    return a.size() == b.size() && a.type() == b.type() && norm(a, b, NORM_INF) == 0;
+}
+
+TEST_CASE("shm_ring/publish_acquire")
+{
+    ShmRingWriter writer;
+    ShmRingReader reader;
+    CHECK(writer.create(ring_name(), SLOTS, RAW_SIZE, BGR_SIZE));
+    CHECK(reader.open(ring_name()));
+
+    ShmFrameView view;
+    CHECK(!reader.acquire(view, 0));
+
+    for (int frame = 1; frame <= 10; frame++)
+    {
+        Mat raw = raw_frame(frame), bgr = bgr_frame(frame);
+        writer.publish(raw, bgr, 1000 + frame, 5000000 + frame, 6000 + frame);
+
+        CHECK(reader.acquire(view, 100));
+        CHECK(view.sequence == (uint64_t)(1000 + frame));
+        CHECK(view.captureTimeUs == (uint64_t)(5000000 + frame));
+        CHECK(view.deviceTempSensor == 6000 + frame);
+        CHECK(same(view.raw, raw));
+        CHECK(same(view.bgr, bgr));
+        CHECK(reader.valid(view));
+    }
+    CHECK(reader.skipped == 0);
+
+    // Nothing newer yet
+    CHECK(!reader.acquire(view, 10));
+}
+
+TEST_CASE("shm_ring/lapped_reader")
+{
+    ShmRingWriter writer;
+    ShmRingReader reader;
+    CHECK(writer.create(ring_name(), SLOTS, RAW_SIZE, BGR_SIZE));
+    CHECK(reader.open(ring_name()));
+
+    Mat raw = raw_frame(1), bgr = bgr_frame(1);
+    writer.publish(raw, bgr, 1, 0, 0);
+    ShmFrameView view;
+    CHECK(reader.acquire(view, 100));
+
+    // The slot survives SLOTS - 1 newer frames, the next one reuses it
+    for (uint32_t i = 0; i < SLOTS - 1; i++)
+    {
+        writer.publish(raw_frame(2 + i), bgr_frame(2 + i), 2 + i, 0, 0);
+        CHECK(reader.valid(view));
+    }
+    CHECK(same(view.raw, raw));
+    writer.publish(raw_frame(9), bgr_frame(9), 1 + SLOTS, 0, 0);
+    CHECK(!reader.valid(view));
+
+    // Coming back, the reader gets the newest frame and counts the ones it never saw
+    CHECK(reader.acquire(view, 100));
+    CHECK(view.sequence == 1 + SLOTS);
+    CHECK(reader.valid(view));
+    CHECK(reader.skipped == SLOTS - 1);
+}
+
+TEST_CASE("shm_ring/seqlock_retry")
+{
+    ShmRingWriter writer;
+    ShmRingReader reader;
+    CHECK(writer.create(ring_name(), SLOTS, RAW_SIZE, BGR_SIZE));
+    CHECK(reader.open(ring_name()));
+    writer.publish(raw_frame(1), bgr_frame(1), 1, 0, 0);
+
+    // Play a writer caught in the middle of rewriting the newest slot, through a mapping of our own
+    int fd = shm_open(("/" + ring_name()).c_str(), O_RDWR, 0);
+    CHECK(fd >= 0);
+    std::size_t size = lseek(fd, 0, SEEK_END);
+    uint8_t *mapping = (uint8_t *)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    CHECK(mapping != MAP_FAILED);
+
+    ShmRingHeader *header = (ShmRingHeader *)mapping;
+    ShmSlotHeader *slot = (ShmSlotHeader *)(mapping + (sizeof(ShmRingHeader) + 63) / 64 * 64);
+    uint32_t lock = slot->lock.load();
+    CHECK(lock % 2 == 0);
+    CHECK(header->published.load() == 1);
+    slot->lock.store(lock + 1);
+    slot->sequence = 2;
+
+    // The reader has to keep retrying until the lock is even again, then see what was written under it
+    std::thread finishing([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        slot->sequence = 3;
+        slot->lock.store(lock + 2, std::memory_order_release);
+    });
+    ShmFrameView view;
+    CHECK(reader.acquire(view, 1000));
+    finishing.join();
+
+    CHECK(view.sequence == 3);
+    CHECK(view.lock == lock + 2);
+    CHECK(reader.valid(view));
+
+    munmap(mapping, size);
+}
@@ -0,0 +1,168 @@
+// WorkerPool: parallel_for covers every index once however it is split, nested or not, submit + wait
+//  runs everything, and the counters add up
+
+#include "test.h"
+#include "../worker_pool.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Runs parallel_for over count and checks every index came up exactly once, in non-empty bands
+static void check_coverage(WorkerPool &pool, int count, int grain)
+{
+    std::unique_ptr<std::atomic<int>[]> hits(new std::atomic<int>[count > 0 ? count : 1]);
+    for (int i = 0; i < count; i++)
+    {
+        hits[i] = 0;
+    }
+    std::atomic<bool> emptyBand(false);
+
+    pool.parallel_for(count, grain, [&](int begin, int end) {
+        emptyBand = emptyBand || begin >= end;
+        for (int i = begin; i < end; i++)
+        {
+            hits[i]++;
+        }
+    });
+
+    CHECK(!emptyBand);
+    bool once = true;
+    for (int i = 0; i < count; i++)
+    {
+        once = once && hits[i] == 1;
+    }
+    CHECK(once);
+}
+
+TEST_CASE("worker_pool/parallel_for_coverage")
+{
+    for (int workers : {0, 1, 3, 8})
+    {
+        WorkerPool pool;
+        if (workers > 0)
+        {
+            pool.start(workers, false);
+        }
+        for (int count : {0, 1, 2, 7, 100, 156, 1000})
+        {
+            for (int grain : {0, 1, 16, 1000})
+            {
+                check_coverage(pool, count, grain);
+            }
+        }
+    }
+}
+
+TEST_CASE("worker_pool/nested_parallel_for")
+{
+    WorkerPool pool;
+    pool.start(4, false);
+
+    // Frame tasks of several cameras, each splitting its frame into bands that split again
+    const int TASKS = 16, ROWS = 120, COLS = 50;
+    std::vector<std::unique_ptr<std::atomic<int>[]>> hits;
+    for (int t = 0; t < TASKS; t++)
+    {
+        hits.emplace_back(new std::atomic<int>[ROWS * COLS]);
+        for (int i = 0; i < ROWS * COLS; i++)
+        {
+            hits[t][i] = 0;
+        }
+    }
+
+    for (int t = 0; t < TASKS; t++)
+    {
+        pool.submit([&pool, &hits, t]() {
+            pool.parallel_for(ROWS, 8, [&](int rowBegin, int rowEnd) {
+                for (int row = rowBegin; row < rowEnd; row++)
+                {
+                    pool.parallel_for(COLS, 4, [&](int colBegin, int colEnd) {
+                        for (int col = colBegin; col < colEnd; col++)
+                        {
+                            hits[t][row * COLS + col]++;
+                        }
+                    });
+                }
+            });
+        });
+    }
+    pool.wait();
+
+    bool once = true;
+    for (int t = 0; t < TASKS; t++)
+    {
+        for (int i = 0; i < ROWS * COLS; i++)
+        {
+            once = once && hits[t][i] == 1;
+        }
+    }
+    CHECK(once);
+}
+
+TEST_CASE("worker_pool/submit_wait")
+{
+    WorkerPool pool;
+    pool.start(3, false);
+
+    // Tasks from outside and tasks submitted by tasks, all done once wait() returns
+    std::atomic<int> ran(0);
+    for (int i = 0; i < 200; i++)
+    {
+        pool.submit([&pool, &ran]() {
+            ran++;
+            for (int j = 0; j < 4; j++)
+            {
+                pool.submit([&ran]() { ran++; });
+            }
+        });
+    }
+    pool.wait();
+    CHECK(ran == 200 * 5);
+
+    // The pool is reusable after a wait, and a wait with nothing queued returns
+    pool.submit([&ran]() { ran++; });
+    pool.wait();
+    pool.wait();
+    CHECK(ran == 200 * 5 + 1);
+
+    // Without workers submit runs the task on the spot
+    WorkerPool inline_;
+    bool ranInline = false;
+    inline_.submit([&ranInline]() { ranInline = true; });
+    CHECK(ranInline);
+    inline_.wait();
+}
+
+TEST_CASE("worker_pool/stats")
+{
+    WorkerPool pool;
+    pool.start(4, false);
+
+    // One task queues the others on its own worker's deque and keeps that worker busy, so the rest of
+    //  the pool has to steal them
+    const int CHILDREN = 40;
+    pool.submit([&pool]() {
+        for (int i = 0; i < CHILDREN; i++)
+        {
+            pool.submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    });
+    pool.wait();
+
+    std::vector<WorkerPool::WorkerStats> stats = pool.stats();
+    CHECK(stats.size() == 4);
+    uint64_t tasks = 0, stolen = 0;
+    for (auto &worker : stats)
+    {
+        CHECK(worker.stolen <= worker.tasks);
+        CHECK(worker.utilization >= 0 && worker.utilization <= 1);
+        tasks += worker.tasks;
+        stolen += worker.stolen;
+    }
+    CHECK(tasks == 1 + CHILDREN);
+    CHECK(stolen > 0);
+    CHECK(stats[0].utilization + stats[1].utilization + stats[2].utilization + stats[3].utilization > 0);
+}
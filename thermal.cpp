@@ -0,0 +1,55 @@
+#include "thermal.h"
+#include <cmath>
+#include <cstdlib>
+
+double preAdd = -32.0;
+double multiplier = 5.0 / 9.0;
+double postAdd = 0;
+
+// formula from http://aterlux.ru/article/ntcresistor-en
+static const double ref_temp = 297.0;    // 23C from table
+static const double ref_sensor = 6616.0; // ref value from table
+static const double beta = 200;          // best beta coef we've found
+
+// Constants below are taken from linear trend line in Excel.
+static const double lin_k = -1.5276;        // derived from Excel linear model
+static const double lin_offset = -470.8979; // same Excel model
+
+double device_sensor_to_k(double sensor)
+{
+    double part3 = log(sensor) - log(ref_sensor);
+    double parte = part3 / beta + 1.0 / ref_temp;
+    return 1.0 / parte;
+}
+
+// Inverse of device_sensor_to_k, used to fake the sensor reading of non-Seek sources
+double device_k_to_sensor(double device_k)
+{
+    return ref_sensor * exp(beta * (1.0 / device_k - 1.0 / ref_temp));
+}
+
+double temp_from_raw(int x, double device_k)
+{
+    // -273 is translation of Kelvin to Celsius
+    // 330 is max temperature supported by Seek device
+    // 16384 is full 14 bits value, max possible ()
+    double base = x * 330 / 16384.0;
+
+    auto fahrenheit = base - device_k * lin_k + lin_offset - 273.0;
+    return ((fahrenheit + preAdd) * multiplier) + postAdd;
+}
+
+// Inverse of temp_from_raw. Not rounded, callers decide how to quantize.
+double raw_from_temp(double temp, double device_k)
+{
+    double fahrenheit = (temp - postAdd) / multiplier - preAdd;
+    double base = fahrenheit + 273.0 + device_k * lin_k - lin_offset;
+    return base * 16384.0 / 330;
+}
+
+bool parse_celcius(const std::string &text, double &celcius)
+{
+    char *end;
+    celcius = std::strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && std::isfinite(celcius);
+}
@@ -0,0 +1,20 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <string>
+
+// Temperature adjustment applied on top of the Excel model (see temp_from_raw)
+extern double preAdd;
+extern double multiplier;
+extern double postAdd;
+
+double device_sensor_to_k(double sensor);
+double device_k_to_sensor(double device_k);
+
+double temp_from_raw(int x, double device_k);
+double raw_from_temp(double temp, double device_k);
+
+// The whole of text as a temperature, false for anything but a finite number
+bool parse_celcius(const std::string &text, double &celcius);
+
+#endif
@@ -0,0 +1,143 @@
+// Reference receiver for the streamer's UDP multicast output.
+//
+// Joins the group, reassembles frames and prints once a second how many arrived complete and how many
+//  were dropped. --loss throws away that fraction of datagrams on arrival to show how viewers behave on a
+//  lossy network, e.g. against `streamer --source=synthetic --multicast=239.255.0.1:5004` on loopback.
+//  Grey frames (--multicast-payload=grey) are colorized here, the way any display of them would.
+
+#include <opencv2/highgui/highgui.hpp>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../args.h"
+#include "../grey_frame.h"
+#include "../multicast.h"
+#include "../protocol.h"
+#include "../raw_codec.h"
+
+static volatile sig_atomic_t sigflag = 0;
+
+void handle_sig(int sig)
+{
+    (void)sig;
+    sigflag = 1;
+}
+
+int main(int argc, char const *argv[])
+{
+    args::ArgumentParser parser("Seek Thermal multicast receiver");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> arg_group(parser, "group", "Multicast group:port", {"multicast"});
+    args::ValueFlag<std::string> arg_if(parser, "address", "Address of the interface to join on", {"multicast-if"});
+    args::ValueFlag<std::string> arg_loss(parser, "fraction", "Simulated datagram loss, 0-1", {"loss"});
+    args::Flag arg_show(parser, "show", "Display the frames", {"show"});
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help)
+    {
+        std::cout << parser;
+        return 0;
+    }
+    catch (args::ParseError e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::string target = arg_group ? args::get(arg_group) : "239.255.0.1:5004";
+    auto colon = target.rfind(':');
+    if (colon == std::string::npos)
+    {
+        std::cerr << "Expected group:port, got " << target << std::endl;
+        return 1;
+    }
+
+    MulticastReceiver receiver;
+    if (!receiver.open(target.substr(0, colon), std::stoi(target.substr(colon + 1)), arg_if ? args::get(arg_if) : ""))
+    {
+        return 1;
+    }
+    if (arg_loss)
+    {
+        receiver.simulatedLoss = std::stod(args::get(arg_loss));
+    }
+
+    signal(SIGINT, handle_sig);
+    signal(SIGTERM, handle_sig);
+
+    std::vector<uint8_t> frame;
+    RawDecoder decoder;
+    cv::Mat raw, shown;
+    uint64_t undecodable = 0;
+    uint32_t frameId;
+    uint8_t payloadType;
+    uint64_t lastCompleted = 0, lastDropped = 0;
+    auto lastReport = std::chrono::steady_clock::now();
+
+    while (!sigflag && receiver.receive(frame, frameId, payloadType))
+    {
+        std::string title = "Multicast camera " + std::to_string(receiver.cameraId);
+        if (arg_show && payloadType == PAYLOAD_JPEG)
+        {
+            cv::Mat image = cv::imdecode(frame, cv::IMREAD_COLOR);
+            if (!image.empty())
+            {
+                cv::imshow(title, image);
+                cv::waitKey(1);
+            }
+        }
+        else if (arg_show && payloadType == PAYLOAD_GREY_JPEG)
+        {
+            if (decode_grey_frame(frame.data(), frame.size(), shown))
+            {
+                cv::imshow(title, shown);
+                cv::waitKey(1);
+            }
+        }
+        else if (payloadType == PAYLOAD_RAW16_DELTA)
+        {
+            // After a dropped frame nothing decodes until the next intra frame
+            if (!decoder.decode(frame.data(), frame.size(), raw))
+            {
+                undecodable++;
+            }
+            else if (arg_show)
+            {
+                cv::normalize(raw, shown, 0, 255, cv::NORM_MINMAX, CV_8U);
+                cv::imshow(title, shown);
+                cv::waitKey(1);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReport).count();
+        if (elapsed >= 1.0)
+        {
+            uint64_t completed = receiver.framesCompleted - lastCompleted;
+            uint64_t dropped = receiver.framesDropped - lastDropped;
+            printf("%6.1f fps  %4lu dropped  (%.1f%% complete)  last frame %u, %zu bytes\n",
+                   completed / elapsed, (unsigned long)dropped,
+                   100.0 * completed / std::max<uint64_t>(1, completed + dropped), frameId, frame.size());
+
+            lastCompleted = receiver.framesCompleted;
+            lastDropped = receiver.framesDropped;
+            lastReport = now;
+        }
+    }
+
+    printf("%lu frames complete, %lu dropped, %lu fragments received, %lu thrown away\n",
+           (unsigned long)receiver.framesCompleted, (unsigned long)receiver.framesDropped,
+           (unsigned long)receiver.fragmentsReceived, (unsigned long)receiver.fragmentsLost);
+    if (undecodable)
+    {
+        printf("%lu raw frames could not be decoded while waiting for an intra frame\n", (unsigned long)undecodable);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Looks inside a recording segment written by --record.
+//
+// Prints the segment's frame count and time span, and with --out writes frames --from to --to (inclusive)
+//  as 16-bit PNGs together with their metadata, e.g. to pull the frames around an incident:
+//
+//    ./recording_export --segment=run_0003.tsrec --from=1200 --to=1300 --out=incident
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "../args.h"
+#include "../recorder.h"
+
+int main(int argc, char const *argv[])
+{
+    args::ArgumentParser parser("Seek Thermal recording export");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> arg_segment(parser, "file", "Recording segment (.tsrec)", {"segment"});
+    args::ValueFlag<std::string> arg_from(parser, "index", "First frame to export", {"from"});
+    args::ValueFlag<std::string> arg_to(parser, "index", "Last frame to export", {"to"});
+    args::ValueFlag<std::string> arg_out(parser, "prefix", "Write <prefix>_<sequence>.png for every exported frame", {"out"});
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help)
+    {
+        std::cout << parser;
+        return 0;
+    }
+    catch (args::ParseError e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    if (!arg_segment)
+    {
+        std::cerr << parser;
+        return 1;
+    }
+
+    RecordingReader reader;
+    if (!reader.open(args::get(arg_segment)))
+    {
+        return 1;
+    }
+
+    uint64_t count = reader.frameCount();
+    cv::Mat frame;
+    RecordedFrameInfo first, last;
+    if (count == 0 || !reader.read(0, frame, first) || !reader.read(count - 1, frame, last))
+    {
+        std::cout << "No frames recorded" << std::endl;
+        return 0;
+    }
+
+    printf("%lu frames of %dx%d, sequence %lu to %lu, %.1f s\n", (unsigned long)count, reader.frameSize().width,
+           reader.frameSize().height, (unsigned long)first.sequence, (unsigned long)last.sequence,
+           (last.captureTimeUs - first.captureTimeUs) / 1e6);
+
+    if (!arg_out)
+    {
+        return 0;
+    }
+
+    uint64_t from = arg_from ? std::stoull(args::get(arg_from)) : 0;
+    uint64_t to = arg_to ? std::stoull(args::get(arg_to)) : count - 1;
+    for (uint64_t i = from; i <= to && i < count; i++)
+    {
+        RecordedFrameInfo info;
+        reader.read(i, frame, info);
+
+        char fileName[64];
+        sprintf(fileName, "_%010lu.png", (unsigned long)info.sequence);
+        cv::imwrite(args::get(arg_out) + fileName, frame);
+
+        printf("%lu  sequence %lu  captured %lu us  sensor %d  preadd %g multiplier %g postadd %g\n",
+               (unsigned long)i, (unsigned long)info.sequence, (unsigned long)info.captureTimeUs,
+               info.deviceTempSensor, info.preAdd, info.multiplier, info.postAdd);
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Reference reader for the streamer's shared memory output.
+//
+// Maps the ring read-only, waits for each new frame and prints once a second how many arrived, how many
+//  it was too slow to see, how many were overwritten while it looked at them and the capture to read
+//  latency, e.g. against `streamer --source=synthetic --shm=seek` on the same box.
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "../args.h"
+#include "../protocol.h"
+#include "../shm_ring.h"
+
+static volatile sig_atomic_t sigflag = 0;
+
+void handle_sig(int sig)
+{
+    (void)sig;
+    sigflag = 1;
+}
+
+int main(int argc, char const *argv[])
+{
+    args::ArgumentParser parser("Seek Thermal shared memory reader");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> arg_shm(parser, "name", "Shared memory ring to read", {"shm"});
+    args::Flag arg_show(parser, "show", "Display the frames", {"show"});
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help)
+    {
+        std::cout << parser;
+        return 0;
+    }
+    catch (args::ParseError e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    std::string name = arg_shm ? args::get(arg_shm) : "seek";
+
+    signal(SIGINT, handle_sig);
+    signal(SIGTERM, handle_sig);
+
+    // The streamer creates the ring after its first frame, so give it a moment
+    ShmRingReader reader;
+    while (!reader.open(name))
+    {
+        if (sigflag)
+        {
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    ShmFrameView view;
+    cv::Mat shown;
+    uint64_t frames = 0, torn = 0, latencyUs = 0;
+    uint64_t lastFrames = 0, lastSkipped = 0, lastTorn = 0, lastLatencyUs = 0;
+    auto lastReport = std::chrono::steady_clock::now();
+
+    while (!sigflag)
+    {
+        if (reader.acquire(view, 1000))
+        {
+            latencyUs += timestamp_us() - view.captureTimeUs;
+
+            // Anything that outlives this iteration has to be copied out before checking the slot
+            if (arg_show && !view.bgr.empty())
+            {
+                view.bgr.copyTo(shown);
+            }
+
+            if (reader.valid(view))
+            {
+                frames++;
+                if (!shown.empty())
+                {
+                    cv::imshow("Shared memory", shown);
+                    cv::waitKey(1);
+                }
+            }
+            else
+            {
+                torn++;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReport).count();
+        if (elapsed >= 1.0)
+        {
+            uint64_t count = frames + torn - lastFrames - lastTorn;
+            printf("%6.1f fps  %4lu skipped  %4lu torn  %.3f ms capture to read  last frame %lu\n",
+                   (frames - lastFrames) / elapsed, (unsigned long)(reader.skipped - lastSkipped),
+                   (unsigned long)(torn - lastTorn), (latencyUs - lastLatencyUs) / 1000.0 / std::max<uint64_t>(1, count),
+                   (unsigned long)view.sequence);
+
+            lastFrames = frames;
+            lastSkipped = reader.skipped;
+            lastTorn = torn;
+            lastLatencyUs = latencyUs;
+            lastReport = now;
+        }
+    }
+
+    printf("%lu frames read, %lu skipped, %lu torn\n", (unsigned long)frames, (unsigned long)reader.skipped, (unsigned long)torn);
+    return 0;
+}
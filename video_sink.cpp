@@ -0,0 +1,300 @@
+#include "video_sink.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// How often the segment's size on disk is looked at, in frames
+static const uint64_t SIZE_CHECK_INTERVAL = 10;
+
+std::unique_ptr<VideoEncoder> create_video_encoder(const std::string &kind)
+{
+    if (kind == "opencv")
+    {
+        return std::unique_ptr<VideoEncoder>(new OpenCvVideoEncoder());
+    }
+    if (kind == "ffmpeg")
+    {
+        return std::unique_ptr<VideoEncoder>(new FfmpegVideoEncoder());
+    }
+
+    return nullptr;
+}
+
+bool OpenCvVideoEncoder::open(const std::string &fileName, cv::Size frameSize, double fps, const std::string &codec)
+{
+    std::string fourcc = codec.empty() ? "MJPG" : codec;
+    if (fourcc.size() != 4)
+    {
+        std::cerr << "Video codec for OpenCV must be a fourcc, got " << fourcc << std::endl;
+        return false;
+    }
+
+    return writer.open(fileName, cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]), fps, frameSize, true);
+}
+
+bool OpenCvVideoEncoder::write(const cv::Mat &frame)
+{
+    writer.write(frame);
+    return true;
+}
+
+void OpenCvVideoEncoder::close()
+{
+    writer.release();
+}
+
+FfmpegVideoEncoder::~FfmpegVideoEncoder()
+{
+    close();
+}
+
+bool FfmpegVideoEncoder::open(const std::string &fileName, cv::Size frameSize, double fps, const std::string &codec)
+{
+    // Every argument goes to ffmpeg as it is, codec and file names can't run anything
+    std::vector<std::string> arguments = {"ffmpeg", "-loglevel", "error", "-y", "-f", "rawvideo", "-pix_fmt", "bgr24",
+                                          "-s", std::to_string(frameSize.width) + "x" + std::to_string(frameSize.height),
+                                          "-r", std::to_string(fps), "-i", "-", "-c:v", codec.empty() ? "libx264" : codec,
+                                          "-pix_fmt", "yuv420p", fileName};
+    std::vector<char *> argv;
+    for (std::string &argument : arguments)
+    {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    // Close on exec, so the ffmpegs of other cameras don't hold this one's stdin open
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        std::cerr << "Could not create a pipe for ffmpeg: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    child = fork();
+    if (child == 0)
+    {
+        dup2(fds[0], STDIN_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    ::close(fds[0]);
+    if (child < 0)
+    {
+        std::cerr << "Could not start ffmpeg: " << strerror(errno) << std::endl;
+        ::close(fds[1]);
+        return false;
+    }
+    input = fds[1];
+    return true;
+}
+
+bool FfmpegVideoEncoder::write(const cv::Mat &frame)
+{
+    for (int y = 0; y < frame.rows; y++)
+    {
+        const uchar *row = frame.ptr(y);
+        std::size_t rowSize = frame.cols * frame.elemSize();
+        while (rowSize > 0)
+        {
+            ssize_t written = ::write(input, row, rowSize);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            row += written;
+            rowSize -= written;
+        }
+    }
+    return true;
+}
+
+void FfmpegVideoEncoder::close()
+{
+    if (input >= 0)
+    {
+        ::close(input);
+        input = -1;
+    }
+    if (child > 0)
+    {
+        int status = 0;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "ffmpeg failed" << (WIFEXITED(status) && WEXITSTATUS(status) == 127 ? ", is it installed?" : "") << std::endl;
+        }
+        child = -1;
+    }
+}
+
+VideoSink::~VideoSink()
+{
+    stop();
+}
+
+bool VideoSink::start(const VideoSinkOptions &options)
+{
+    this->options = options;
+    encoder = create_video_encoder(options.encoder);
+    if (!encoder)
+    {
+        std::cerr << "Unknown video encoder " << options.encoder << std::endl;
+        return false;
+    }
+
+    auto dot = options.path.rfind('.');
+    auto slash = options.path.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        stem = options.path.substr(0, dot);
+        extension = options.path.substr(dot);
+    }
+    else
+    {
+        stem = options.path;
+        extension = options.encoder == "ffmpeg" ? ".mp4" : ".avi";
+    }
+
+    queue.resize(options.queueDepth);
+    stopping = false;
+    writer = std::thread(&VideoSink::run, this);
+    return true;
+}
+
+void VideoSink::stop()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+
+    if (segmentOpen)
+    {
+        encoder->close();
+        segmentOpen = false;
+        segmentsWritten++;
+    }
+}
+
+bool VideoSink::push(const cv::Mat &frame)
+{
+    std::size_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queued == queue.size())
+        {
+            framesDropped++;
+            return false;
+        }
+        slot = (head + queued) % queue.size();
+    }
+
+    // The writer only ever looks at queued slots, so this one can be filled without the lock
+    frame.copyTo(queue[slot]);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    wake.notify_one();
+    return true;
+}
+
+bool VideoSink::nextSegment(cv::Size frameSize)
+{
+    if (segmentOpen)
+    {
+        encoder->close();
+        segmentOpen = false;
+        segmentsWritten++;
+    }
+
+    char number[16];
+    sprintf(number, "_%04d", segmentNumber++);
+    segmentName = stem + number + extension;
+    segmentOpen = encoder->open(segmentName, frameSize, options.fps, options.codec);
+    if (!segmentOpen)
+    {
+        std::cerr << "Could not open video segment " << segmentName << std::endl;
+        return false;
+    }
+
+    segmentSize = frameSize;
+    segmentStart = std::chrono::steady_clock::now();
+    segmentFrames = 0;
+    return true;
+}
+
+// Time is checked every frame, size every few since it means asking the file system
+bool VideoSink::segmentDone()
+{
+    if (options.segmentSeconds > 0 &&
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - segmentStart).count() >= options.segmentSeconds)
+    {
+        return true;
+    }
+
+    if (options.segmentBytes > 0 && segmentFrames > 0 && segmentFrames % SIZE_CHECK_INTERVAL == 0)
+    {
+        struct stat info;
+        return stat(segmentName.c_str(), &info) == 0 && (uint64_t)info.st_size >= options.segmentBytes;
+    }
+
+    return false;
+}
+
+void VideoSink::run()
+{
+    while (true)
+    {
+        std::size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0)
+            {
+                return;
+            }
+            slot = head;
+        }
+
+        const cv::Mat &frame = queue[slot];
+        if (!segmentOpen || frame.size() != segmentSize || segmentDone())
+        {
+            nextSegment(frame.size());
+        }
+
+        if (segmentOpen && encoder->write(frame))
+        {
+            segmentFrames++;
+            framesWritten++;
+        }
+        else
+        {
+            framesDropped++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % queue.size();
+            queued--;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef VIDEO_SINK_H
+#define VIDEO_SINK_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio/videoio.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+// Encodes one video file. Mirrors FrameSource: the sink doesn't care what does the encoding.
+class VideoEncoder
+{
+public:
+    virtual ~VideoEncoder() = default;
+
+    virtual bool open(const std::string &fileName, cv::Size frameSize, double fps, const std::string &codec) = 0;
+    virtual bool write(const cv::Mat &frame) = 0;
+    virtual void close() = 0;
+};
+
+// "opencv" or "ffmpeg", nullptr for anything else
+std::unique_ptr<VideoEncoder> create_video_encoder(const std::string &kind);
+
+// cv::VideoWriter, codec is a fourcc such as MJPG, avc1 or mp4v
+class OpenCvVideoEncoder : public VideoEncoder
+{
+public:
+    bool open(const std::string &fileName, cv::Size frameSize, double fps, const std::string &codec) override;
+    bool write(const cv::Mat &frame) override;
+    void close() override;
+
+private:
+    cv::VideoWriter writer;
+};
+
+// Raw BGR frames piped into an ffmpeg process, codec is an ffmpeg encoder such as libx264 or mjpeg
+// Runs ffmpeg without a shell and writes frames to its stdin. The process has to ignore SIGPIPE for an
+//  ffmpeg that died to show up as a failed write.
+class FfmpegVideoEncoder : public VideoEncoder
+{
+public:
+    ~FfmpegVideoEncoder();
+
+    bool open(const std::string &fileName, cv::Size frameSize, double fps, const std::string &codec) override;
+    bool write(const cv::Mat &frame) override;
+    void close() override;
+
+private:
+    int input = -1; // write end of ffmpeg's stdin
+    pid_t child = -1;
+};
+
+struct VideoSinkOptions
+{
+    std::string path;              // segments go to <path without extension>_NNNN<extension>
+    std::string encoder = "opencv";
+    std::string codec;             // empty for the encoder's default
+    double fps = 9;
+    double segmentSeconds = 0;     // 0 = never rotate by time
+    uint64_t segmentBytes = 0;     // 0 = never rotate by size
+    int queueDepth = 8;
+};
+
+// Writes processed frames to video files on its own thread. push() copies the frame into a bounded
+//  queue and returns; when the encoder can't keep up the queue is full and new frames are dropped
+//  (counted in framesDropped), so the live output never waits for the video. Meant to be fed from a
+//  single thread.
+class VideoSink
+{
+public:
+    ~VideoSink();
+
+    bool start(const VideoSinkOptions &options);
+    // Encodes whatever is still queued and closes the last segment
+    void stop();
+
+    bool push(const cv::Mat &frame);
+
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> segmentsWritten{0};
+
+private:
+    void run();
+    bool nextSegment(cv::Size frameSize);
+    bool segmentDone();
+
+    VideoSinkOptions options;
+    std::string stem, extension;
+    int segmentNumber = 0;
+    std::unique_ptr<VideoEncoder> encoder;
+    bool segmentOpen = false;
+    std::string segmentName;
+    cv::Size segmentSize;
+    std::chrono::steady_clock::time_point segmentStart;
+    uint64_t segmentFrames = 0;
+
+    std::vector<cv::Mat> queue; // ring, preallocated as frames come in
+    std::size_t head = 0, queued = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+};
+
+#endif
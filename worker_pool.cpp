@@ -0,0 +1,264 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+// Bands parallel_for cuts a range into per worker, a few more than one so stealing can even out bands
+//  that take longer than others
+static const int BANDS_PER_WORKER = 2;
+
+// Which pool and worker the current thread is, so tasks submitted from a task stay on their worker
+static thread_local WorkerPool *currentPool = nullptr;
+static thread_local int currentWorker = -1;
+// Tasks run from within a task (parallel_for helping out) are already in the outer task's busy time
+static thread_local int taskDepth = 0;
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::start(int threads, bool pin)
+{
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores <= 0)
+    {
+        cores = 1;
+    }
+    if (threads <= 0)
+    {
+        threads = cores;
+    }
+
+    stopping = false;
+    started = std::chrono::steady_clock::now();
+
+    // All deques exist before any worker starts looking at them
+    for (int i = 0; i < threads; i++)
+    {
+        workers.emplace_back(new Worker());
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i]->thread = std::thread(&WorkerPool::run, this, i);
+
+        if (pin)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            if (pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpus), &cpus) != 0)
+            {
+                std::cerr << "Could not pin worker " << i << " to core " << i % cores << std::endl;
+            }
+        }
+    }
+}
+
+void WorkerPool::stop()
+{
+    if (workers.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+    {
+        worker->thread.join();
+    }
+    workers.clear();
+}
+
+void WorkerPool::submit(std::function<void()> task)
+{
+    if (workers.empty())
+    {
+        task();
+        return;
+    }
+
+    push(std::move(task));
+}
+
+void WorkerPool::push(std::function<void()> task)
+{
+    int target = currentPool == this ? currentWorker : (int)(nextWorker++ % workers.size());
+
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void WorkerPool::wait()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    idle.wait(lock, [this] { return pending == 0; });
+}
+
+void WorkerPool::parallel_for(int count, int grain, const std::function<void(int, int)> &body)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    int bands = std::min((count + std::max(grain, 1) - 1) / std::max(grain, 1), size() * BANDS_PER_WORKER);
+    if (bands <= 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    // Helpers still queued when the call returns find no band left and never touch body, but hold on
+    //  to the counters
+    struct Bands
+    {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+    };
+    std::shared_ptr<Bands> shared(new Bands());
+    auto runBands = [shared, &body, count, bands]() {
+        for (int band = shared->next++; band < bands; band = shared->next++)
+        {
+            body((int)((int64_t)count * band / bands), (int)((int64_t)count * (band + 1) / bands));
+            shared->done++;
+        }
+    };
+
+    int helpers = std::min(bands - 1, size());
+    for (int i = 0; i < helpers; i++)
+    {
+        push(runBands);
+    }
+
+    runBands();
+    while (shared->done < bands)
+    {
+        std::this_thread::yield();
+    }
+}
+
+std::vector<WorkerPool::WorkerStats> WorkerPool::stats() const
+{
+    double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+
+    std::vector<WorkerStats> result;
+    for (auto &worker : workers)
+    {
+        WorkerStats stats;
+        stats.utilization = elapsedNs > 0 ? worker->busyNs / elapsedNs : 0;
+        stats.tasks = worker->tasksRun;
+        stats.stolen = worker->tasksStolen;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+bool WorkerPool::runOne(int self)
+{
+    std::function<void()> task;
+    bool stolen = false;
+
+    if (self >= 0)
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+
+    if (!task)
+    {
+        int count = size();
+        int first = self >= 0 ? self + 1 : (int)(nextWorker % count);
+        for (int i = 0; i < count && !task; i++)
+        {
+            int victim = (first + i) % count;
+            if (victim == self)
+            {
+                continue;
+            }
+
+            Worker &other = *workers[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.tasks.empty())
+            {
+                task = std::move(other.tasks.front());
+                other.tasks.pop_front();
+                stolen = true;
+            }
+        }
+    }
+
+    if (!task)
+    {
+        return false;
+    }
+    queued--;
+
+    bool outermost = self >= 0 && taskDepth == 0;
+    auto begin = std::chrono::steady_clock::now();
+    taskDepth++;
+    task();
+    taskDepth--;
+
+    if (self >= 0)
+    {
+        Worker &own = *workers[self];
+        if (outermost)
+        {
+            own.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        }
+        own.tasksRun++;
+        if (stolen)
+        {
+            own.tasksStolen++;
+        }
+    }
+
+    if (--pending == 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        idle.notify_all();
+    }
+    return true;
+}
+
+void WorkerPool::run(int index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    while (true)
+    {
+        if (runOne(index))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued <= 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running submitted tasks, with work stealing.
+//
+// Every worker has a deque of its own. Tasks submitted from a worker go onto its deque and the worker
+//  takes its newest task first, while its cache still holds what that task needs. A worker with nothing
+//  left steals the oldest task of another worker, so a frame split into bands spreads over all cores and
+//  frames of several cameras interleave without one core doing all the work. Tasks submitted from any
+//  other thread are dealt round robin.
+class WorkerPool
+{
+public:
+    struct WorkerStats
+    {
+        double utilization; // fraction of the time since start() spent running tasks
+        uint64_t tasks;     // run, stolen ones included
+        uint64_t stolen;    // taken from another worker's deque
+    };
+
+    ~WorkerPool();
+
+    // threads <= 0 starts one worker per online core. With pin set worker i only runs on core i % cores,
+    //  which keeps its caches warm and stops the scheduler from stacking workers on one core.
+    void start(int threads, bool pin);
+    // Runs whatever is still queued, then joins the workers
+    void stop();
+
+    void submit(std::function<void()> task);
+    // Blocks until every deque is empty and no task is running
+    void wait();
+
+    // Calls body(begin, end) over [0, count) split into bands of at least grain and returns once all of
+    //  them are done. The calling thread and helper tasks on the workers take bands of this call one at a
+    //  time until none are left, then the caller waits for those still running. The caller only ever runs
+    //  bands of its own call, never another queued task: a camera's frame task waiting here would
+    //  otherwise pick up another camera's whole frame task and hold its own frame back behind it. Any
+    //  band taken is running on some thread, so this can be called from within a task, nested too.
+    //  Without workers the whole range runs on the caller.
+    void parallel_for(int count, int grain, const std::function<void(int, int)> &body);
+
+    int size() const { return (int)workers.size(); }
+
+    std::vector<WorkerStats> stats() const;
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<uint64_t> tasksRun{0};
+        std::atomic<uint64_t> tasksStolen{0};
+    };
+
+    void run(int index);
+    void push(std::function<void()> task);
+    // Runs one task from self's deque or stolen from another, self is -1 for threads outside the pool
+    bool runOne(int self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned> nextWorker{0};
+
+    // Tasks sitting in deques, and those plus the ones running
+    std::atomic<int> queued{0};
+    std::atomic<int> pending{0};
+    bool stopping = false;
+    std::mutex sleepMutex;
+    std::condition_variable wake, idle;
+
+    std::chrono::steady_clock::time_point started;
+};
+
+#endif
@@ -0,0 +1,282 @@
+#include "zone_alarm.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include "thermal.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace cv;
+
+// Reads x, y pairs; false if there aren't any or one is missing its y
+static bool read_points(const FileNode &node, std::vector<Point> &points)
+{
+    std::vector<int> values;
+    for (FileNodeIterator it = node.begin(); it != node.end(); ++it)
+    {
+        values.push_back((int)*it);
+    }
+    if (values.empty() || values.size() % 2 != 0)
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < values.size(); i += 2)
+    {
+        points.push_back(Point(values[i], values[i + 1]));
+    }
+    return true;
+}
+
+bool load_zones(const std::string &path, std::vector<Zone> &zones)
+{
+    FileStorage storage(path, FileStorage::READ);
+    if (!storage.isOpened())
+    {
+        std::cerr << "Could not open zones file " << path << std::endl;
+        return false;
+    }
+
+    FileNode list = storage["zones"];
+    if (!list.isSeq())
+    {
+        std::cerr << path << ": expected a zones list" << std::endl;
+        return false;
+    }
+
+    for (FileNodeIterator it = list.begin(); it != list.end(); ++it)
+    {
+        FileNode node = *it;
+        Zone zone;
+        zone.name = node["name"].isString() ? (std::string)node["name"] : "zone" + std::to_string(zones.size());
+
+        std::vector<Point> points;
+        if (!node["rect"].empty())
+        {
+            if (!read_points(node["rect"], points) || points.size() != 2 || points[1].x < 1 || points[1].y < 1)
+            {
+                std::cerr << path << ": zone " << zone.name << " needs rect: [ x, y, width, height ]" << std::endl;
+                return false;
+            }
+            // fillPoly includes the edges, the far corner is the last pixel inside
+            Point first = points[0], last = points[0] + points[1] - Point(1, 1);
+            zone.polygon = {first, Point(last.x, first.y), last, Point(first.x, last.y)};
+        }
+        else if (!read_points(node["polygon"], zone.polygon) || zone.polygon.size() < 3)
+        {
+            std::cerr << path << ": zone " << zone.name << " needs a rect or a polygon of at least 3 points" << std::endl;
+            return false;
+        }
+
+        zone.watchMax = !node["max"].empty();
+        zone.watchMean = !node["mean"].empty();
+        if (!zone.watchMax && !zone.watchMean)
+        {
+            std::cerr << path << ": zone " << zone.name << " has no max or mean threshold" << std::endl;
+            return false;
+        }
+        if (zone.watchMax)
+        {
+            zone.maxCelcius = (double)node["max"];
+        }
+        if (zone.watchMean)
+        {
+            zone.meanCelcius = (double)node["mean"];
+        }
+        if (!node["hysteresis"].empty())
+        {
+            zone.hysteresisCelcius = (double)node["hysteresis"];
+        }
+        zones.push_back(zone);
+    }
+
+    return true;
+}
+
+// The zone's name as a JSON string body, names come from the config file as they are
+static std::string json_escape(const std::string &text)
+{
+    std::string out;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string zone_event_json(const ZoneEvent &event, int cameraId)
+{
+    char rest[160];
+    snprintf(rest, sizeof(rest), "\",\"state\":\"%s\",\"sequence\":%u,\"time\":%llu,\"max\":%.2f,\"mean\":%.2f}",
+             event.raised ? "raised" : "cleared", event.sequence, (unsigned long long)event.captureTimeUs, event.max, event.mean);
+    return "{\"camera\":" + std::to_string(cameraId) + ",\"zone\":\"" + json_escape(event.zone) + rest;
+}
+
+void ZoneAlarms::setup(const std::vector<Zone> &zoneList, Size frameSize)
+{
+    zones.clear();
+    Mat mask(frameSize, CV_8UC1);
+    for (const Zone &zone : zoneList)
+    {
+        // Rasterized by fillPoly, which also does the clipping
+        mask.setTo(Scalar(0));
+        fillPoly(mask, std::vector<std::vector<Point>>{zone.polygon}, Scalar(255));
+
+        State state;
+        state.zone = zone;
+        for (int y = 0; y < mask.rows; y++)
+        {
+            const uchar *row = mask.ptr<uchar>(y);
+            for (int x = 0; x < mask.cols; x++)
+            {
+                if (!row[x])
+                {
+                    continue;
+                }
+                Span span;
+                span.row = y;
+                span.begin = x;
+                while (x < mask.cols && row[x])
+                {
+                    x++;
+                }
+                span.end = x;
+                state.pixels += span.end - span.begin;
+                state.spans.push_back(span);
+            }
+        }
+
+        if (state.spans.empty())
+        {
+            std::cerr << "Zone " << zone.name << " is outside the " << frameSize.width << "x" << frameSize.height << " frame, ignored" << std::endl;
+            continue;
+        }
+        zones.push_back(state);
+    }
+}
+
+// Max and sum of a run of pixels, without branches so that it vectorizes. A run is at most a row, far
+//  below what would overflow the 32 bit sum.
+static void span_max_sum(const uint16_t *pixels, int count, uint16_t &max, uint64_t &sum)
+{
+    uint16_t m = max;
+    uint32_t s = 0;
+    for (int i = 0; i < count; i++)
+    {
+        m = std::max(m, pixels[i]);
+        s += pixels[i];
+    }
+    max = m;
+    sum += s;
+}
+
+bool ZoneAlarms::evaluate(const Mat &raw, int deviceTempSensor, uint32_t sequence, uint64_t captureTimeUs, std::vector<ZoneEvent> &events)
+{
+    double device_k = device_sensor_to_k(deviceTempSensor);
+    double offset = temp_from_raw(0, device_k);
+    double perCount = temp_from_raw(1, device_k) - offset;
+
+    bool any = false;
+    for (State &state : zones)
+    {
+        uint16_t maxRaw = 0;
+        uint64_t sum = 0;
+        for (const Span &span : state.spans)
+        {
+            span_max_sum(raw.ptr<uint16_t>(span.row) + span.begin, span.end - span.begin, maxRaw, sum);
+        }
+
+        // temp_from_raw is linear, the mean of the temperatures is the temperature of the mean
+        double max = temp_from_raw(maxRaw, device_k);
+        double mean = offset + perCount * sum / state.pixels;
+
+        const Zone &zone = state.zone;
+        bool alarm;
+        if (!state.alarm)
+        {
+            alarm = (zone.watchMax && max > zone.maxCelcius) || (zone.watchMean && mean > zone.meanCelcius);
+        }
+        else
+        {
+            alarm = (zone.watchMax && max >= zone.maxCelcius - zone.hysteresisCelcius) ||
+                    (zone.watchMean && mean >= zone.meanCelcius - zone.hysteresisCelcius);
+        }
+
+        if (alarm != state.alarm)
+        {
+            ZoneEvent event;
+            event.zone = zone.name;
+            event.raised = alarm;
+            event.sequence = sequence;
+            event.captureTimeUs = captureTimeUs;
+            event.max = max;
+            event.mean = mean;
+            events.push_back(event);
+            state.alarm = alarm;
+        }
+        any = any || alarm;
+    }
+
+    return any;
+}
+
+bool ZoneAlarms::active() const
+{
+    for (const State &state : zones)
+    {
+        if (state.alarm)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AlarmChannel::open(const std::string &target)
+{
+    auto colon = target.rfind(':');
+    if (colon == std::string::npos)
+    {
+        std::cerr << "Alarm channel needs host:port, got " << target << std::endl;
+        return false;
+    }
+
+    address = sf::IpAddress(target.substr(0, colon));
+    if (address == sf::IpAddress::None)
+    {
+        std::cerr << "Could not resolve alarm channel host " << target.substr(0, colon) << std::endl;
+        return false;
+    }
+    std::string portText = target.substr(colon + 1);
+    char *end = nullptr;
+    long value = std::strtol(portText.c_str(), &end, 10);
+    if (portText.empty() || *end != '\0' || value < 1 || value > 65535)
+    {
+        std::cerr << "Alarm channel port must be 1-65535, got " << portText << std::endl;
+        return false;
+    }
+    port = (unsigned short)value;
+    return true;
+}
+
+void AlarmChannel::send(const std::string &json)
+{
+    if (isOpen())
+    {
+        socket.send(json.data(), json.size(), address, port);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef ZONE_ALARM_H
+#define ZONE_ALARM_H
+
+#include <opencv2/core/core.hpp>
+#include <SFML/Network.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Alarm zones: areas of the frame, each with its own thresholds, evaluated on every raw frame.
+//
+// Zones come from an OpenCV FileStorage file (YAML or JSON), in raw sensor pixels:
+//
+//   zones:
+//     - { name: door, rect: [ 40, 30, 60, 80 ], max: 38.0 }
+//     - { name: bed, polygon: [ 100, 20, 180, 20, 190, 120, 90, 110 ], max: 37.5, mean: 33.0, hysteresis: 1.0 }
+//
+// A zone alarms when its max (or mean) goes over max (or mean), and clears once every value it watches
+//  is hysteresis below its threshold again. A threshold left out isn't watched.
+struct Zone
+{
+    std::string name;
+    std::vector<cv::Point> polygon; // a rect is its four corners
+    double maxCelcius = 0;
+    double meanCelcius = 0;
+    bool watchMax = false;
+    bool watchMean = false;
+    double hysteresisCelcius = 0.5;
+};
+
+// Reads the zones of a FileStorage file, false with a message on std::cerr when that fails
+bool load_zones(const std::string &path, std::vector<Zone> &zones);
+
+// A zone going into or out of alarm
+struct ZoneEvent
+{
+    std::string zone;
+    bool raised = false;
+    uint32_t sequence = 0;
+    uint64_t captureTimeUs = 0;
+    double max = 0;
+    double mean = 0;
+};
+
+// {"camera":..,"zone":"..","state":"raised"|"cleared",...}, one line of the alarm channel
+std::string zone_event_json(const ZoneEvent &event, int cameraId);
+
+// Evaluates zones on raw frames. Every zone is rasterized once into runs of pixels on a row, so a frame
+//  only touches the pixels inside the zones, in loops the compiler vectorizes.
+class ZoneAlarms
+{
+public:
+    // Clips the zones to frameSize; a zone with no pixel inside the frame is dropped with a warning
+    void setup(const std::vector<Zone> &zones, cv::Size frameSize);
+
+    // Appends the zones that changed state to events, true while any zone is in alarm
+    bool evaluate(const cv::Mat &raw, int deviceTempSensor, uint32_t sequence, uint64_t captureTimeUs, std::vector<ZoneEvent> &events);
+
+    bool empty() const { return zones.empty(); }
+    bool active() const;
+
+private:
+    struct Span
+    {
+        int row;
+        int begin, end; // columns [begin, end)
+    };
+
+    struct State
+    {
+        Zone zone;
+        std::vector<Span> spans;
+        uint64_t pixels = 0;
+        bool alarm = false;
+    };
+
+    std::vector<State> zones;
+};
+
+// The lightweight alarm channel: one JSON datagram per event, to a UDP host:port. Nothing is resent.
+class AlarmChannel
+{
+public:
+    // target is host:port
+    bool open(const std::string &target);
+    bool isOpen() const { return port != 0; }
+
+    // One event, e.g. zone_event_json()
+    void send(const std::string &json);
+
+private:
+    sf::UdpSocket socket;
+    sf::IpAddress address;
+    unsigned short port = 0;
+};
+
+#endif